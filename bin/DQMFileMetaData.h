@@ -0,0 +1,342 @@
+#ifndef DQMServices_FwkIO_DQMFileMetaData_h
+#define DQMServices_FwkIO_DQMFileMetaData_h
+// -*- C++ -*-
+//
+// Package:     FwkIO
+// Class  :     DQMFileMetaData
+//
+/**\class DQMFileMetaData DQMFileMetaData.h DQMServices/FwkIO/bin/DQMFileMetaData.h
+
+ Description: Reads and writes the Indices tree and the meta data of DQM Root files for the programs in bin
+
+ Usage:
+    The programs work directly on the trees described in format.h, without the framework, so the
+    process histories are kept as the rows of the ProcessHistories tree. DQMFileMetaData collects
+    the histories and ParameterSets of all the input files, removing duplicates, and writes them
+    together with the name table and a checkpoint to the output file.
+
+    Problems are reported by throwing std::runtime_error.
+*/
+
+// system include files
+#include <string>
+#include <vector>
+#include <set>
+#include <memory>
+#include <stdexcept>
+#include <cstdlib>
+
+// user include files
+#include "TFile.h"
+#include "TTree.h"
+
+#include "DQMServices/FwkIO/plugins/format.h"
+#include "DQMServices/FwkIO/plugins/IndexOrderBuilder.h"
+
+// forward declarations
+
+struct ProcessConfigurationRow {
+  std::string m_processName;
+  std::string m_parameterSetID;
+  std::string m_releaseVersion;
+  std::string m_passID;
+  bool operator==(const ProcessConfigurationRow& iOther) const {
+    return m_processName == iOther.m_processName and m_parameterSetID == iOther.m_parameterSetID and
+      m_releaseVersion == iOther.m_releaseVersion and m_passID == iOther.m_passID;
+  }
+};
+typedef std::vector<ProcessConfigurationRow> HistoryRows;
+
+struct NameRow {
+  std::string m_fullName;
+  std::string m_path;
+  std::string m_name;
+  bool operator==(const NameRow& iOther) const {
+    return m_fullName == iOther.m_fullName;
+  }
+};
+
+struct IndexEntry {
+  unsigned int m_run;
+  unsigned int m_lumi;
+  unsigned int m_historyIndex;
+  ULong64_t m_beginTime;
+  ULong64_t m_endTime;
+  unsigned int m_type;
+  ULong64_t m_firstIndex;
+  ULong64_t m_lastIndex;
+};
+
+inline void throwFileError(const std::string& iFileName, const std::string& iMessage) {
+  throw std::runtime_error(iFileName+": "+iMessage);
+}
+
+inline TTree* getTree(TDirectory* iDirectory, const char* iName, const std::string& iFileName) {
+  TTree* tree = dynamic_cast<TTree*>(iDirectory->Get(iName));
+  if(0 == tree) {
+    throwFileError(iFileName,std::string("does not have the ")+iName+" tree, it is not a DQM Root file or is corrupted");
+  }
+  return tree;
+}
+
+//Opens a DQM Root file and checks its file format version, which is the title of the TFile
+inline std::unique_ptr<TFile> openDQMFileOfAnyVersion(const std::string& iFileName, unsigned int& oVersion) {
+  std::unique_ptr<TFile> file(TFile::Open(iFileName.c_str()));
+  if(0 == file.get() or file->IsZombie()) {
+    throwFileError(iFileName,"could not be opened");
+  }
+  oVersion = atoi(file->GetTitle());
+  if(oVersion < kFirstFileFormatVersion or oVersion > kLatestFileFormatVersion) {
+    throwFileError(iFileName,std::string("is not a DQM Root file or has a newer file format version (")+file->GetTitle()+")");
+  }
+  return file;
+}
+
+//Same but only for the file format versions the copy and merge tools can handle
+inline std::unique_ptr<TFile> openDQMFile(const std::string& iFileName, unsigned int& oVersion) {
+  std::unique_ptr<TFile> file = openDQMFileOfAnyVersion(iFileName,oVersion);
+  if(oVersion >= kColumnarFileFormatVersion) {
+    throwFileError(iFileName,std::string("stores its histograms as columns (file format version ")+file->GetTitle()+
+                   ") which can not be copied or merged by this tool yet, use DQMRootSource and DQMRootOutputModule");
+  }
+  return file;
+}
+
+inline TDirectory* getMetaDataDirectory(TFile* iFile, const std::string& iFileName) {
+  TDirectory* metaDir = iFile->GetDirectory(kMetaDataDirectoryAbsolute);
+  if(0 == metaDir) {
+    throwFileError(iFileName,"does not have the meta data, check to see if the file was closed properly");
+  }
+  return metaDir;
+}
+
+//As DQMRootSource does, the entries written after the last checkpoint are ignored.
+// Returns true if that happened.
+inline bool readIndices(TFile* iFile, TDirectory* iMetaDir, const std::string& iFileName, std::vector<IndexEntry>& oEntries) {
+  TTree* indicesTree = getTree(iFile,kIndicesTree,iFileName);
+  IndexEntry entry;
+  indicesTree->SetBranchAddress(kRunBranch,&entry.m_run);
+  indicesTree->SetBranchAddress(kLumiBranch,&entry.m_lumi);
+  indicesTree->SetBranchAddress(kProcessHistoryIndexBranch,&entry.m_historyIndex);
+  indicesTree->SetBranchAddress(kBeginTimeBranch,&entry.m_beginTime);
+  indicesTree->SetBranchAddress(kEndTimeBranch,&entry.m_endTime);
+  indicesTree->SetBranchAddress(kTypeBranch,&entry.m_type);
+  indicesTree->SetBranchAddress(kFirstIndex,&entry.m_firstIndex);
+  indicesTree->SetBranchAddress(kLastIndex,&entry.m_lastIndex);
+  oEntries.clear();
+  oEntries.reserve(indicesTree->GetEntries());
+  for(Long64_t index = 0; index != indicesTree->GetEntries(); ++index) {
+    indicesTree->GetEntry(index);
+    oEntries.push_back(entry);
+  }
+  TTree* checkpointsTree = dynamic_cast<TTree*>(iMetaDir->Get(kCheckpointsTree));
+  if(0 != checkpointsTree and checkpointsTree->GetEntries() > 0) {
+    ULong64_t nIndices = 0;
+    checkpointsTree->SetBranchAddress(kCheckpointNIndicesBranch,&nIndices);
+    checkpointsTree->GetEntry(checkpointsTree->GetEntries()-1);
+    if(nIndices < oEntries.size()) {
+      oEntries.resize(nIndices);
+      return true;
+    }
+  }
+  return false;
+}
+
+inline void readNames(TDirectory* iMetaDir, const std::string& iFileName, std::vector<NameRow>& oNames) {
+  TTree* nameTree = getTree(iMetaDir,kNameTree,iFileName);
+  NameRow row;
+  std::string* pFullName = &row.m_fullName;
+  nameTree->SetBranchAddress(kNameFullNameBranch,&pFullName);
+  std::string* pPath = &row.m_path;
+  nameTree->SetBranchAddress(kNamePathBranch,&pPath);
+  std::string* pName = &row.m_name;
+  nameTree->SetBranchAddress(kNameLeafBranch,&pName);
+  oNames.clear();
+  oNames.reserve(nameTree->GetEntries());
+  for(Long64_t index = 0; index != nameTree->GetEntries(); ++index) {
+    nameTree->GetEntry(index);
+    oNames.push_back(row);
+  }
+}
+
+//The Indices tree of the output file
+class IndicesTree {
+public:
+  explicit IndicesTree(TDirectory* iFile):
+    m_tree(new TTree(kIndicesTree,kIndicesTree)) {
+    m_tree->Branch(kRunBranch,&m_buffer.m_run);
+    m_tree->Branch(kLumiBranch,&m_buffer.m_lumi);
+    m_tree->Branch(kProcessHistoryIndexBranch,&m_buffer.m_historyIndex);
+    m_tree->Branch(kBeginTimeBranch,&m_buffer.m_beginTime);
+    m_tree->Branch(kEndTimeBranch,&m_buffer.m_endTime);
+    m_tree->Branch(kTypeBranch,&m_buffer.m_type);
+    m_tree->Branch(kFirstIndex,&m_buffer.m_firstIndex);
+    m_tree->Branch(kLastIndex,&m_buffer.m_lastIndex);
+    m_tree->SetDirectory(iFile); //TFile takes ownership
+  }
+  void fill(const IndexEntry& iEntry) {
+    m_buffer = iEntry;
+    m_tree->Fill();
+    if(m_order.grouped()) {
+      //the programs do not reduce the histories, each one is its own group
+      m_order.add(iEntry.m_historyIndex,iEntry.m_run,iEntry.m_lumi);
+    }
+  }
+  ULong64_t entries() const { return m_tree->GetEntries();}
+  //if the entries are grouped the way DQMRootSource processes them
+  bool grouped() const { return m_order.grouped();}
+private:
+  TTree* m_tree;
+  IndexEntry m_buffer;
+  GroupedIndexOrder m_order;
+};
+
+class DQMFileMetaData {
+public:
+  DQMFileMetaData(): m_allParameterSetsHaveIDs(true) {}
+
+  //oHistories are the histories of the file, in the order used by its ProcessHistoryIndex
+  void add(TDirectory* iMetaDir, const std::string& iFileName, std::vector<HistoryRows>& oHistories) {
+    {
+      TTree* parameterSetTree = getTree(iMetaDir,kParameterSetTree,iFileName);
+      std::string blob;
+      std::string* pBlob = &blob;
+      parameterSetTree->SetBranchAddress(kParameterSetBranch,&pBlob);
+      std::string id;
+      std::string* pID = &id;
+      const bool hasIDs = 0 != parameterSetTree->GetBranch(kParameterSetIDBranch);
+      if(hasIDs) {
+        parameterSetTree->SetBranchAddress(kParameterSetIDBranch,&pID);
+      } else {
+        m_allParameterSetsHaveIDs = false;
+      }
+      for(Long64_t index = 0; index != parameterSetTree->GetEntries(); ++index) {
+        parameterSetTree->GetEntry(index);
+        if(m_parameterSetKeys.insert(hasIDs ? id : blob).second) {
+          m_parameterSetBlobs.push_back(blob);
+          m_parameterSetIDs.push_back(id);
+        }
+      }
+    }
+    TTree* processHistoryTree = getTree(iMetaDir,kProcessHistoryTree,iFileName);
+    unsigned int index = 0;
+    ProcessConfigurationRow row;
+    processHistoryTree->SetBranchAddress(kPHIndexBranch,&index);
+    std::string* pProcessName = &row.m_processName;
+    processHistoryTree->SetBranchAddress(kProcessConfigurationProcessNameBranch,&pProcessName);
+    std::string* pParameterSetID = &row.m_parameterSetID;
+    processHistoryTree->SetBranchAddress(kProcessConfigurationParameterSetIDBranch,&pParameterSetID);
+    std::string* pReleaseVersion = &row.m_releaseVersion;
+    processHistoryTree->SetBranchAddress(kProcessConfigurationReleaseVersion,&pReleaseVersion);
+    std::string* pPassID = &row.m_passID;
+    processHistoryTree->SetBranchAddress(kProcessConfigurationPassID,&pPassID);
+    oHistories.clear();
+    for(Long64_t i = 0; i != processHistoryTree->GetEntries(); ++i) {
+      processHistoryTree->GetEntry(i);
+      //each history starts with its configuration 0
+      if(0 == index or oHistories.empty()) {
+        oHistories.push_back(HistoryRows());
+      }
+      oHistories.back().push_back(row);
+    }
+  }
+
+  //the index to use in the output for the history
+  unsigned int historyIndex(const HistoryRows& iHistory) {
+    for(unsigned int index = 0; index != m_histories.size(); ++index) {
+      if(m_histories[index] == iHistory) {
+        return index;
+      }
+    }
+    m_histories.push_back(iHistory);
+    return m_histories.size()-1;
+  }
+
+  //iNames is only used when iUseNameTable is set
+  void write(TDirectory* iFile, const std::vector<NameRow>& iNames, bool iUseNameTable, const IndicesTree& iIndices) const {
+    TDirectory* metaDir = iFile->mkdir(kMetaDataDirectory);
+    {
+      TTree* processHistoryTree = new TTree(kProcessHistoryTree,kProcessHistoryTree);
+      processHistoryTree->SetDirectory(metaDir);
+      unsigned int index = 0;
+      ProcessConfigurationRow row;
+      processHistoryTree->Branch(kPHIndexBranch,&index);
+      processHistoryTree->Branch(kProcessConfigurationProcessNameBranch,&row.m_processName);
+      processHistoryTree->Branch(kProcessConfigurationParameterSetIDBranch,&row.m_parameterSetID);
+      processHistoryTree->Branch(kProcessConfigurationReleaseVersion,&row.m_releaseVersion);
+      processHistoryTree->Branch(kProcessConfigurationPassID,&row.m_passID);
+      for(std::vector<HistoryRows>::const_iterator it = m_histories.begin(), itEnd = m_histories.end();
+          it != itEnd;
+          ++it) {
+        index = 0;
+        for(HistoryRows::const_iterator itRow = it->begin(), itRowEnd = it->end();
+            itRow != itRowEnd;
+            ++itRow,++index) {
+          row = *itRow;
+          processHistoryTree->Fill();
+        }
+      }
+    }
+    {
+      TTree* parameterSetsTree = new TTree(kParameterSetTree,kParameterSetTree);
+      parameterSetsTree->SetDirectory(metaDir);
+      std::string blob;
+      std::string id;
+      parameterSetsTree->Branch(kParameterSetBranch,&blob);
+      //without the IDs of all the blobs the duplicates could not be removed reliably either
+      if(m_allParameterSetsHaveIDs) {
+        parameterSetsTree->Branch(kParameterSetIDBranch,&id);
+      }
+      for(unsigned int index = 0; index != m_parameterSetBlobs.size(); ++index) {
+        blob = m_parameterSetBlobs[index];
+        id = m_parameterSetIDs[index];
+        parameterSetsTree->Fill();
+      }
+    }
+    if(iUseNameTable) {
+      TTree* nameTree = new TTree(kNameTree,kNameTree);
+      nameTree->SetDirectory(metaDir);
+      NameRow row;
+      nameTree->Branch(kNameFullNameBranch,&row.m_fullName);
+      nameTree->Branch(kNamePathBranch,&row.m_path);
+      nameTree->Branch(kNameLeafBranch,&row.m_name);
+      for(std::vector<NameRow>::const_iterator it = iNames.begin(), itEnd = iNames.end();
+          it != itEnd;
+          ++it) {
+        row = *it;
+        nameTree->Fill();
+      }
+    }
+    TTree* checkpointsTree = new TTree(kCheckpointsTree,kCheckpointsTree);
+    checkpointsTree->SetDirectory(metaDir);
+    ULong64_t nIndices = iIndices.entries();
+    checkpointsTree->Branch(kCheckpointNIndicesBranch,&nIndices);
+    checkpointsTree->Fill();
+    if(iIndices.grouped()) {
+      //as DQMRootOutputModule does, without reducing the histories. A reader which
+      // reduces some of them to the same history recomputes the order.
+      TTree* reducedHistoriesTree = new TTree(kReducedHistoriesTree,kReducedHistoriesTree);
+      reducedHistoriesTree->SetDirectory(metaDir);
+      unsigned int reducedIndex = 0;
+      reducedHistoriesTree->Branch(kReducedHistoryIndexBranch,&reducedIndex);
+      for(; reducedIndex != m_histories.size(); ++reducedIndex) {
+        reducedHistoriesTree->Fill();
+      }
+      //no entries means grouped
+      TTree* orderedIndicesTree = new TTree(kOrderedIndicesTree,kOrderedIndicesTree);
+      orderedIndicesTree->SetDirectory(metaDir);
+      unsigned int index = 0;
+      orderedIndicesTree->Branch(kOrderedIndexBranch,&index);
+    }
+  }
+
+private:
+  std::vector<HistoryRows> m_histories;
+  std::vector<std::string> m_parameterSetBlobs;
+  std::vector<std::string> m_parameterSetIDs;
+  //the ID when stored, else the blob itself
+  std::set<std::string> m_parameterSetKeys;
+  bool m_allParameterSetsHaveIDs;
+};
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef DQMServices_FwkIO_DQMFileSummaries_h
+#define DQMServices_FwkIO_DQMFileSummaries_h
+// -*- C++ -*-
+//
+// Package:     FwkIO
+// Class  :     DQMFileSummaries
+//
+/**\class DQMFileSummaries DQMFileSummaries.h DQMServices/FwkIO/bin/DQMFileSummaries.h
+
+ Description: Reads the Summaries tree which DQMRootOutputModule writes when writeSummaries is set
+
+ Usage:
+    Each row has the statistics of one stored int, float or histogram entry so trends over
+    many runs and lumis can be made without reading, let alone decompressing, the payloads.
+    The full name is resolved through the name table when the file has one. When only the
+    rows of some MonitorElements are wanted, select compares just the name branch and only
+    reads the other branches of the matching rows.
+
+    Problems are reported by throwing std::runtime_error.
+*/
+
+// system include files
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// user include files
+#include "TFile.h"
+#include "TTree.h"
+#include "TBranch.h"
+
+#include "DQMServices/FwkIO/plugins/format.h"
+#include "DQMServices/FwkIO/bin/DQMFileMetaData.h"
+
+// forward declarations
+
+struct SummaryRow {
+  unsigned int m_run;
+  unsigned int m_lumi;
+  unsigned int m_historyIndex;
+  unsigned int m_type;
+  std::string m_fullName;
+  //the entry in the type tree
+  ULong64_t m_entry;
+  double m_entries;
+  double m_sumOfWeights;
+  double m_mean[3];
+  double m_rms[3];
+  double m_minContent;
+  double m_maxContent;
+};
+
+class DQMFileSummaries {
+public:
+  DQMFileSummaries(TFile* iFile, const std::string& iFileName):
+    m_tree(dynamic_cast<TTree*>(iFile->Get(kSummariesTree))),
+    m_nameBranch(0),
+    m_hasNameTable(false),
+    m_nameId(0),
+    m_pFullName(&m_row.m_fullName) {
+    if(0 == m_tree) {
+      throwFileError(iFileName,std::string("does not have the ")+kSummariesTree+
+                     " tree, it must be written with DQMRootOutputModule's writeSummaries set");
+    }
+    m_tree->SetBranchAddress(kRunBranch,&m_row.m_run);
+    m_tree->SetBranchAddress(kLumiBranch,&m_row.m_lumi);
+    m_tree->SetBranchAddress(kProcessHistoryIndexBranch,&m_row.m_historyIndex);
+    m_tree->SetBranchAddress(kTypeBranch,&m_row.m_type);
+    m_tree->SetBranchAddress(kSummaryEntryBranch,&m_row.m_entry);
+    m_tree->SetBranchAddress(kSummaryEntriesBranch,&m_row.m_entries);
+    m_tree->SetBranchAddress(kSummarySumOfWeightsBranch,&m_row.m_sumOfWeights);
+    m_tree->SetBranchAddress(kSummaryMeanBranch,m_row.m_mean);
+    m_tree->SetBranchAddress(kSummaryRMSBranch,m_row.m_rms);
+    m_tree->SetBranchAddress(kSummaryMinContentBranch,&m_row.m_minContent);
+    m_tree->SetBranchAddress(kSummaryMaxContentBranch,&m_row.m_maxContent);
+    m_nameBranch = m_tree->GetBranch(kNameIdBranch);
+    m_hasNameTable = 0 != m_nameBranch;
+    if(m_hasNameTable) {
+      readNames(getMetaDataDirectory(iFile,iFileName),iFileName,m_names);
+      m_tree->SetBranchAddress(kNameIdBranch,&m_nameId);
+    } else {
+      m_nameBranch = m_tree->GetBranch(kFullNameBranch);
+      if(0 == m_nameBranch) {
+        throwFileError(iFileName,std::string("the ")+kSummariesTree+" tree has neither a "+kNameIdBranch+" nor a "+kFullNameBranch+" branch");
+      }
+      m_tree->SetBranchAddress(kFullNameBranch,&m_pFullName);
+    }
+  }
+
+  ULong64_t size() const { return m_tree->GetEntries();}
+
+  const SummaryRow& row(ULong64_t iIndex) {
+    m_tree->GetEntry(iIndex);
+    resolveName();
+    return m_row;
+  }
+
+  //the rows of the MonitorElements with one of the full names, in the order they were written
+  void select(const std::vector<std::string>& iFullNames, std::vector<SummaryRow>& oRows) {
+    oRows.clear();
+    std::vector<uint32_t> ids;
+    if(m_hasNameTable) {
+      for(uint32_t id = 0; id != m_names.size(); ++id) {
+        if(std::find(iFullNames.begin(),iFullNames.end(),m_names[id].m_fullName) != iFullNames.end()) {
+          ids.push_back(id);
+        }
+      }
+      if(ids.empty()) {
+        return;
+      }
+    }
+    for(Long64_t index = 0; index != m_tree->GetEntries(); ++index) {
+      m_nameBranch->GetEntry(index);
+      const bool selected = m_hasNameTable ?
+        std::find(ids.begin(),ids.end(),m_nameId) != ids.end() :
+        std::find(iFullNames.begin(),iFullNames.end(),m_row.m_fullName) != iFullNames.end();
+      if(selected) {
+        oRows.push_back(row(index));
+      }
+    }
+  }
+
+private:
+  void resolveName() {
+    if(m_hasNameTable) {
+      m_row.m_fullName = m_nameId < m_names.size() ? m_names[m_nameId].m_fullName : std::string();
+    }
+  }
+
+  TTree* m_tree;
+  TBranch* m_nameBranch;
+  bool m_hasNameTable;
+  std::vector<NameRow> m_names;
+  uint32_t m_nameId;
+  SummaryRow m_row;
+  std::string* m_pFullName;
+};
+
+#endif
@@ -0,0 +1,253 @@
+// -*- C++ -*-
+//
+// Package:     FwkIO
+// Program:     dqmFastCopy
+//
+/*
+ Description: Copies, filters on run or concatenates DQM Root files without going through a DQMStore
+
+ Usage:
+    dqmFastCopy [--run <run number> ...] -o <output file> <input file> [<input file> ...]
+
+    When all the entries of an input file are kept, the baskets of its type trees are
+    copied without being uncompressed (TTree fast cloning). Only the Indices tree and the
+    meta data are rewritten. When a file has runs which are dropped, or was not closed
+    properly, the kept entries are copied one by one which still avoids the DQMStore.
+
+    The input files are concatenated, not merged. A run or lumi found in several input
+    files is stored several times and DQMRootSource merges them when reading, just as
+    when reading the input files themselves. All input files must have the same file
+    format version. With a name table, the output has the names of all the input files.
+    The entries of a file whose names do not have the same ids in it are copied one by
+    one with their NameId changed.
+*/
+//
+
+// system include files
+#include <iostream>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <boost/program_options.hpp>
+
+// user include files
+#include "TFile.h"
+#include "TTree.h"
+#include "TH1.h"
+
+#include "DQMServices/FwkIO/plugins/format.h"
+#include "DQMServices/FwkIO/bin/DQMFileMetaData.h"
+
+namespace {
+  class FastCopier {
+  public:
+    FastCopier(const std::string& iOutputFileName, const std::set<unsigned int>& iRuns):
+      m_outputFileName(iOutputFileName),
+      m_runs(iRuns),
+      m_fileFormatVersion(0),
+      m_typeTrees(kNIndicies,static_cast<TTree*>(0)) {}
+
+    void add(const std::string& iInputFileName);
+    void finish();
+
+  private:
+    bool mergeNames(TDirectory* iMetaDir, const std::string& iFileName, std::vector<uint32_t>& oNameIds);
+
+    std::string m_outputFileName;
+    std::set<unsigned int> m_runs;
+    unsigned int m_fileFormatVersion;
+
+    std::unique_ptr<TFile> m_outputFile;
+    std::unique_ptr<IndicesTree> m_indicesTree;
+    DQMFileMetaData m_metaData;
+    std::vector<NameRow> m_names;
+    std::map<std::string, uint32_t> m_nameIds;
+    std::vector<TTree*> m_typeTrees;
+  };
+
+  //Adds the names of the file to the output name table. oNameIds is the output id of
+  // each id of the file. Returns true if they are the same so the NameIds can be copied.
+  bool FastCopier::mergeNames(TDirectory* iMetaDir, const std::string& iFileName, std::vector<uint32_t>& oNameIds) {
+    std::vector<NameRow> names;
+    readNames(iMetaDir,iFileName,names);
+    oNameIds.clear();
+    oNameIds.reserve(names.size());
+    bool sameIds = true;
+    for(std::vector<NameRow>::const_iterator it = names.begin(), itEnd = names.end();
+        it != itEnd;
+        ++it) {
+      std::pair<std::map<std::string, uint32_t>::iterator,bool> inserted =
+        m_nameIds.insert(std::make_pair(it->m_fullName,static_cast<uint32_t>(m_names.size())));
+      if(inserted.second) {
+        m_names.push_back(*it);
+      }
+      sameIds = sameIds and inserted.first->second == oNameIds.size();
+      oNameIds.push_back(inserted.first->second);
+    }
+    return sameIds;
+  }
+
+  void FastCopier::add(const std::string& iInputFileName) {
+    unsigned int version = 0;
+    std::unique_ptr<TFile> file = openDQMFile(iInputFileName,version);
+    if(0 == m_outputFile.get()) {
+      m_fileFormatVersion = version;
+      m_outputFile.reset(new TFile(m_outputFileName.c_str(),"RECREATE",file->GetTitle()));
+      if(m_outputFile->IsZombie()) {
+        throwFileError(m_outputFileName,"could not be created");
+      }
+      m_indicesTree.reset(new IndicesTree(m_outputFile.get()));
+    } else if(version != m_fileFormatVersion) {
+      throwFileError(iInputFileName,"has a different file format version than the previous input files");
+    }
+    TDirectory* metaDir = getMetaDataDirectory(file.get(),iInputFileName);
+    std::vector<HistoryRows> histories;
+    m_metaData.add(metaDir,iInputFileName,histories);
+    std::vector<uint32_t> nameIds;
+    const bool sameNameIds = m_fileFormatVersion < kNameTableFileFormatVersion or mergeNames(metaDir,iInputFileName,nameIds);
+
+    std::vector<IndexEntry> entries;
+    //the baskets can only be copied if the NameIds stored in them are still right
+    bool keepAll = not readIndices(file.get(),metaDir,iInputFileName,entries) and sameNameIds;
+    std::vector<IndexEntry> kept;
+    kept.reserve(entries.size());
+    for(std::vector<IndexEntry>::const_iterator it = entries.begin(), itEnd = entries.end();
+        it != itEnd;
+        ++it) {
+      if(it->m_historyIndex >= histories.size()) {
+        throwFileError(iInputFileName,"refers to a process history it does not store");
+      }
+      if(m_runs.empty() or m_runs.find(it->m_run) != m_runs.end()) {
+        kept.push_back(*it);
+      } else {
+        keepAll = false;
+      }
+    }
+
+    std::vector<ULong64_t> offsets(kNIndicies,0);
+    for(unsigned int type = 0; type != kNIndicies; ++type) {
+      TTree* tree = getTree(file.get(),kTypeNames[type],iInputFileName);
+      if(0 == m_typeTrees[type]) {
+        m_outputFile->cd();
+        //keeps the branches and basket sizes so later files can be fast cloned as well
+        m_typeTrees[type] = tree->CloneTree(0);
+        m_typeTrees[type]->SetDirectory(m_outputFile.get());
+      }
+      TTree* outputTree = m_typeTrees[type];
+      offsets[type] = outputTree->GetEntries();
+      if(keepAll) {
+        if(0 != tree->GetEntries() and outputTree->CopyEntries(tree,-1,"fast") < 0) {
+          throwFileError(iInputFileName,std::string("the ")+kTypeNames[type]+" tree could not be copied");
+        }
+        continue;
+      }
+      tree->CopyAddresses(outputTree);
+      uint32_t nameId = 0;
+      if(not sameNameIds) {
+        tree->SetBranchAddress(kNameIdBranch,&nameId);
+        outputTree->SetBranchAddress(kNameIdBranch,&nameId);
+      }
+      for(std::vector<IndexEntry>::iterator it = kept.begin(), itEnd = kept.end();
+          it != itEnd;
+          ++it) {
+        if(it->m_type != type) {
+          continue;
+        }
+        const ULong64_t firstIndex = outputTree->GetEntries();
+        for(ULong64_t index = it->m_firstIndex; index <= it->m_lastIndex; ++index) {
+          if(tree->GetEntry(index) <= 0) {
+            throwFileError(iInputFileName,std::string("the ")+kTypeNames[type]+" tree could not be read");
+          }
+          if(not sameNameIds) {
+            if(nameId >= nameIds.size()) {
+              throwFileError(iInputFileName,"refers to a name which is not in its name table");
+            }
+            nameId = nameIds[nameId];
+          }
+          outputTree->Fill();
+        }
+        //already relative to the start of the output tree
+        it->m_firstIndex = firstIndex - offsets[type];
+        it->m_lastIndex = outputTree->GetEntries()-1 - offsets[type];
+      }
+      tree->CopyAddresses(outputTree,true);
+    }
+
+    std::vector<unsigned int> historyIndices(histories.size(),kNoTypesStored);
+    for(std::vector<IndexEntry>::iterator it = kept.begin(), itEnd = kept.end();
+        it != itEnd;
+        ++it) {
+      if(historyIndices[it->m_historyIndex] == kNoTypesStored) {
+        historyIndices[it->m_historyIndex] = m_metaData.historyIndex(histories[it->m_historyIndex]);
+      }
+      it->m_historyIndex = historyIndices[it->m_historyIndex];
+      //markers and kNoTypesStored have no elements
+      if(it->m_type < kNIndicies) {
+        it->m_firstIndex += offsets[it->m_type];
+        it->m_lastIndex += offsets[it->m_type];
+      }
+      m_indicesTree->fill(*it);
+    }
+  }
+
+  void FastCopier::finish() {
+    if(0 == m_outputFile.get()) {
+      return;
+    }
+    m_metaData.write(m_outputFile.get(),m_names,m_fileFormatVersion >= kNameTableFileFormatVersion,*m_indicesTree);
+    m_outputFile->Write();
+    m_outputFile->Close();
+    m_outputFile.reset();
+  }
+}
+
+int main(int argc, char* argv[]) {
+  namespace po = boost::program_options;
+  po::options_description desc("Allowed options");
+  desc.add_options()
+    ("help,h", "produce help message")
+    ("output,o", po::value<std::string>(), "name of the output file")
+    ("run,r", po::value<std::vector<unsigned int> >(), "only copy this run, can be given several times")
+    ("input", po::value<std::vector<std::string> >(), "input files");
+  po::positional_options_description positional;
+  positional.add("input", -1);
+
+  po::variables_map vm;
+  try {
+    po::store(po::command_line_parser(argc,argv).options(desc).positional(positional).run(),vm);
+    po::notify(vm);
+  } catch(const po::error& e) {
+    std::cerr <<e.what()<<"\n"<<desc<<std::endl;
+    return 1;
+  }
+  if(vm.count("help") or 0 == vm.count("output") or 0 == vm.count("input")) {
+    std::cout <<"Usage: dqmFastCopy [--run <run number> ...] -o <output file> <input file> [<input file> ...]\n"
+              <<" Copies DQM Root files, only keeping the given runs, without going through a DQMStore.\n"
+              <<desc<<std::endl;
+    return vm.count("help") ? 0 : 1;
+  }
+  std::set<unsigned int> runs;
+  if(vm.count("run")) {
+    const std::vector<unsigned int>& r = vm["run"].as<std::vector<unsigned int> >();
+    runs.insert(r.begin(),r.end());
+  }
+
+  TH1::AddDirectory(kFALSE);
+  try {
+    FastCopier copier(vm["output"].as<std::string>(),runs);
+    const std::vector<std::string>& inputs = vm["input"].as<std::vector<std::string> >();
+    for(std::vector<std::string>::const_iterator it = inputs.begin(), itEnd = inputs.end();
+        it != itEnd;
+        ++it) {
+      copier.add(*it);
+    }
+    copier.finish();
+  } catch(const std::exception& e) {
+    std::cerr <<"dqmFastCopy failed: "<<e.what()<<std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,794 @@
+// -*- C++ -*-
+//
+// Package:     FwkIO
+// Program:     dqmMerge
+//
+/*
+ Description: Merges DQM Root files using several threads
+
+ Usage:
+    dqmMerge [-j <number of threads>] [--file-format-version <version>] -o <output file> <input file> [<input file> ...]
+
+    The MonitorElements with the same process history, run, lumi and name are combined using the
+    rules of DQMRootSource (see ElementMergeRules). Each thread reads a whole input file. The
+    results are merged along a balanced binary tree over the file indices which is fixed before
+    any file is read: the range [first,end) is always the merge of [first,mid) and [mid,end)
+    with mid = first+(end-first)/2. A merge starts as soon as both halves are available, so
+    the threads only decide when it happens, never what is merged with what, and the output
+    does not depend on which thread finishes first.
+
+    Everything merged is kept in memory until the output is written. Besides the merged output
+    itself, the results of up to about one range per level of the tree plus one per thread are
+    held, each at most as large as the output, so the memory needed is at most roughly
+    (log2(number of input files)+number of threads) times the uncompressed size of the output.
+    Split very large merges by run with dqmFastCopy --run first if that is too much.
+
+    Unlike a cmsRun job using DQMRootSource and DQMRootOutputModule, the process histories of the
+    input files are kept as they are, and a MonitorElement is not written for a lumi in which no
+    input file stored it.
+*/
+//
+
+// system include files
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <chrono>
+#include <cassert>
+#include <boost/program_options.hpp>
+
+// user include files
+#include "TFile.h"
+#include "TTree.h"
+#include "TBranch.h"
+#include "TH1.h"
+#include "TH2.h"
+#include "TH3.h"
+#include "TProfile.h"
+#include "TProfile2D.h"
+#include "TThread.h"
+#include "TClass.h"
+
+#include "DQMServices/FwkIO/plugins/format.h"
+#include "DQMServices/FwkIO/plugins/ElementMergeRules.h"
+#include "DQMServices/FwkIO/bin/DQMFileMetaData.h"
+
+namespace {
+  bool isSnapshotMarker(unsigned int iType) {
+    return iType == kFullSnapshot or iType == kCarryForwardSnapshot;
+  }
+
+  struct Key {
+    unsigned int m_history;
+    unsigned int m_run;
+    unsigned int m_lumi;
+    //the lumis of a run come before the run itself, as when DQMRootOutputModule writes them
+    bool operator<(const Key& iOther) const {
+      if(m_history != iOther.m_history) {
+        return m_history < iOther.m_history;
+      }
+      if(m_run != iOther.m_run) {
+        return m_run < iOther.m_run;
+      }
+      if(m_lumi == iOther.m_lumi or 0 == m_lumi) {
+        return false;
+      }
+      return 0 == iOther.m_lumi or m_lumi < iOther.m_lumi;
+    }
+  };
+
+  struct KeyTimes {
+    ULong64_t m_beginTime;
+    ULong64_t m_endTime;
+  };
+
+  struct InputFile {
+    std::string m_name;
+    unsigned int m_fileFormatVersion;
+    std::vector<NameRow> m_names;
+    //the ProcessHistoryIndex is already the one used in the output
+    std::vector<IndexEntry> m_entries;
+  };
+
+  struct Element {
+    Element(): m_type(kNoTypesStored), m_tag(0), m_int(0), m_float(0) {}
+    unsigned int m_type;
+    uint32_t m_tag;
+    std::unique_ptr<TH1> m_hist;
+    Long64_t m_int;
+    double m_float;
+    std::string m_string;
+  };
+  //sorted by name so the output does not depend on the order of the input entries
+  typedef std::map<std::string, Element> Elements;
+
+  //the merged content of the input files [m_firstFile, m_endFile)
+  struct Partial {
+    unsigned int m_firstFile;
+    unsigned int m_endFile;
+    std::map<Key, Elements> m_contents;
+  };
+
+  std::mutex s_reportMutex;
+  void report(const std::string& iMessage) {
+    std::lock_guard<std::mutex> lock(s_reportMutex);
+    std::cerr <<iMessage<<std::endl;
+  }
+
+  template<class T>
+  void mergeHistograms(const std::string& iName, Element& ioOriginal, Element& iToAdd) {
+    switch(ElementMergeRules::mergeHistograms(static_cast<T*>(ioOriginal.m_hist.get()),static_cast<T*>(iToAdd.m_hist.get()))) {
+      case ElementMergeRules::kMergeFailed:
+        report("Failed to merge DQM element "+iName);
+        break;
+      case ElementMergeRules::kDifferentAxes:
+        report("Found histograms with different axis limits '"+iName+"' not merged.");
+        break;
+      case ElementMergeRules::kMerged:
+        break;
+    }
+  }
+
+  void mergeElement(const std::string& iName, Element& ioOriginal, Element& iToAdd) {
+    if(ioOriginal.m_type != iToAdd.m_type) {
+      report("The DQM element "+iName+" is stored with different types, only the first one is kept.");
+      return;
+    }
+    switch(ioOriginal.m_type) {
+      case kIntIndex:
+        ioOriginal.m_int = ElementMergeRules::mergeInts(iName,ioOriginal.m_int,iToAdd.m_int);
+        break;
+      case kTH1FIndex: mergeHistograms<TH1F>(iName,ioOriginal,iToAdd); break;
+      case kTH1SIndex: mergeHistograms<TH1S>(iName,ioOriginal,iToAdd); break;
+      case kTH1DIndex: mergeHistograms<TH1D>(iName,ioOriginal,iToAdd); break;
+      case kTH2FIndex: mergeHistograms<TH2F>(iName,ioOriginal,iToAdd); break;
+      case kTH2SIndex: mergeHistograms<TH2S>(iName,ioOriginal,iToAdd); break;
+      case kTH2DIndex: mergeHistograms<TH2D>(iName,ioOriginal,iToAdd); break;
+      case kTH3FIndex: mergeHistograms<TH3F>(iName,ioOriginal,iToAdd); break;
+      case kTProfileIndex: mergeHistograms<TProfile>(iName,ioOriginal,iToAdd); break;
+      case kTProfile2DIndex: mergeHistograms<TProfile2D>(iName,ioOriginal,iToAdd); break;
+      default:
+        //Floats and Strings are not merged
+        break;
+    }
+    //as DQMStore::tag is called by DQMRootSource
+    if(0 != iToAdd.m_tag) {
+      ioOriginal.m_tag = iToAdd.m_tag;
+    }
+  }
+
+  void mergeInto(Elements& ioOriginal, Elements& iToAdd) {
+    for(Elements::iterator it = iToAdd.begin(), itEnd = iToAdd.end();
+        it != itEnd;
+        ++it) {
+      Elements::iterator itFound = ioOriginal.find(it->first);
+      if(itFound == ioOriginal.end()) {
+        ioOriginal[it->first] = std::move(it->second);
+      } else {
+        mergeElement(it->first,itFound->second,it->second);
+      }
+    }
+  }
+
+  //iToAdd must hold the files just after those of ioOriginal
+  void mergeInto(Partial& ioOriginal, Partial& iToAdd) {
+    for(std::map<Key, Elements>::iterator it = iToAdd.m_contents.begin(), itEnd = iToAdd.m_contents.end();
+        it != itEnd;
+        ++it) {
+      std::map<Key, Elements>::iterator itFound = ioOriginal.m_contents.find(it->first);
+      if(itFound == ioOriginal.m_contents.end()) {
+        ioOriginal.m_contents[it->first].swap(it->second);
+      } else {
+        mergeInto(itFound->second,it->second);
+      }
+    }
+    ioOriginal.m_endFile = iToAdd.m_endFile;
+  }
+
+  //Reads the entries of one type tree of an input file
+  class TypeTreeReader {
+  public:
+    TypeTreeReader(TTree* iTree, unsigned int iType, const InputFile& iFile):
+      m_tree(iTree), m_type(iType), m_file(iFile),
+      m_nameBranch(0), m_fullNamePtr(&m_fullName), m_nameId(0), m_tag(0),
+      m_int(0), m_float(0), m_stringPtr(&m_string), m_object(0) {
+      if(iFile.m_fileFormatVersion >= kNameTableFileFormatVersion) {
+        m_tree->SetBranchAddress(kNameIdBranch,&m_nameId);
+        m_nameBranch = m_tree->GetBranch(kNameIdBranch);
+      } else {
+        m_tree->SetBranchAddress(kFullNameBranch,&m_fullNamePtr);
+        m_nameBranch = m_tree->GetBranch(kFullNameBranch);
+      }
+      m_tree->SetBranchAddress(kFlagBranch,&m_tag);
+      switch(m_type) {
+        case kIntIndex: m_tree->SetBranchAddress(kValueBranch,&m_int); break;
+        case kFloatIndex: m_tree->SetBranchAddress(kValueBranch,&m_float); break;
+        case kStringIndex: m_tree->SetBranchAddress(kValueBranch,&m_stringPtr); break;
+        default:
+          //if ROOT created the object it would delete it once the pointer changes
+          newObject();
+          m_tree->SetBranchAddress(kValueBranch,&m_object);
+          break;
+      }
+    }
+    ~TypeTreeReader() {
+      delete m_object;
+      m_tree->ResetBranchAddresses();
+    }
+
+    //only reads the name
+    const std::string& readName(ULong64_t iEntry) {
+      if(0 == m_nameBranch or m_nameBranch->GetEntry(iEntry) <= 0) {
+        failedToRead();
+      }
+      return name();
+    }
+
+    //oElement borrows the histogram read, which stays owned by the reader, see release()
+    const std::string& read(ULong64_t iEntry, Element& oElement) {
+      if(0 == m_object and m_type > kStringIndex) {
+        newObject();
+      }
+      if(m_tree->GetEntry(iEntry) <= 0) {
+        failedToRead();
+      }
+      oElement.m_type = m_type;
+      oElement.m_tag = m_tag;
+      oElement.m_int = m_int;
+      oElement.m_float = m_float;
+      oElement.m_string = m_string;
+      oElement.m_hist.reset(m_object);
+      return name();
+    }
+    //the histogram given by the last read now belongs to whoever kept it
+    void release() {
+      if(0 != m_object) {
+        m_object->SetDirectory(0);
+      }
+      m_object = 0;
+    }
+
+  private:
+    TypeTreeReader(const TypeTreeReader&); // stop default
+    const TypeTreeReader& operator=(const TypeTreeReader&); // stop default
+
+    void newObject() {
+      m_object = static_cast<TH1*>(TClass::GetClass(kTypeClassNames[m_type])->New());
+      m_object->SetDirectory(0);
+    }
+    const std::string& name() const {
+      if(0 == m_nameBranch or m_file.m_fileFormatVersion < kNameTableFileFormatVersion) {
+        return m_fullName;
+      }
+      if(m_nameId >= m_file.m_names.size()) {
+        throwFileError(m_file.m_name,"refers to a name which is not in its name table");
+      }
+      return m_file.m_names[m_nameId].m_fullName;
+    }
+    void failedToRead() const {
+      throwFileError(m_file.m_name,std::string("the ")+kTypeNames[m_type]+" tree could not be read");
+    }
+
+    TTree* m_tree;
+    unsigned int m_type;
+    const InputFile& m_file;
+    TBranch* m_nameBranch;
+    std::string m_fullName;
+    std::string* m_fullNamePtr;
+    uint32_t m_nameId;
+    uint32_t m_tag;
+    Long64_t m_int;
+    double m_float;
+    std::string m_string;
+    std::string* m_stringPtr;
+    TH1* m_object;
+  };
+
+  //An entry of a type tree and the run or lumi it is used for. The same entry is
+  // used for several lumis when a lumi only stores the elements which changed.
+  struct Read {
+    ULong64_t m_entry;
+    Key m_key;
+    bool operator<(const Read& iOther) const {
+      return m_entry < iOther.m_entry;
+    }
+  };
+
+  std::mutex s_rootMutex;
+
+  //opening and closing files changes the lists kept by gROOT
+  struct LockedClose {
+    void operator()(TFile* iFile) const {
+      std::lock_guard<std::mutex> lock(s_rootMutex);
+      delete iFile;
+    }
+  };
+
+  //Reads all the elements of the file, merging the ones with the same key and name
+  void readFile(const InputFile& iInput, Partial& oPartial) {
+    std::unique_ptr<TFile, LockedClose> file;
+    {
+      std::lock_guard<std::mutex> lock(s_rootMutex);
+      unsigned int version = 0;
+      file.reset(openDQMFile(iInput.m_name,version).release());
+    }
+    std::vector<std::unique_ptr<TypeTreeReader> > readers(kNIndicies);
+    for(unsigned int type = 0; type != kNIndicies; ++type) {
+      readers[type].reset(new TypeTreeReader(getTree(file.get(),kTypeNames[type],iInput.m_name),type,iInput));
+    }
+
+    //Find which entries are needed by each run and lumi. A lumi which only stores the
+    // elements which changed also uses the elements of the lumis written before it.
+    std::vector<std::vector<Read> > reads(kNIndicies);
+    typedef std::map<std::string, std::pair<unsigned int, ULong64_t> > Snapshot;
+    Snapshot snapshot;
+    const IndexEntry* snapshotStart = 0;
+    const std::vector<IndexEntry>& entries = iInput.m_entries;
+    for(size_t i = 0; i != entries.size(); ++i) {
+      const IndexEntry& entry = entries[i];
+      const Key key = {entry.m_historyIndex, entry.m_run, entry.m_lumi};
+      //lumis without any element are still stored
+      oPartial.m_contents[key];
+      if(isSnapshotMarker(entry.m_type)) {
+        if(entry.m_type == kCarryForwardSnapshot) {
+          if(0 == snapshotStart or snapshotStart->m_run != entry.m_run or snapshotStart->m_historyIndex != entry.m_historyIndex) {
+            throwFileError(iInput.m_name,"has a lumi which only stores the elements which changed"
+                           " but the lumi it is based on can not be found");
+          }
+        } else {
+          snapshot.clear();
+        }
+        snapshotStart = &entry;
+        size_t next = i+1;
+        for(; next != entries.size() and entries[next].m_type < kNIndicies and
+              entries[next].m_run == entry.m_run and entries[next].m_lumi == entry.m_lumi and
+              entries[next].m_historyIndex == entry.m_historyIndex;
+            ++next) {
+          const IndexEntry& part = entries[next];
+          for(ULong64_t index = part.m_firstIndex; index <= part.m_lastIndex; ++index) {
+            snapshot[readers[part.m_type]->readName(index)] = std::make_pair(part.m_type,index);
+          }
+        }
+        for(Snapshot::const_iterator it = snapshot.begin(), itEnd = snapshot.end();
+            it != itEnd;
+            ++it) {
+          const Read read = {it->second.second, key};
+          reads[it->second.first].push_back(read);
+        }
+        i = next-1;
+        continue;
+      }
+      //kNoTypesStored has no elements
+      if(entry.m_type < kNIndicies) {
+        for(ULong64_t index = entry.m_firstIndex; index <= entry.m_lastIndex; ++index) {
+          const Read read = {index, key};
+          reads[entry.m_type].push_back(read);
+        }
+      }
+    }
+
+    for(unsigned int type = 0; type != kNIndicies; ++type) {
+      //reading in entry order is what the baskets are made for, the order of the
+      // reads of one key is kept since its entries were written in that order
+      std::stable_sort(reads[type].begin(),reads[type].end());
+      TypeTreeReader& reader = *readers[type];
+      for(std::vector<Read>::const_iterator it = reads[type].begin(), itEnd = reads[type].end();
+          it != itEnd;
+          ++it) {
+        Element element;
+        const std::string& name = reader.read(it->m_entry,element);
+        Elements& elements = oPartial.m_contents[it->m_key];
+        Elements::iterator itFound = elements.find(name);
+        if(itFound == elements.end()) {
+          elements[name] = std::move(element);
+          reader.release();
+        } else {
+          mergeElement(name,itFound->second,element);
+          //still owned by the reader which reuses it for the next entry
+          element.m_hist.release();
+        }
+      }
+    }
+    readers.clear();
+  }
+
+  //Hands out the files to read and the partial results to merge, following the
+  // balanced binary tree over the file indices
+  class Reduction {
+  public:
+    explicit Reduction(const std::vector<InputFile>& iFiles):
+      m_files(iFiles), m_nextFile(0), m_nBusy(0) {
+      addSplits(0,iFiles.size());
+    }
+
+    //called by each thread
+    void work();
+    //the merge of all the files
+    std::unique_ptr<Partial> result();
+
+  private:
+    Reduction(const Reduction&); // stop default
+    const Reduction& operator=(const Reduction&); // stop default
+
+    void addSplits(unsigned int iFirst, unsigned int iEnd);
+    bool areHalves(const Partial& iLeft, const Partial& iRight) const;
+    void finished(std::unique_ptr<Partial> iPartial, std::unique_lock<std::mutex>& iLock);
+    void failed(std::unique_lock<std::mutex>& iLock);
+
+    typedef std::map<unsigned int, std::unique_ptr<Partial> > DoneMap;
+    const std::vector<InputFile>& m_files;
+    //the mid of each range of files which is the merge of two halves, by first and end file
+    std::map<std::pair<unsigned int, unsigned int>, unsigned int> m_splits;
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    //the partial results not being worked on, by their first file
+    DoneMap m_done;
+    unsigned int m_nextFile;
+    unsigned int m_nBusy;
+    std::exception_ptr m_exception;
+  };
+
+  void Reduction::addSplits(unsigned int iFirst, unsigned int iEnd) {
+    if(iEnd-iFirst < 2) {
+      return;
+    }
+    const unsigned int mid = iFirst+(iEnd-iFirst)/2;
+    m_splits[std::make_pair(iFirst,iEnd)] = mid;
+    addSplits(iFirst,mid);
+    addSplits(mid,iEnd);
+  }
+
+  bool Reduction::areHalves(const Partial& iLeft, const Partial& iRight) const {
+    std::map<std::pair<unsigned int, unsigned int>, unsigned int>::const_iterator itFound =
+      m_splits.find(std::make_pair(iLeft.m_firstFile,iRight.m_endFile));
+    return itFound != m_splits.end() and itFound->second == iLeft.m_endFile and itFound->second == iRight.m_firstFile;
+  }
+
+  void Reduction::finished(std::unique_ptr<Partial> iPartial, std::unique_lock<std::mutex>& iLock) {
+    iLock.lock();
+    --m_nBusy;
+    const unsigned int firstFile = iPartial->m_firstFile;
+    m_done.insert(std::make_pair(firstFile,std::move(iPartial)));
+    m_changed.notify_all();
+  }
+
+  void Reduction::failed(std::unique_lock<std::mutex>& iLock) {
+    iLock.lock();
+    --m_nBusy;
+    if(not m_exception) {
+      m_exception = std::current_exception();
+    }
+    m_changed.notify_all();
+  }
+
+  void Reduction::work() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(not m_exception) {
+      //merging first keeps the number of partial results, and so the memory used, small
+      DoneMap::iterator itLeft = m_done.begin();
+      DoneMap::iterator itRight = itLeft;
+      for(; itLeft != m_done.end(); ++itLeft) {
+        itRight = itLeft;
+        ++itRight;
+        if(itRight != m_done.end() and areHalves(*itLeft->second,*itRight->second)) {
+          break;
+        }
+      }
+      if(itLeft != m_done.end()) {
+        std::unique_ptr<Partial> left(std::move(itLeft->second));
+        std::unique_ptr<Partial> right(std::move(itRight->second));
+        m_done.erase(itLeft);
+        m_done.erase(itRight);
+        ++m_nBusy;
+        lock.unlock();
+        try {
+          mergeInto(*left,*right);
+          right.reset();
+        } catch(...) {
+          failed(lock);
+          return;
+        }
+        finished(std::move(left),lock);
+        continue;
+      }
+      if(m_nextFile != m_files.size()) {
+        std::unique_ptr<Partial> partial(new Partial);
+        partial->m_firstFile = m_nextFile;
+        partial->m_endFile = m_nextFile+1;
+        ++m_nextFile;
+        ++m_nBusy;
+        lock.unlock();
+        try {
+          readFile(m_files[partial->m_firstFile],*partial);
+        } catch(...) {
+          failed(lock);
+          return;
+        }
+        finished(std::move(partial),lock);
+        continue;
+      }
+      if(0 == m_nBusy) {
+        //nothing left to read or merge
+        m_changed.notify_all();
+        return;
+      }
+      m_changed.wait(lock);
+    }
+  }
+
+  std::unique_ptr<Partial> Reduction::result() {
+    if(m_exception) {
+      std::rethrow_exception(m_exception);
+    }
+    std::unique_ptr<Partial> result;
+    if(not m_done.empty()) {
+      assert(1 == m_done.size());
+      result = std::move(m_done.begin()->second);
+      m_done.clear();
+    }
+    return result;
+  }
+
+  //Writes the type trees and the Indices tree the way DQMRootOutputModule does
+  class OutputWriter {
+  public:
+    OutputWriter(const std::string& iFileName, unsigned int iFileFormatVersion);
+    void write(const Partial& iPartial, const std::map<Key, KeyTimes>& iTimes, const DQMFileMetaData& iMetaData);
+
+  private:
+    void setName(const std::string& iFullName);
+
+    std::string m_fileName;
+    unsigned int m_fileFormatVersion;
+    std::unique_ptr<TFile> m_file;
+    std::unique_ptr<IndicesTree> m_indicesTree;
+    std::vector<TTree*> m_typeTrees;
+    //the branch buffers
+    std::string m_fullName;
+    std::string* m_fullNamePtr;
+    uint32_t m_nameId;
+    uint32_t m_tag;
+    Long64_t m_int;
+    double m_float;
+    std::string m_string;
+    std::string* m_stringPtr;
+    TH1* m_object;
+    std::map<std::string, uint32_t> m_nameIds;
+    std::vector<NameRow> m_names;
+  };
+
+  OutputWriter::OutputWriter(const std::string& iFileName, unsigned int iFileFormatVersion):
+    m_fileName(iFileName),
+    m_fileFormatVersion(iFileFormatVersion),
+    m_typeTrees(kNIndicies,static_cast<TTree*>(0)),
+    m_fullNamePtr(&m_fullName),
+    m_nameId(0),
+    m_tag(0),
+    m_int(0),
+    m_float(0),
+    m_stringPtr(&m_string),
+    m_object(0) {
+    std::ostringstream version;
+    version << m_fileFormatVersion;
+    //the file format version is the title of the TFile
+    m_file.reset(new TFile(m_fileName.c_str(),"RECREATE",version.str().c_str()));
+    if(m_file->IsZombie()) {
+      throwFileError(m_fileName,"could not be created");
+    }
+    m_indicesTree.reset(new IndicesTree(m_file.get()));
+    for(unsigned int type = 0; type != kNIndicies; ++type) {
+      TTree* tree = new TTree(kTypeNames[type],kTypeNames[type]);
+      if(m_fileFormatVersion >= kNameTableFileFormatVersion) {
+        tree->Branch(kNameIdBranch,&m_nameId);
+      } else {
+        tree->Branch(kFullNameBranch,&m_fullNamePtr);
+      }
+      tree->Branch(kFlagBranch,&m_tag);
+      switch(type) {
+        case kIntIndex: tree->Branch(kValueBranch,&m_int); break;
+        case kFloatIndex: tree->Branch(kValueBranch,&m_float); break;
+        case kStringIndex: tree->Branch(kValueBranch,&m_stringPtr); break;
+        default: tree->Branch(kValueBranch,kTypeClassNames[type],&m_object,128*1024,0); break;
+      }
+      tree->SetDirectory(m_file.get()); //TFile takes ownership
+      m_typeTrees[type] = tree;
+    }
+  }
+
+  void OutputWriter::setName(const std::string& iFullName) {
+    if(m_fileFormatVersion < kNameTableFileFormatVersion) {
+      m_fullName = iFullName;
+      return;
+    }
+    std::map<std::string, uint32_t>::iterator itFound = m_nameIds.find(iFullName);
+    if(itFound == m_nameIds.end()) {
+      itFound = m_nameIds.insert(std::make_pair(iFullName,static_cast<uint32_t>(m_names.size()))).first;
+      NameRow row;
+      row.m_fullName = iFullName;
+      size_t index = iFullName.find_last_of('/');
+      if(index == std::string::npos) {
+        row.m_name = iFullName;
+      } else {
+        row.m_path = iFullName.substr(0,index);
+        row.m_name = iFullName.substr(index+1);
+      }
+      m_names.push_back(row);
+    }
+    m_nameId = itFound->second;
+  }
+
+  void OutputWriter::write(const Partial& iPartial, const std::map<Key, KeyTimes>& iTimes, const DQMFileMetaData& iMetaData) {
+    std::vector<std::vector<Elements::const_iterator> > byType(kNIndicies);
+    for(std::map<Key, Elements>::const_iterator it = iPartial.m_contents.begin(), itEnd = iPartial.m_contents.end();
+        it != itEnd;
+        ++it) {
+      const Key& key = it->first;
+      const KeyTimes& times = iTimes.find(key)->second;
+      IndexEntry entry;
+      entry.m_run = key.m_run;
+      entry.m_lumi = key.m_lumi;
+      entry.m_historyIndex = key.m_history;
+      entry.m_beginTime = times.m_beginTime;
+      entry.m_endTime = times.m_endTime;
+
+      for(unsigned int type = 0; type != kNIndicies; ++type) {
+        byType[type].clear();
+      }
+      for(Elements::const_iterator itElement = it->second.begin(), itElementEnd = it->second.end();
+          itElement != itElementEnd;
+          ++itElement) {
+        byType[itElement->second.m_type].push_back(itElement);
+      }
+      bool storedIndex = false;
+      for(unsigned int type = 0; type != kNIndicies; ++type) {
+        if(byType[type].empty()) {
+          continue;
+        }
+        TTree* tree = m_typeTrees[type];
+        entry.m_type = type;
+        entry.m_firstIndex = tree->GetEntries();
+        for(std::vector<Elements::const_iterator>::const_iterator itElement = byType[type].begin(), itElementEnd = byType[type].end();
+            itElement != itElementEnd;
+            ++itElement) {
+          const Element& element = (*itElement)->second;
+          setName((*itElement)->first);
+          m_tag = element.m_tag;
+          m_int = element.m_int;
+          m_float = element.m_float;
+          m_string = element.m_string;
+          m_object = element.m_hist.get();
+          tree->Fill();
+        }
+        entry.m_lastIndex = tree->GetEntries()-1;
+        m_indicesTree->fill(entry);
+        storedIndex = true;
+      }
+      if(not storedIndex and 0 != key.m_lumi) {
+        //later DQM modules look to see what lumis were processed
+        entry.m_type = kNoTypesStored;
+        entry.m_firstIndex = 0;
+        entry.m_lastIndex = 0;
+        m_indicesTree->fill(entry);
+      }
+    }
+    m_object = 0;
+    iMetaData.write(m_file.get(),m_names,m_fileFormatVersion >= kNameTableFileFormatVersion,*m_indicesTree);
+    m_file->Write();
+    m_file->Close();
+    m_file.reset();
+  }
+}
+
+int main(int argc, char* argv[]) {
+  namespace po = boost::program_options;
+  po::options_description desc("Allowed options");
+  desc.add_options()
+    ("help,h", "produce help message")
+    ("output,o", po::value<std::string>(), "name of the output file")
+    ("threads,j", po::value<unsigned int>()->default_value(std::max(1U,std::thread::hardware_concurrency())), "number of threads")
+    ("file-format-version", po::value<unsigned int>()->default_value(kFirstFileFormatVersion), "file format version of the output, see format.h")
+    ("input", po::value<std::vector<std::string> >(), "input files");
+  po::positional_options_description positional;
+  positional.add("input", -1);
+
+  po::variables_map vm;
+  try {
+    po::store(po::command_line_parser(argc,argv).options(desc).positional(positional).run(),vm);
+    po::notify(vm);
+  } catch(const po::error& e) {
+    std::cerr <<e.what()<<"\n"<<desc<<std::endl;
+    return 1;
+  }
+  if(vm.count("help") or 0 == vm.count("output") or 0 == vm.count("input")) {
+    std::cout <<"Usage: dqmMerge [-j <number of threads>] -o <output file> <input file> [<input file> ...]\n"
+              <<" Merges DQM Root files the way DQMRootSource does, using several threads.\n"
+              <<desc<<std::endl;
+    return vm.count("help") ? 0 : 1;
+  }
+  const unsigned int nThreads = std::max(1U,vm["threads"].as<unsigned int>());
+  const unsigned int outputVersion = vm["file-format-version"].as<unsigned int>();
+  //the histograms are always written as whole objects
+  if(outputVersion < kFirstFileFormatVersion or outputVersion > kNameTableFileFormatVersion) {
+    std::cerr <<"dqmMerge: unsupported file format version "<<outputVersion<<std::endl;
+    return 1;
+  }
+
+  TH1::AddDirectory(kFALSE);
+  TThread::Initialize();
+  try {
+    typedef std::chrono::steady_clock Clock;
+    const Clock::time_point start = Clock::now();
+
+    //the meta data is small and read first so the histories can be numbered as in the output
+    const std::vector<std::string>& inputNames = vm["input"].as<std::vector<std::string> >();
+    std::vector<InputFile> inputs(inputNames.size());
+    DQMFileMetaData metaData;
+    std::map<Key, KeyTimes> times;
+    for(unsigned int i = 0; i != inputNames.size(); ++i) {
+      InputFile& input = inputs[i];
+      input.m_name = inputNames[i];
+      std::unique_ptr<TFile> file = openDQMFile(input.m_name,input.m_fileFormatVersion);
+      TDirectory* metaDir = getMetaDataDirectory(file.get(),input.m_name);
+      std::vector<HistoryRows> histories;
+      metaData.add(metaDir,input.m_name,histories);
+      if(input.m_fileFormatVersion >= kNameTableFileFormatVersion) {
+        readNames(metaDir,input.m_name,input.m_names);
+      }
+      readIndices(file.get(),metaDir,input.m_name,input.m_entries);
+      std::vector<unsigned int> historyIndices(histories.size(),kNoTypesStored);
+      for(std::vector<IndexEntry>::iterator it = input.m_entries.begin(), itEnd = input.m_entries.end();
+          it != itEnd;
+          ++it) {
+        if(it->m_historyIndex >= histories.size()) {
+          throwFileError(input.m_name,"refers to a process history it does not store");
+        }
+        if(historyIndices[it->m_historyIndex] == kNoTypesStored) {
+          historyIndices[it->m_historyIndex] = metaData.historyIndex(histories[it->m_historyIndex]);
+        }
+        it->m_historyIndex = historyIndices[it->m_historyIndex];
+        const Key key = {it->m_historyIndex, it->m_run, it->m_lumi};
+        std::map<Key, KeyTimes>::iterator itTimes = times.find(key);
+        if(itTimes == times.end()) {
+          const KeyTimes keyTimes = {it->m_beginTime, it->m_endTime};
+          times.insert(std::make_pair(key,keyTimes));
+        } else {
+          itTimes->second.m_beginTime = std::min(itTimes->second.m_beginTime,it->m_beginTime);
+          itTimes->second.m_endTime = std::max(itTimes->second.m_endTime,it->m_endTime);
+        }
+      }
+    }
+
+    Reduction reduction(inputs);
+    std::vector<std::thread> threads;
+    for(unsigned int i = 0; i != std::min<size_t>(nThreads,inputs.size()); ++i) {
+      threads.push_back(std::thread(&Reduction::work,&reduction));
+    }
+    for(std::vector<std::thread>::iterator it = threads.begin(), itEnd = threads.end();
+        it != itEnd;
+        ++it) {
+      it->join();
+    }
+    std::unique_ptr<Partial> merged = reduction.result();
+    const Clock::time_point merging = Clock::now();
+
+    OutputWriter writer(vm["output"].as<std::string>(),outputVersion);
+    writer.write(*merged,times,metaData);
+    const Clock::time_point end = Clock::now();
+    std::cout <<"dqmMerge: merged "<<inputs.size()<<" files into "<<merged->m_contents.size()<<" runs and lumis"
+              <<" with "<<threads.size()<<" threads\n"
+              <<" read and merge: "<<std::chrono::duration<double>(merging-start).count()<<" s\n"
+              <<" write: "<<std::chrono::duration<double>(end-merging).count()<<" s"<<std::endl;
+  } catch(const std::exception& e) {
+    std::cerr <<"dqmMerge failed: "<<e.what()<<std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,103 @@
+// -*- C++ -*-
+//
+// Package:     FwkIO
+// Program:     dqmSummary
+//
+/*
+ Description: Prints the statistics stored in the Summaries tree of DQM Root files
+
+ Usage:
+    dqmSummary [--name <full name> ...] <input file> [<input file> ...]
+
+    Prints one line for each row of the Summaries tree, or only for the rows of the
+    MonitorElements with the given full names, in the order the rows were written. The
+    payloads of the MonitorElements are never read so this is fast even for large files.
+*/
+//
+
+// system include files
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include <boost/program_options.hpp>
+
+// user include files
+#include "TFile.h"
+#include "TH1.h"
+
+#include "DQMServices/FwkIO/plugins/format.h"
+#include "DQMServices/FwkIO/bin/DQMFileMetaData.h"
+#include "DQMServices/FwkIO/bin/DQMFileSummaries.h"
+
+namespace {
+  void print(const SummaryRow& iRow) {
+    std::cout <<iRow.m_run<<" "<<iRow.m_lumi<<" "<<iRow.m_historyIndex<<" "
+              <<(iRow.m_type < kNIndicies ? kTypeNames[iRow.m_type] : "?")<<" "<<iRow.m_fullName
+              <<" entries "<<iRow.m_entries<<" sumw "<<iRow.m_sumOfWeights
+              <<" mean "<<iRow.m_mean[0]<<" "<<iRow.m_mean[1]<<" "<<iRow.m_mean[2]
+              <<" rms "<<iRow.m_rms[0]<<" "<<iRow.m_rms[1]<<" "<<iRow.m_rms[2]
+              <<" min "<<iRow.m_minContent<<" max "<<iRow.m_maxContent<<"\n";
+  }
+}
+
+int main(int argc, char* argv[]) {
+  namespace po = boost::program_options;
+  po::options_description desc("Allowed options");
+  desc.add_options()
+    ("help,h", "produce help message")
+    ("name,n", po::value<std::vector<std::string> >(), "only print the rows of the MonitorElement with this full name, can be given several times")
+    ("input", po::value<std::vector<std::string> >(), "input files");
+  po::positional_options_description positional;
+  positional.add("input", -1);
+
+  po::variables_map vm;
+  try {
+    po::store(po::command_line_parser(argc,argv).options(desc).positional(positional).run(),vm);
+    po::notify(vm);
+  } catch(const po::error& e) {
+    std::cerr <<e.what()<<"\n"<<desc<<std::endl;
+    return 1;
+  }
+  if(vm.count("help") or 0 == vm.count("input")) {
+    std::cout <<"Usage: dqmSummary [--name <full name> ...] <input file> [<input file> ...]\n"
+              <<" Prints the per entry statistics of DQM Root files written with writeSummaries set.\n"
+              <<" Columns: run lumi processHistoryIndex type fullName, then the statistics.\n"
+              <<desc<<std::endl;
+    return vm.count("help") ? 0 : 1;
+  }
+  std::vector<std::string> names;
+  if(vm.count("name")) {
+    names = vm["name"].as<std::vector<std::string> >();
+  }
+
+  TH1::AddDirectory(kFALSE);
+  try {
+    const std::vector<std::string>& inputs = vm["input"].as<std::vector<std::string> >();
+    for(std::vector<std::string>::const_iterator it = inputs.begin(), itEnd = inputs.end();
+        it != itEnd;
+        ++it) {
+      unsigned int version = 0;
+      std::unique_ptr<TFile> file = openDQMFileOfAnyVersion(*it,version);
+      DQMFileSummaries summaries(file.get(),*it);
+      if(names.empty()) {
+        for(ULong64_t index = 0; index != summaries.size(); ++index) {
+          print(summaries.row(index));
+        }
+      } else {
+        std::vector<SummaryRow> rows;
+        summaries.select(names,rows);
+        for(std::vector<SummaryRow>::const_iterator itRow = rows.begin(), itRowEnd = rows.end();
+            itRow != itRowEnd;
+            ++itRow) {
+          print(*itRow);
+        }
+      }
+    }
+  } catch(const std::exception& e) {
+    std::cerr <<"dqmSummary failed: "<<e.what()<<std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,86 @@
+#ifndef DQMServices_FwkIO_CacheEntryRanges_h
+#define DQMServices_FwkIO_CacheEntryRanges_h
+// -*- C++ -*-
+//
+// Package:     FwkIO
+// Class  :     CacheEntryRanges
+//
+/**\class CacheEntryRanges CacheEntryRanges.h DQMServices/FwkIO/plugins/CacheEntryRanges.h
+
+ Description: The entries of a type tree which will be read, as contiguous ranges for its TTreeCache
+
+ Usage:
+    The entries of a run or lumi are interleaved with those of other runs, lumis and files
+    so one range from the first to the last needed entry would have the cache read a lot
+    which is never used. Instead the needed entries are added, adjacent ones are merged
+    by prepare() and select() points the cache at the one range holding the entry about
+    to be read. An entry which is in no range is read without changing the cache.
+*/
+
+// system include files
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include "TTree.h"
+
+// user include files
+
+// forward declarations
+
+class CacheEntryRanges {
+public:
+  CacheEntryRanges(): m_selected(kNoneSelected) {}
+
+  void clear() {
+    m_ranges.clear();
+    m_selected = kNoneSelected;
+  }
+  //iEnd is one past the last entry
+  void add(ULong64_t iFirst, ULong64_t iEnd) {
+    if(iFirst < iEnd) {
+      m_ranges.push_back(std::make_pair(iFirst,iEnd));
+    }
+  }
+  //call once all ranges were added
+  void prepare() {
+    std::sort(m_ranges.begin(),m_ranges.end());
+    std::vector<Range> merged;
+    for(std::vector<Range>::const_iterator it = m_ranges.begin(), itEnd = m_ranges.end(); it != itEnd; ++it) {
+      if(not merged.empty() and it->first <= merged.back().second) {
+        merged.back().second = std::max(merged.back().second,it->second);
+      } else {
+        merged.push_back(*it);
+      }
+    }
+    m_ranges.swap(merged);
+    m_selected = kNoneSelected;
+  }
+  bool empty() const { return m_ranges.empty();}
+
+  void select(TTree* iTree, ULong64_t iEntry) {
+    if(m_selected != kNoneSelected and contains(m_ranges[m_selected],iEntry)) {
+      return;
+    }
+    std::vector<Range>::const_iterator itFound = std::upper_bound(m_ranges.begin(),m_ranges.end(),
+                                                                  std::make_pair(iEntry,ULong64_t(-1)));
+    if(itFound == m_ranges.begin() or not contains(*(itFound-1),iEntry)) {
+      return;
+    }
+    --itFound;
+    m_selected = itFound - m_ranges.begin();
+    iTree->SetCacheEntryRange(itFound->first,itFound->second);
+  }
+
+private:
+  typedef std::pair<ULong64_t,ULong64_t> Range;
+  static const size_t kNoneSelected = static_cast<size_t>(-1);
+
+  static bool contains(const Range& iRange, ULong64_t iEntry) {
+    return iRange.first <= iEntry and iEntry < iRange.second;
+  }
+
+  std::vector<Range> m_ranges;
+  size_t m_selected;
+};
+
+#endif
@@ -14,17 +14,33 @@
 // system include files
 #include <algorithm>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <cstring>
 #include <map>
+#include <set>
+#include <unordered_map>
 #include <memory>
 #include <vector>
+#include <deque>
+#include <exception>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
 #include <boost/shared_ptr.hpp>
 #include "TFile.h"
 #include "TTree.h"
+#include "TBranch.h"
+#include "Compression.h"
 #include "TString.h"
 #include "TH1.h"
 #include "TH2.h"
 #include "TProfile.h"
+#include "TList.h"
+#include "TThread.h"
 
 // user include files
 #include "FWCore/Framework/interface/OutputModule.h"
@@ -37,6 +53,7 @@
 #include "FWCore/MessageLogger/interface/JobReport.h"
 #include "FWCore/Utilities/interface/Digest.h"
 #include "FWCore/Utilities/interface/GlobalIdentifier.h"
+#include "FWCore/Utilities/interface/EDMException.h"
 
 #include "DataFormats/Provenance/interface/ProcessHistory.h"
 #include "DataFormats/Provenance/interface/ProcessHistoryID.h"
@@ -44,17 +61,369 @@
 #include "FWCore/ParameterSet/interface/Registry.h"
 
 #include "format.h"
+#include "IndexOrderBuilder.h"
+#include "HistogramColumns.h"
 
 namespace {
+  //Owned copy of the payload of a MonitorElement. Used when the actual
+  // TTree::Fill is done on a different thread than the one owning the DQMStore
+  struct ElementSnapshot {
+    ElementSnapshot(): m_tag(0), m_shapeId(0), m_intValue(0), m_floatValue(0) {}
+    std::string m_fullName;
+    uint32_t m_tag;
+    boost::shared_ptr<TObject> m_object;
+    //only for histograms stored as columns, the shape is made on the framework thread
+    uint32_t m_shapeId;
+    Long64_t m_intValue;
+    double m_floatValue;
+    std::string m_stringValue;
+  };
+
+  //Handles how the name of a MonitorElement is stored in the entries of the
+  // type trees. Either the full name is written each time or, when using a
+  // name table, just the index of the name in the table.
+  class NameStorage {
+  public:
+    explicit NameStorage(bool iUseNameTable): 
+    m_useNameTable(iUseNameTable), m_fullNamePtr(&m_fullName), m_id(0) {}
+    bool useNameTable() const { return m_useNameTable;}
+
+    void setupBranch(TTree* iTree) {
+      if(m_useNameTable) {
+        iTree->Branch(kNameIdBranch,&m_id);
+      } else {
+        iTree->Branch(kFullNameBranch,&m_fullNamePtr);
+      }
+    }
+    void set(const std::string& iFullName) {
+      if(m_useNameTable) {
+        std::unordered_map<std::string, uint32_t>::iterator itFound = m_ids.find(iFullName);
+        if(itFound == m_ids.end()) {
+          itFound = m_ids.insert(std::make_pair(iFullName,static_cast<uint32_t>(m_names.size()))).first;
+          m_names.push_back(iFullName);
+        }
+        m_id = itFound->second;
+      } else {
+        m_fullName = iFullName;
+      }
+    }
+    //the index in the vector is the id
+    const std::vector<std::string>& names() const { return m_names;}
+    void clear() {
+      m_ids.clear();
+      m_names.clear();
+    }
+  private:
+    bool m_useNameTable;
+    std::string m_fullName;
+    std::string* m_fullNamePtr;
+    uint32_t m_id;
+    std::unordered_map<std::string, uint32_t> m_ids;
+    std::vector<std::string> m_names;
+  };
+
+  //Fills the optional Summaries tree. The name branch shares the buffer of the
+  // NameStorage so the name must already be set when an entry is added.
+  class SummaryStorage {
+  public:
+    SummaryStorage(TTree* iTree, NameStorage* iNames):
+    m_tree(iTree), m_run(0), m_lumi(0), m_historyIndex(0), m_type(0), m_entry(0),
+    m_entries(0), m_sumOfWeights(0), m_minContent(0), m_maxContent(0) {
+      std::fill(m_mean,m_mean+3,0.);
+      std::fill(m_rms,m_rms+3,0.);
+      m_tree->Branch(kRunBranch,&m_run);
+      m_tree->Branch(kLumiBranch,&m_lumi);
+      m_tree->Branch(kProcessHistoryIndexBranch,&m_historyIndex);
+      m_tree->Branch(kTypeBranch,&m_type);
+      iNames->setupBranch(m_tree);
+      m_tree->Branch(kSummaryEntryBranch,&m_entry);
+      m_tree->Branch(kSummaryEntriesBranch,&m_entries);
+      m_tree->Branch(kSummarySumOfWeightsBranch,&m_sumOfWeights);
+      m_tree->Branch(kSummaryMeanBranch,m_mean,(std::string(kSummaryMeanBranch)+"[3]/D").c_str());
+      m_tree->Branch(kSummaryRMSBranch,m_rms,(std::string(kSummaryRMSBranch)+"[3]/D").c_str());
+      m_tree->Branch(kSummaryMinContentBranch,&m_minContent);
+      m_tree->Branch(kSummaryMaxContentBranch,&m_maxContent);
+    }
+    TTree* tree() const { return m_tree;}
+
+    void setKey(unsigned int iRun, unsigned int iLumi, unsigned int iHistoryIndex) {
+      m_run = iRun;
+      m_lumi = iLumi;
+      m_historyIndex = iHistoryIndex;
+    }
+    void fill(unsigned int iType, ULong64_t iEntry, double iValue) {
+      m_type = iType;
+      m_entry = iEntry;
+      m_entries = 1;
+      m_sumOfWeights = 1;
+      std::fill(m_mean,m_mean+3,0.);
+      std::fill(m_rms,m_rms+3,0.);
+      m_mean[0] = iValue;
+      m_minContent = iValue;
+      m_maxContent = iValue;
+      m_tree->Fill();
+    }
+    void fill(unsigned int iType, ULong64_t iEntry, const TH1& iHist) {
+      m_type = iType;
+      m_entry = iEntry;
+      m_entries = iHist.GetEntries();
+      m_sumOfWeights = iHist.GetSumOfWeights();
+      const int dimension = iHist.GetDimension();
+      for(int axis = 0; axis != 3; ++axis) {
+        m_mean[axis] = axis < dimension ? iHist.GetMean(axis+1) : 0.;
+        m_rms[axis] = axis < dimension ? iHist.GetRMS(axis+1) : 0.;
+      }
+      //the same bins GetSumOfWeights uses, under- and overflows are left out
+      const int nX = iHist.GetNbinsX(), nY = iHist.GetNbinsY(), nZ = iHist.GetNbinsZ();
+      bool first = true;
+      m_minContent = 0;
+      m_maxContent = 0;
+      for(int z = 1; z <= nZ; ++z) {
+        for(int y = 1; y <= nY; ++y) {
+          for(int x = 1; x <= nX; ++x) {
+            const double content = iHist.GetBinContent(iHist.GetBin(x,y,z));
+            if(first or content < m_minContent) { m_minContent = content;}
+            if(first or content > m_maxContent) { m_maxContent = content;}
+            first = false;
+          }
+        }
+      }
+      m_tree->Fill();
+    }
+  private:
+    TTree* m_tree;
+    unsigned int m_run;
+    unsigned int m_lumi;
+    unsigned int m_historyIndex;
+    unsigned int m_type;
+    ULong64_t m_entry;
+    double m_entries;
+    double m_sumOfWeights;
+    double m_mean[3];
+    double m_rms[3];
+    double m_minContent;
+    double m_maxContent;
+  };
+
+  //TH1::Clone adds the copy to gDirectory, which is shared by all threads, unless this is off
+  class NoAddDirectory {
+  public:
+    NoAddDirectory(): m_status(TH1::AddDirectoryStatus()) { TH1::AddDirectory(kFALSE);}
+    ~NoAddDirectory() { TH1::AddDirectory(m_status);}
+  private:
+    bool m_status;
+  };
+
+  //FNV-1a hash, only used to decide if the content of a MonitorElement
+  // changed since it was last written
+  class ContentHash {
+  public:
+    ContentHash(): m_value(14695981039346656037ULL) {}
+    void add(const void* iData, size_t iSize) {
+      const unsigned char* data = static_cast<const unsigned char*>(iData);
+      for(size_t i = 0; i != iSize; ++i) {
+        m_value ^= data[i];
+        m_value *= 1099511628211ULL;
+      }
+    }
+    template<class T>
+    void add(const T& iValue) { add(&iValue,sizeof(T));}
+    uint64_t value() const { return m_value;}
+  private:
+    uint64_t m_value;
+  };
+
+  //A second hash built differently from ContentHash (the rounds of xxHash64 over 8 byte
+  // words). Payloads are only taken to be the same if both hashes agree.
+  class CheckHash {
+  public:
+    CheckHash(): m_value(2870177450012600261ULL), m_size(0) {}
+    void add(const void* iData, size_t iSize) {
+      const unsigned char* data = static_cast<const unsigned char*>(iData);
+      m_size += iSize;
+      for(; iSize >= sizeof(uint64_t); data += sizeof(uint64_t), iSize -= sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word,data,sizeof(uint64_t));
+        round(word);
+      }
+      for(; iSize != 0; ++data, --iSize) {
+        round(*data);
+      }
+    }
+    template<class T>
+    void add(const T& iValue) { add(&iValue,sizeof(T));}
+    uint64_t value() const { return m_value ^ m_size;}
+  private:
+    void round(uint64_t iWord) {
+      m_value += iWord*14029467366897019727ULL;
+      m_value = (m_value << 31) | (m_value >> 33);
+      m_value *= 11400714785074694791ULL;
+    }
+    uint64_t m_value;
+    uint64_t m_size;
+  };
+
+  void hashAxis(const TAxis& iAxis, ContentHash& ioHash) {
+    ioHash.add(iAxis.GetNbins());
+    ioHash.add(iAxis.GetXmin());
+    ioHash.add(iAxis.GetXmax());
+  }
+
+  //the parts of the content which are common to all histogram types
+  void hashHistogram(const TH1& iHist, ContentHash& ioHash) {
+    ioHash.add(iHist.GetDimension());
+    hashAxis(*iHist.GetXaxis(),ioHash);
+    hashAxis(*iHist.GetYaxis(),ioHash);
+    hashAxis(*iHist.GetZaxis(),ioHash);
+    ioHash.add(iHist.GetEntries());
+    double stats[TH1::kNstat] = {0};
+    iHist.GetStats(stats);
+    ioHash.add(stats,sizeof(stats));
+    const TArrayD* sumw2 = iHist.GetSumw2();
+    if(0 != sumw2 and 0 != sumw2->GetSize()) {
+      ioHash.add(sumw2->GetArray(),sumw2->GetSize()*sizeof(double));
+    }
+  }
+
+  void hashBinEntries(const TH1&, unsigned int, ContentHash&) {}
+  void hashBinEntries(const TProfile& iHist, unsigned int iNCells, ContentHash& ioHash) {
+    for(unsigned int i = 0; i != iNCells; ++i) {
+      ioHash.add(iHist.GetBinEntries(i));
+    }
+  }
+  void hashBinEntries(const TProfile2D& iHist, unsigned int iNCells, ContentHash& ioHash) {
+    for(unsigned int i = 0; i != iNCells; ++i) {
+      ioHash.add(iHist.GetBinEntries(i));
+    }
+  }
+
+  void hashString(const char* iString, ContentHash& ioHash) {
+    ioHash.add(iString,std::strlen(iString)+1);
+  }
+
+  void hashAxisShape(const TAxis& iAxis, ContentHash& ioHash) {
+    hashAxis(iAxis,ioHash);
+    const TArrayD& edges = *iAxis.GetXbins();
+    if(0 != edges.fN) {
+      ioHash.add(edges.fArray,edges.fN*sizeof(double));
+    }
+    hashString(iAxis.GetTitle(),ioHash);
+    if(TList* labels = iAxis.GetLabels()) {
+      TIter next(labels);
+      while(TObject* label = next()) {
+        hashString(label->GetName(),ioHash);
+      }
+    }
+    ioHash.add(iAxis.TestBit(TAxis::kAxisRange));
+    ioHash.add(iAxis.GetFirst());
+    ioHash.add(iAxis.GetLast());
+  }
+
+  //What a stored shape holds which is likely to change while a job runs. Drawing
+  // attributes are not included so changing only them does not store a new shape.
+  void hashShape(const TH1& iHist, ContentHash& ioHash) {
+    hashString(iHist.GetName(),ioHash);
+    hashString(iHist.GetTitle(),ioHash);
+    hashString(iHist.GetOption(),ioHash);
+    ioHash.add(iHist.GetDimension());
+    hashAxisShape(*iHist.GetXaxis(),ioHash);
+    hashAxisShape(*iHist.GetYaxis(),ioHash);
+    hashAxisShape(*iHist.GetZaxis(),ioHash);
+    ioHash.add(iHist.TestBit(TH1::kCanRebin));
+    ioHash.add(iHist.TestBit(TH1::kIsAverage));
+    ioHash.add(iHist.TestBit(TH1::kNoStats));
+    ioHash.add(iHist.GetBufferSize());
+    ioHash.add(iHist.GetMinimumStored());
+    ioHash.add(iHist.GetMaximumStored());
+    ioHash.add(iHist.GetNormFactor());
+    ioHash.add(iHist.GetListOfFunctions()->GetSize());
+  }
+  void hashProfileShape(const TH1&, ContentHash&) {}
+  void hashProfileShape(const TProfile& iHist, ContentHash& ioHash) {
+    hashString(iHist.GetErrorOption(),ioHash);
+    ioHash.add(iHist.GetYmin());
+    ioHash.add(iHist.GetYmax());
+  }
+  void hashProfileShape(const TProfile2D& iHist, ContentHash& ioHash) {
+    hashString(iHist.GetErrorOption(),ioHash);
+    ioHash.add(iHist.GetZmin());
+    ioHash.add(iHist.GetZmax());
+  }
+
+  //everything but the shape id
+  template<class V, class H>
+  void hashValues(const std::vector<V>& iValues, H& ioHash) {
+    ioHash.add(iValues.size());
+    if(not iValues.empty()) {
+      ioHash.add(&iValues[0],iValues.size()*sizeof(V));
+    }
+  }
+  template<class H>
+  void hashContent(const HistogramContent& iContent, H& ioHash) {
+    ioHash.add(iContent.m_entries);
+    hashValues(iContent.m_stats,ioHash);
+    hashValues(iContent.m_floatContents,ioHash);
+    hashValues(iContent.m_shortContents,ioHash);
+    hashValues(iContent.m_doubleContents,ioHash);
+    hashValues(iContent.m_sumw2,ioHash);
+    hashValues(iContent.m_binEntries,ioHash);
+    hashValues(iContent.m_binSumw2,ioHash);
+    hashValues(iContent.m_bins,ioHash);
+  }
+
+  //The shapes of the histograms of one type tree when they are stored as columns.
+  // A new shape is only stored the first time a histogram is written to the file
+  // or when its shape changed since it was last written. Only used on the framework
+  // thread since making a shape clones the histogram.
+  class ShapeStorage {
+  public:
+    template<class T>
+    uint32_t id(const std::string& iFullName, const T& iHist) {
+      ContentHash hash;
+      hashShape(iHist,hash);
+      hashProfileShape(iHist,hash);
+      std::unordered_map<std::string, std::pair<uint64_t,uint32_t> >::iterator itFound = m_ids.find(iFullName);
+      if(itFound != m_ids.end() and itFound->second.first == hash.value()) {
+        return itFound->second.second;
+      }
+      const uint32_t id = m_shapes.size();
+      NoAddDirectory noAddDirectory;
+      m_shapes.push_back(HistogramColumns::makeShape(iHist));
+      m_ids[iFullName] = std::make_pair(hash.value(),id);
+      return id;
+    }
+    //the index in the vector is the id
+    const std::vector<std::unique_ptr<TH1> >& shapes() const { return m_shapes;}
+  private:
+    std::unordered_map<std::string, std::pair<uint64_t,uint32_t> > m_ids;
+    std::vector<std::unique_ptr<TH1> > m_shapes;
+  };
+
   class TreeHelperBase {
   public:
-    TreeHelperBase(): m_wasFilled(false), m_firstIndex(0),m_lastIndex(0) {}
+    TreeHelperBase(): m_wasFilled(false), m_firstIndex(0),m_lastIndex(0), m_summaries(0) {}
     virtual ~TreeHelperBase(){}
     void fill(MonitorElement* iElement) {
       doFill(iElement); 
       if(m_wasFilled) {++m_lastIndex;} 
       m_wasFilled = true; }
+    void fill(const ElementSnapshot& iSnapshot) {
+      doFill(iSnapshot);
+      if(m_wasFilled) {++m_lastIndex;}
+      m_wasFilled = true; }
+    void snapshot(MonitorElement* iElement, ElementSnapshot& oSnapshot) {
+      oSnapshot.m_fullName = iElement->getFullname();
+      oSnapshot.m_tag = iElement->getTag();
+      doSnapshot(iElement,oSnapshot);
+    }
+    uint64_t contentHash(MonitorElement* iElement) const {
+      ContentHash hash;
+      doHash(iElement,hash);
+      return hash.value();
+    }
     bool wasFilled() const { return m_wasFilled;}
+    //0 unless the histograms are stored as columns
+    virtual const ShapeStorage* shapes() const { return 0;}
     void getRangeAndReset(ULong64_t& iFirstIndex, ULong64_t& iLastIndex) {
       iFirstIndex = m_firstIndex;
       iLastIndex = m_lastIndex;
@@ -62,116 +431,328 @@ namespace {
       m_firstIndex = m_lastIndex +1;
       m_lastIndex = m_firstIndex;
     }
+    //0 means no summaries are written
+    void setSummaries(SummaryStorage* iSummaries) { m_summaries = iSummaries;}
+  protected:
+    SummaryStorage* summaries() const { return m_summaries;}
   private:
     virtual void doFill(MonitorElement*) = 0;
+    virtual void doFill(const ElementSnapshot&) = 0;
+    virtual void doSnapshot(MonitorElement*, ElementSnapshot&) = 0;
+    virtual void doHash(MonitorElement*, ContentHash&) const = 0;
     bool m_wasFilled;
     ULong64_t m_firstIndex;
     ULong64_t m_lastIndex;
+    SummaryStorage* m_summaries;
   };
   
   template<class T>
   class TreeHelper : public TreeHelperBase {
   public:
-    TreeHelper(TTree* iTree, std::string* iFullNameBufferPtr ):
-     m_tree(iTree), m_flagBuffer(0),m_fullNameBufferPtr(iFullNameBufferPtr){ setup();}
+    TreeHelper(TTree* iTree, NameStorage* iNames, unsigned int iTypeIndex, unsigned int iFileFormatVersion,
+               double iSparseDensityThreshold):
+     m_tree(iTree), m_flagBuffer(0),m_names(iNames), m_typeIndex(iTypeIndex),
+     m_storesBins(iFileFormatVersion >= kSparseFileFormatVersion),
+     m_sparseDensityThreshold(m_storesBins ? iSparseDensityThreshold : 0.),
+     m_deduplicate(iFileFormatVersion >= kDeduplicatedFileFormatVersion), m_sameAs(0){
+       if(iFileFormatVersion >= kColumnarFileFormatVersion) {
+         m_columns.reset(new HistogramColumns(iTypeIndex));
+       }
+       setup();
+     }
      virtual void doFill(MonitorElement* iElement) {
-       *m_fullNameBufferPtr = iElement->getFullname();
+       m_names->set(iElement->getFullname());
        m_flagBuffer = iElement->getTag();
-       m_bufferPtr = dynamic_cast<T*>(iElement->getRootObject());
-       assert(0!=m_bufferPtr);
-       //std::cout <<"#entries: "<<m_bufferPtr->GetEntries()<<std::endl;
-       m_tree->Fill();
+       T* hist = dynamic_cast<T*>(iElement->getRootObject());
+       assert(0!=hist);
+       fillValue(iElement->getFullname(),hist,0);
+     }
+     virtual void doFill(const ElementSnapshot& iSnapshot) {
+       m_names->set(iSnapshot.m_fullName);
+       m_flagBuffer = iSnapshot.m_tag;
+       T* hist = static_cast<T*>(iSnapshot.m_object.get());
+       assert(0!=hist);
+       fillValue(iSnapshot.m_fullName,hist,&iSnapshot.m_shapeId);
+     }
+     virtual void doSnapshot(MonitorElement* iElement, ElementSnapshot& oSnapshot) {
+       T* original = dynamic_cast<T*>(iElement->getRootObject());
+       assert(0!=original);
+       T* copy = 0;
+       {
+         NoAddDirectory noAddDirectory;
+         copy = static_cast<T*>(original->Clone());
+       }
+       //the copy must not be owned by whatever happens to be gDirectory
+       copy->SetDirectory(0);
+       oSnapshot.m_object.reset(copy);
+       if(m_columns.get()) {
+         //the shape must not hold the fill buffer
+         if(0 != copy->GetBuffer()) {
+           copy->BufferEmpty();
+         }
+         oSnapshot.m_shapeId = m_shapes.id(oSnapshot.m_fullName,*copy);
+       }
+     }
+     virtual void doHash(MonitorElement* iElement, ContentHash& ioHash) const {
+       const T* hist = dynamic_cast<const T*>(iElement->getRootObject());
+       assert(0!=hist);
+       hashHistogram(*hist,ioHash);
+       const TArray& contents = *hist;
+       ioHash.add(hist->GetArray(),contents.GetSize()*sizeof(*(hist->GetArray())));
+       hashBinEntries(*hist,contents.GetSize(),ioHash);
+     }
+     virtual const ShapeStorage* shapes() const {
+       return m_columns.get() ? &m_shapes : 0;
      }
      
      
   private:
     void setup() {
-      m_tree->Branch(kFullNameBranch,&m_fullNameBufferPtr);
+      m_names->setupBranch(m_tree);
       m_tree->Branch(kFlagBranch,&m_flagBuffer);
       
       m_bufferPtr = 0;
-      m_tree->Branch(kValueBranch,&m_bufferPtr,128*1024,0);
+      if(m_columns.get()) {
+        m_columns->branch(m_tree,m_storesBins);
+        if(m_deduplicate) {
+          m_tree->Branch(kSameAsBranch,&m_sameAs);
+        }
+      } else {
+        m_tree->Branch(kValueBranch,&m_bufferPtr,128*1024,0);
+      }
+    }
+    //iShapeId is 0 unless the shape was already stored when the snapshot was taken
+    void fillValue(const std::string& iFullName, T* iHist, const uint32_t* iShapeId) {
+      if(m_columns.get()) {
+        //must be done first since it empties the fill buffer the shape must not hold
+        HistogramColumns::store(*iHist,m_columns->content(),m_sparseDensityThreshold);
+        m_columns->content().m_shapeId = iShapeId ? *iShapeId : m_shapes.id(iFullName,*iHist);
+        if(m_deduplicate) {
+          deduplicate(m_columns->content());
+        }
+      } else {
+        m_bufferPtr = iHist;
+      }
+      if(summaries()) {
+        summaries()->fill(m_typeIndex,m_tree->GetEntries(),*iHist);
+      }
+      //std::cout <<"#entries: "<<iHist->GetEntries()<<std::endl;
+      m_tree->Fill();
     }
     TTree* m_tree;
     uint32_t m_flagBuffer;
-    std::string* m_fullNameBufferPtr;
+    NameStorage* m_names;
+    unsigned int m_typeIndex;
+    //the payload of an entry which has the same hashes as an earlier one is not stored again
+    void deduplicate(HistogramContent& ioContent) {
+      ContentHash hash;
+      hashContent(ioContent,hash);
+      CheckHash check;
+      hashContent(ioContent,check);
+      std::pair<std::unordered_map<uint64_t, std::pair<uint64_t,ULong64_t> >::iterator,bool> inserted =
+        m_entries.insert(std::make_pair(hash.value(),std::make_pair(check.value(),static_cast<ULong64_t>(m_tree->GetEntries()))));
+      m_sameAs = 0;
+      //if only the first hash is the same the payloads differ and this one is stored
+      if(not inserted.second and inserted.first->second.first == check.value()) {
+        m_sameAs = inserted.first->second.second+1;
+        ioContent.clearPayload();
+      }
+    }
     T* m_bufferPtr;
+    bool m_storesBins;
+    double m_sparseDensityThreshold;
+    bool m_deduplicate;
+    ULong64_t m_sameAs;
+    //the CheckHash and the entry storing the payload with the hash
+    std::unordered_map<uint64_t, std::pair<uint64_t,ULong64_t> > m_entries;
+    std::unique_ptr<HistogramColumns> m_columns;
+    ShapeStorage m_shapes;
   };
   
   class IntTreeHelper: public TreeHelperBase {
   public:
-    IntTreeHelper(TTree* iTree, std::string* iFullNameBufferPtr):
-     m_tree(iTree), m_flagBuffer(0),m_fullNameBufferPtr(iFullNameBufferPtr)
+    IntTreeHelper(TTree* iTree, NameStorage* iNames):
+     m_tree(iTree), m_flagBuffer(0),m_names(iNames)
      {setup();}
 
     virtual void doFill(MonitorElement* iElement) {
-     *m_fullNameBufferPtr = iElement->getFullname();
+     m_names->set(iElement->getFullname());
      m_flagBuffer = iElement->getTag();
      m_buffer = iElement->getIntValue();
-     m_tree->Fill();
+     fillValue();
+    }
+    virtual void doFill(const ElementSnapshot& iSnapshot) {
+     m_names->set(iSnapshot.m_fullName);
+     m_flagBuffer = iSnapshot.m_tag;
+     m_buffer = iSnapshot.m_intValue;
+     fillValue();
+    }
+    virtual void doSnapshot(MonitorElement* iElement, ElementSnapshot& oSnapshot) {
+     oSnapshot.m_intValue = iElement->getIntValue();
+    }
+    virtual void doHash(MonitorElement* iElement, ContentHash& ioHash) const {
+     ioHash.add(iElement->getIntValue());
     }
 
   private:
     void setup() {
-      m_tree->Branch(kFullNameBranch,&m_fullNameBufferPtr);
+      m_names->setupBranch(m_tree);
       m_tree->Branch(kFlagBranch,&m_flagBuffer);
       m_tree->Branch(kValueBranch,&m_buffer);
     }
+    void fillValue() {
+      if(summaries()) {
+        summaries()->fill(kIntIndex,m_tree->GetEntries(),static_cast<double>(m_buffer));
+      }
+      m_tree->Fill();
+    }
     TTree* m_tree;
     uint32_t m_flagBuffer;
-    std::string* m_fullNameBufferPtr;
+    NameStorage* m_names;
     Long64_t m_buffer;
   };
 
   class FloatTreeHelper: public TreeHelperBase {
   public:
-    FloatTreeHelper(TTree* iTree, std::string* iFullNameBufferPtr):
-     m_tree(iTree), m_flagBuffer(0),m_fullNameBufferPtr(iFullNameBufferPtr)
+    FloatTreeHelper(TTree* iTree, NameStorage* iNames):
+     m_tree(iTree), m_flagBuffer(0),m_names(iNames)
      {setup();}
    virtual void doFill(MonitorElement* iElement) {
-     *m_fullNameBufferPtr = iElement->getFullname();
+     m_names->set(iElement->getFullname());
      m_flagBuffer = iElement->getTag();
      m_buffer = iElement->getFloatValue();
-     m_tree->Fill();
+     fillValue();
+   }
+   virtual void doFill(const ElementSnapshot& iSnapshot) {
+     m_names->set(iSnapshot.m_fullName);
+     m_flagBuffer = iSnapshot.m_tag;
+     m_buffer = iSnapshot.m_floatValue;
+     fillValue();
+   }
+   virtual void doSnapshot(MonitorElement* iElement, ElementSnapshot& oSnapshot) {
+     oSnapshot.m_floatValue = iElement->getFloatValue();
+   }
+   virtual void doHash(MonitorElement* iElement, ContentHash& ioHash) const {
+     ioHash.add(iElement->getFloatValue());
    }
   private:
     void setup() {
-      m_tree->Branch(kFullNameBranch,&m_fullNameBufferPtr);
+      m_names->setupBranch(m_tree);
       m_tree->Branch(kFlagBranch,&m_flagBuffer);
       m_tree->Branch(kValueBranch,&m_buffer);
     }
+    void fillValue() {
+      if(summaries()) {
+        summaries()->fill(kFloatIndex,m_tree->GetEntries(),m_buffer);
+      }
+      m_tree->Fill();
+    }
     
     TTree* m_tree;
     uint32_t m_flagBuffer;
-    std::string* m_fullNameBufferPtr;
+    NameStorage* m_names;
     double m_buffer;
   };
 
   class StringTreeHelper: public TreeHelperBase {
   public:
-    StringTreeHelper(TTree* iTree, std::string* iFullNameBufferPtr):
-     m_tree(iTree), m_flagBuffer(0),m_fullNameBufferPtr(iFullNameBufferPtr), m_bufferPtr(&m_buffer)
+    StringTreeHelper(TTree* iTree, NameStorage* iNames, bool iDeduplicate):
+     m_tree(iTree), m_flagBuffer(0),m_names(iNames), m_bufferPtr(&m_buffer),
+     m_deduplicate(iDeduplicate), m_sameAs(0)
      {setup();}
    virtual void doFill(MonitorElement* iElement) {
-     *m_fullNameBufferPtr = iElement->getFullname();
+     m_names->set(iElement->getFullname());
      m_flagBuffer = iElement->getTag();
      m_buffer = iElement->getStringValue();
-     m_tree->Fill();
+     fillValue();
+   }
+   virtual void doFill(const ElementSnapshot& iSnapshot) {
+     m_names->set(iSnapshot.m_fullName);
+     m_flagBuffer = iSnapshot.m_tag;
+     m_buffer = iSnapshot.m_stringValue;
+     fillValue();
+   }
+   virtual void doSnapshot(MonitorElement* iElement, ElementSnapshot& oSnapshot) {
+     oSnapshot.m_stringValue = iElement->getStringValue();
+   }
+   virtual void doHash(MonitorElement* iElement, ContentHash& ioHash) const {
+     const std::string& value = iElement->getStringValue();
+     ioHash.add(value.data(),value.size());
    }
   private:
     void setup() {
-      m_tree->Branch(kFullNameBranch,&m_fullNameBufferPtr);
+      m_names->setupBranch(m_tree);
       m_tree->Branch(kFlagBranch,&m_flagBuffer);
       m_tree->Branch(kValueBranch,&m_bufferPtr);
+      if(m_deduplicate) {
+        m_tree->Branch(kSameAsBranch,&m_sameAs);
+      }
+    }
+    void fillValue() {
+      if(m_deduplicate) {
+        m_sameAs = 0;
+        if(not m_buffer.empty()) {
+          std::pair<std::unordered_map<std::string, ULong64_t>::iterator,bool> inserted =
+            m_entries.insert(std::make_pair(m_buffer,static_cast<ULong64_t>(m_tree->GetEntries())));
+          if(not inserted.second) {
+            m_sameAs = inserted.first->second+1;
+            m_buffer.clear();
+          }
+        }
+      }
+      m_tree->Fill();
     }
     
     TTree* m_tree;
     uint32_t m_flagBuffer;
-    std::string* m_fullNameBufferPtr;
+    NameStorage* m_names;
     std::string m_buffer;
     std::string* m_bufferPtr;
+    bool m_deduplicate;
+    ULong64_t m_sameAs;
+    //the entry storing each value
+    std::unordered_map<std::string, ULong64_t> m_entries;
   };
 
+  //Everything needed to write one run or lumi, detached from the DQMStore
+  struct WriteRequest {
+    unsigned int m_run;
+    unsigned int m_lumi;
+    ULong64_t m_beginTime;
+    ULong64_t m_endTime;
+    unsigned int m_historyIndex;
+    unsigned int m_snapshotMarker;
+    //first is the TypeIndex of the element
+    std::vector<std::pair<unsigned int, ElementSnapshot> > m_elements;
+  };
+
+  //Adds iID and every ParameterSet nested in it. Nested PSets are stored in
+  // the blob of their parent by ID so they must be written as well.
+  void addReachableParameterSets(const edm::pset::Registry& iRegistry, const edm::ParameterSetID& iID,
+                                 std::set<edm::ParameterSetID>& ioReached) {
+    if(not ioReached.insert(iID).second) {
+      return;
+    }
+    const edm::ParameterSet* pset = iRegistry.getMapped(iID);
+    if(0 == pset) {
+      return;
+    }
+    for(edm::ParameterSet::psettable::const_iterator it = pset->psetTable().begin(), itEnd = pset->psetTable().end();
+        it != itEnd;
+        ++it) {
+      addReachableParameterSets(iRegistry,it->second.pset().id(),ioReached);
+    }
+    for(edm::ParameterSet::vpsettable::const_iterator it = pset->vpsetTable().begin(), itEnd = pset->vpsetTable().end();
+        it != itEnd;
+        ++it) {
+      const std::vector<edm::ParameterSet>& vpset = it->second.vpset();
+      for(std::vector<edm::ParameterSet>::const_iterator itV = vpset.begin(), itVEnd = vpset.end();
+          itV != itVEnd;
+          ++itV) {
+        addReachableParameterSets(iRegistry,itV->id(),ioReached);
+      }
+    }
+  }
 }
 
 
@@ -191,10 +772,91 @@ private:
 
   virtual void startEndFile();
   virtual void finishEndFile();
+
+  unsigned int historyIndex(edm::ProcessHistoryID const& iID);
+  void writeElements(bool iLumiElements, unsigned int iRun, unsigned int iLumi,
+                     ULong64_t iBeginTime, ULong64_t iEndTime, unsigned int iHistoryIndex);
+  void storeIndices(unsigned int iRun, unsigned int iLumi,
+                    ULong64_t iBeginTime, ULong64_t iEndTime, unsigned int iHistoryIndex,
+                    unsigned int iSnapshotMarker);
+  void fillIndices();
+  void writeOrderedIndices(TDirectory* iMetaDataDirectory);
+  void chooseBasketSize(unsigned int iTypeIndex);
+  unsigned int selectChangedLumiElements(std::vector<MonitorElement*>& ioItems, std::vector<unsigned int>& ioTypes,
+                                         unsigned int iRun, unsigned int iLumi, unsigned int iHistoryIndex);
+  void reallyOpenFile();
+  bool rolloverIfNeeded();
+  void updateMetaData();
+  void checkpointIfNeeded();
+
+  //used when the trees are filled on a separate thread
+  void startWriterThread();
+  void stopWriterThread();
+  void queueForWriting(boost::shared_ptr<WriteRequest> iRequest);
+  void writerLoop();
+
   std::string m_fileName;
   std::string m_logicalFileName;
   std::auto_ptr<TFile> m_file;
+
+  //limits after which the next lumi goes to a new file, 0 means no limit
+  unsigned int m_maxFileSizeMB;
+  unsigned int m_maxLumisPerFile;
+  unsigned int m_maxSecondsPerFile;
+  //0 for the first file, the others get the number added to their name
+  unsigned int m_fileSequence;
+  unsigned int m_lumisInFile;
+  std::chrono::steady_clock::time_point m_fileOpenTime;
+  //end of the file as seen by whichever thread fills the trees
+  std::atomic<long long> m_fileEnd;
+
+  //periodically make the file readable even if the job dies, 0 means never
+  unsigned int m_checkpointEveryNLumis;
+  unsigned int m_checkpointEverySeconds;
+  unsigned int m_lumisSinceCheckpoint;
+  std::chrono::steady_clock::time_point m_lastCheckpointTime;
+
+  //The meta data trees are kept so each checkpoint only adds what is new
+  struct MetaData {
+    MetaData(): m_directory(0), m_processHistoryTree(0), m_parameterSetsTree(0), m_nameTree(0), m_checkpointsTree(0),
+                m_shapesDirectory(0), m_shapeTrees(kNIndicies,static_cast<TTree*>(0)), m_nShapesStored(kNIndicies,0),
+                m_nHistoriesStored(0), m_nNamesStored(0), m_index(0),
+                m_pFullName(&m_fullName), m_pPath(&m_path), m_pName(&m_name), m_shape(0), m_nIndices(0) {}
+    TDirectory* m_directory;
+    TTree* m_processHistoryTree;
+    TTree* m_parameterSetsTree;
+    TTree* m_nameTree;
+    TTree* m_checkpointsTree;
+    //only when the histograms are stored as columns, one tree per histogram type
+    TDirectory* m_shapesDirectory;
+    std::vector<TTree*> m_shapeTrees;
+    std::vector<size_t> m_nShapesStored;
+    size_t m_nHistoriesStored;
+    size_t m_nNamesStored;
+    std::set<edm::ParameterSetID> m_storedParameterSets;
+    //the branch buffers
+    unsigned int m_index;
+    std::string m_processName;
+    std::string m_parameterSetID;
+    std::string m_releaseVersion;
+    std::string m_passID;
+    std::string m_blob;
+    std::string m_psetID;
+    std::string m_fullName;
+    std::string m_path;
+    std::string m_name;
+    std::string* m_pFullName;
+    std::string* m_pPath;
+    std::string* m_pName;
+    TH1* m_shape;
+    ULong64_t m_nIndices;
+  private:
+    MetaData(const MetaData&); // stop default
+    const MetaData& operator=(const MetaData&); // stop default
+  };
+  MetaData m_metaData;
   std::vector<boost::shared_ptr<TreeHelperBase> > m_treeHelpers;
+  std::vector<TTree*> m_typeTrees;
   
   unsigned int m_run;
   unsigned int m_lumi;
@@ -206,48 +868,94 @@ private:
   ULong64_t m_lastIndex;
   unsigned int m_filterOnRun;
   
-  std::string m_fullNameBuffer;
-  std::string* m_fullNameBufferPtr;
-  std::map<unsigned int, unsigned int> m_dqmKindToTypeIndex;
+  unsigned int m_fileFormatVersion;
+  NameStorage m_nameStorage;
+  //2D and 3D histograms with a smaller fraction of filled bins are stored sparse
+  double m_sparseDensityThreshold;
+  //0 unless the Summaries tree is written
+  bool m_writeSummaries;
+  std::unique_ptr<SummaryStorage> m_summaries;
+
+  //I/O tuning, 0 or -1 means use the ROOT default
+  int m_compressionAlgorithm;
+  int m_compressionLevel;
+  std::vector<unsigned int> m_basketSizes;
+  bool m_autoBasketSize;
+  std::vector<bool> m_basketSizeChosen;
+  long long m_autoFlush;
+  long long m_autoSave;
+  //indexed by MonitorElement::Kind
+  std::vector<unsigned int> m_dqmKindToTypeIndex;
   TTree* m_indicesTree;
+  //process history index, run and lumi of each entry of the Indices tree
+  struct IndexKey {
+    unsigned int m_historyIndex;
+    unsigned int m_run;
+    unsigned int m_lumi;
+  };
+  std::vector<IndexKey> m_indexKeys;
   
   std::vector<edm::ProcessHistoryID> m_seenHistories;
   edm::JobReport::Token m_jrToken;
+
+  //used to only write the lumi elements which changed since the previous lumi
+  bool m_writeOnlyChangedLumiElements;
+  bool m_hasPreviousLumiWrite;
+  unsigned int m_previousLumiRun;
+  unsigned int m_previousLumi;
+  unsigned int m_previousLumiHistoryIndex;
+  std::unordered_map<std::string, uint64_t> m_lumiContentHashes;
+
+  bool m_asyncWriting;
+  unsigned int m_asyncQueueDepth;
+  std::thread m_writerThread;
+  std::mutex m_queueMutex;
+  std::condition_variable m_queueChanged;
+  std::deque<boost::shared_ptr<WriteRequest> > m_writeQueue;
+  bool m_stopWriter;
+  std::exception_ptr m_writerException;
 };
 
 //
 // constants, enums and typedefs
 //
 
+//sizes used when the basket sizes are chosen automatically
+static const Long64_t kAutoBasketEntries = 16;
+static const Long64_t kMinAutoBasketSize = 16*1024;
+static const Long64_t kMaxAutoBasketSize = 8*1024*1024;
+
 static TreeHelperBase*
 makeHelper(unsigned int iTypeIndex,
            TTree* iTree, 
-           std::string* iFullNameBufferPtr) {
+           NameStorage* iNames,
+           unsigned int iFileFormatVersion,
+           double iSparseDensityThreshold) {
   switch(iTypeIndex) {
     case kIntIndex:
-    return new IntTreeHelper(iTree,iFullNameBufferPtr);
+    return new IntTreeHelper(iTree,iNames);
     case kFloatIndex:
-    return new FloatTreeHelper(iTree,iFullNameBufferPtr);
+    return new FloatTreeHelper(iTree,iNames);
     case kStringIndex:
-    return new StringTreeHelper(iTree,iFullNameBufferPtr);
+    return new StringTreeHelper(iTree,iNames,iFileFormatVersion >= kDeduplicatedFileFormatVersion);
     case kTH1FIndex:
-    return new TreeHelper<TH1F>(iTree,iFullNameBufferPtr);
+    return new TreeHelper<TH1F>(iTree,iNames,iTypeIndex,iFileFormatVersion,iSparseDensityThreshold);
     case kTH1SIndex:
-    return new TreeHelper<TH1S>(iTree,iFullNameBufferPtr);
+    return new TreeHelper<TH1S>(iTree,iNames,iTypeIndex,iFileFormatVersion,iSparseDensityThreshold);
     case kTH1DIndex:
-    return new TreeHelper<TH1D>(iTree,iFullNameBufferPtr);
+    return new TreeHelper<TH1D>(iTree,iNames,iTypeIndex,iFileFormatVersion,iSparseDensityThreshold);
     case kTH2FIndex:
-    return new TreeHelper<TH2F>(iTree,iFullNameBufferPtr);
+    return new TreeHelper<TH2F>(iTree,iNames,iTypeIndex,iFileFormatVersion,iSparseDensityThreshold);
     case kTH2SIndex:
-    return new TreeHelper<TH2S>(iTree,iFullNameBufferPtr);
+    return new TreeHelper<TH2S>(iTree,iNames,iTypeIndex,iFileFormatVersion,iSparseDensityThreshold);
     case kTH2DIndex:
-    return new TreeHelper<TH2D>(iTree,iFullNameBufferPtr);
+    return new TreeHelper<TH2D>(iTree,iNames,iTypeIndex,iFileFormatVersion,iSparseDensityThreshold);
     case kTH3FIndex:
-    return new TreeHelper<TH3F>(iTree,iFullNameBufferPtr);
+    return new TreeHelper<TH3F>(iTree,iNames,iTypeIndex,iFileFormatVersion,iSparseDensityThreshold);
     case kTProfileIndex:
-    return new TreeHelper<TProfile>(iTree,iFullNameBufferPtr);
+    return new TreeHelper<TProfile>(iTree,iNames,iTypeIndex,iFileFormatVersion,iSparseDensityThreshold);
     case kTProfile2DIndex:
-    return new TreeHelper<TProfile2D>(iTree,iFullNameBufferPtr);
+    return new TreeHelper<TProfile2D>(iTree,iNames,iTypeIndex,iFileFormatVersion,iSparseDensityThreshold);
   }
   assert(false);
   return 0;
@@ -265,12 +973,79 @@ edm::OutputModule(pset),
 m_fileName(pset.getUntrackedParameter<std::string>("fileName")),
 m_logicalFileName(pset.getUntrackedParameter<std::string>("logicalFileName","")),
 m_file(0),
+m_maxFileSizeMB(pset.getUntrackedParameter<unsigned int>("maxFileSizeMB",0)),
+m_maxLumisPerFile(pset.getUntrackedParameter<unsigned int>("maxLumisPerFile",0)),
+m_maxSecondsPerFile(pset.getUntrackedParameter<unsigned int>("maxSecondsPerFile",0)),
+m_fileSequence(0),
+m_lumisInFile(0),
+m_fileEnd(0),
+m_checkpointEveryNLumis(pset.getUntrackedParameter<unsigned int>("checkpointEveryNLumis",0)),
+m_checkpointEverySeconds(pset.getUntrackedParameter<unsigned int>("checkpointEverySeconds",0)),
+m_lumisSinceCheckpoint(0),
 m_treeHelpers(kNIndicies,boost::shared_ptr<TreeHelperBase>()),
+m_typeTrees(kNIndicies,static_cast<TTree*>(0)),
 m_presentHistoryIndex(0),
 m_filterOnRun(pset.getUntrackedParameter<unsigned int>("filterOnRun",0)),
-m_fullNameBufferPtr(&m_fullNameBuffer),
-m_indicesTree(0)
+m_fileFormatVersion(pset.getUntrackedParameter<unsigned int>("fileFormatVersion",kFirstFileFormatVersion)),
+m_nameStorage(m_fileFormatVersion >= kNameTableFileFormatVersion),
+m_sparseDensityThreshold(pset.getUntrackedParameter<double>("sparseDensityThreshold",0.25)),
+m_writeSummaries(pset.getUntrackedParameter<bool>("writeSummaries",false)),
+m_compressionAlgorithm(ROOT::kUseGlobalSetting),
+m_compressionLevel(pset.getUntrackedParameter<int>("compressionLevel",-1)),
+m_basketSizes(kNIndicies,pset.getUntrackedParameter<unsigned int>("basketSize",0)),
+m_autoBasketSize(pset.getUntrackedParameter<bool>("autoBasketSize",false)),
+m_basketSizeChosen(kNIndicies,false),
+m_autoFlush(pset.getUntrackedParameter<long long>("autoFlush",0)),
+m_autoSave(pset.getUntrackedParameter<long long>("autoSave",0)),
+m_indicesTree(0),
+m_writeOnlyChangedLumiElements(pset.getUntrackedParameter<bool>("writeOnlyChangedLumiElements",false)),
+m_hasPreviousLumiWrite(false),
+m_previousLumiRun(0),
+m_previousLumi(0),
+m_previousLumiHistoryIndex(0),
+m_asyncWriting(pset.getUntrackedParameter<bool>("asyncWriting",false)),
+m_asyncQueueDepth(std::max(1U,pset.getUntrackedParameter<unsigned int>("asyncQueueDepth",2))),
+m_stopWriter(false)
 {
+  const std::string algorithm = pset.getUntrackedParameter<std::string>("compressionAlgorithm","");
+  if(algorithm == "ZLIB") {
+    m_compressionAlgorithm = ROOT::kZLIB;
+  } else if(algorithm == "LZMA") {
+    m_compressionAlgorithm = ROOT::kLZMA;
+  } else if(not algorithm.empty()) {
+    throw edm::Exception(edm::errors::Configuration)<<"DQMRootOutputModule does not know the compression algorithm '"<<algorithm
+                                                    <<"'. Allowed values are ZLIB and LZMA.";
+  }
+
+  //TTree::AutoSave changes gDirectory, which must not happen on the writer thread
+  if(m_asyncWriting and 0 != m_autoSave) {
+    throw edm::Exception(edm::errors::Configuration)<<"DQMRootOutputModule can not use autoSave together with asyncWriting,"
+                                                    " use checkpointEveryNLumis or checkpointEverySeconds instead.";
+  }
+
+  if(m_writeOnlyChangedLumiElements and m_fileFormatVersion < kSnapshotMarkerFileFormatVersion) {
+    throw edm::Exception(edm::errors::Configuration)<<"DQMRootOutputModule writeOnlyChangedLumiElements needs fileFormatVersion "
+                                                    <<kSnapshotMarkerFileFormatVersion<<" or later so that older releases refuse the file"
+                                                    " instead of misreading it, but fileFormatVersion is "<<m_fileFormatVersion<<".";
+  }
+
+  if(m_sparseDensityThreshold < 0. or m_sparseDensityThreshold > 1.) {
+    throw edm::Exception(edm::errors::Configuration)<<"DQMRootOutputModule sparseDensityThreshold is "<<m_sparseDensityThreshold
+                                                    <<" but must be between 0 (never store sparse) and 1.";
+  }
+
+  //the basket size can be overridden for each type tree, e.g. basketSizes = cms.untracked.PSet(TH2Fs = cms.untracked.uint32(1048576))
+  const edm::ParameterSet basketSizes = pset.getUntrackedParameter<edm::ParameterSet>("basketSizes",edm::ParameterSet());
+  const std::vector<std::string> typeNames = basketSizes.getParameterNamesForType<unsigned int>(false);
+  for(std::vector<std::string>::const_iterator it = typeNames.begin(), itEnd = typeNames.end();
+      it != itEnd;
+      ++it) {
+    const char* const* itFound = std::find(kTypeNames,kTypeNames+kNIndicies,*it);
+    if(itFound == kTypeNames+kNIndicies) {
+      throw edm::Exception(edm::errors::Configuration)<<"DQMRootOutputModule basketSizes contains '"<<*it<<"' which is not the name of a type tree.";
+    }
+    m_basketSizes[itFound-kTypeNames] = basketSizes.getUntrackedParameter<unsigned int>(*it);
+  }
 }
 
 // DQMRootOutputModule::DQMRootOutputModule(const DQMRootOutputModule& rhs)
@@ -280,6 +1055,16 @@ m_indicesTree(0)
 
 DQMRootOutputModule::~DQMRootOutputModule()
 {
+  //only happens if the job is being stopped because of an exception
+  if(m_writerThread.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(m_queueMutex);
+      m_writeQueue.clear();
+      m_stopWriter = true;
+    }
+    m_queueChanged.notify_all();
+    m_writerThread.join();
+  }
 }
 
 //
@@ -306,16 +1091,70 @@ DQMRootOutputModule::isFileOpen() const
 void 
 DQMRootOutputModule::openFile(edm::FileBlock const&)
 {
-  //NOTE: I need to also set the I/O performance settings
-  
-  m_file = std::auto_ptr<TFile>(new TFile(m_fileName.c_str(),"RECREATE",
-                                "1" //This is the file format version number
+  m_fileSequence = 0;
+  reallyOpenFile();
+}
+
+void
+DQMRootOutputModule::reallyOpenFile()
+{
+  if(m_fileFormatVersion < kFirstFileFormatVersion || m_fileFormatVersion > kLatestFileFormatVersion) {
+    throw edm::Exception(edm::errors::Configuration)<<"DQMRootOutputModule can not write file format version "<<m_fileFormatVersion
+                                                    <<". Allowed versions are "<<kFirstFileFormatVersion<<" to "<<kLatestFileFormatVersion<<".";
+  }
+  std::ostringstream version;
+  version << m_fileFormatVersion;
+  //like PoolOutputModule, files after the first one get a number before the '.root'
+  std::string fileName = m_fileName;
+  std::string logicalFileName = m_logicalFileName;
+  if(0 != m_fileSequence) {
+    std::ostringstream suffix;
+    suffix << std::setw(3) << std::setfill('0') << m_fileSequence << ".root";
+    const std::string root(".root");
+    const bool hasRoot = fileName.size() >= root.size() and 0 == fileName.compare(fileName.size()-root.size(),root.size(),root);
+    fileName = (hasRoot ? fileName.substr(0,fileName.size()-root.size()) : fileName) + suffix.str();
+    if(not logicalFileName.empty()) {
+      const bool logicalHasRoot = logicalFileName.size() >= root.size() and
+                                  0 == logicalFileName.compare(logicalFileName.size()-root.size(),root.size(),root);
+      logicalFileName = (logicalHasRoot ? logicalFileName.substr(0,logicalFileName.size()-root.size()) : logicalFileName) + suffix.str();
+    }
+  }
+  m_file = std::auto_ptr<TFile>(new TFile(fileName.c_str(),"RECREATE",
+                                version.str().c_str() //This is the file format version number
                                 ));  
+  if(m_compressionAlgorithm != ROOT::kUseGlobalSetting) {
+    m_file->SetCompressionAlgorithm(m_compressionAlgorithm);
+  }
+  if(m_compressionLevel >= 0) {
+    m_file->SetCompressionLevel(m_compressionLevel);
+  }
+  m_nameStorage.clear();
+  m_indexKeys.clear();
+  //the first lumi in a file must always be complete
+  m_hasPreviousLumiWrite = false;
+  m_lumiContentHashes.clear();
+  m_lumisInFile = 0;
+  m_fileOpenTime = std::chrono::steady_clock::now();
+  m_lumisSinceCheckpoint = 0;
+  m_lastCheckpointTime = m_fileOpenTime;
+  //the meta data trees belong to the previous file
+  m_metaData.m_directory = 0;
+  m_metaData.m_processHistoryTree = 0;
+  m_metaData.m_parameterSetsTree = 0;
+  m_metaData.m_nameTree = 0;
+  m_metaData.m_checkpointsTree = 0;
+  m_metaData.m_shapesDirectory = 0;
+  std::fill(m_metaData.m_shapeTrees.begin(),m_metaData.m_shapeTrees.end(),static_cast<TTree*>(0));
+  std::fill(m_metaData.m_nShapesStored.begin(),m_metaData.m_nShapesStored.end(),0);
+  m_metaData.m_nHistoriesStored = 0;
+  m_metaData.m_nNamesStored = 0;
+  m_metaData.m_storedParameterSets.clear();
+  m_fileEnd = m_file->GetEND();
   
   edm::Service<edm::JobReport> jr;
   cms::Digest branchHash;
-  m_jrToken = jr->outputFileOpened(m_fileName,
-                                   m_logicalFileName,
+  m_jrToken = jr->outputFileOpened(fileName,
+                                   logicalFileName,
                                    std::string(),
                                    "DQMRootOutputModule",
                                    description().moduleLabel(),
@@ -336,6 +1175,19 @@ DQMRootOutputModule::openFile(edm::FileBlock const&)
   m_indicesTree->Branch(kFirstIndex,&m_firstIndex);
   m_indicesTree->Branch(kLastIndex,&m_lastIndex);
   m_indicesTree->SetDirectory(m_file.get());
+  if(0 != m_autoFlush) { m_indicesTree->SetAutoFlush(m_autoFlush);}
+  //0 turns off ROOT's default auto save, the writer thread must never do one
+  const bool setAutoSave = 0 != m_autoSave or m_asyncWriting;
+  if(setAutoSave) { m_indicesTree->SetAutoSave(m_autoSave);}
+
+  m_summaries.reset();
+  if(m_writeSummaries) {
+    TTree* summariesTree = new TTree(kSummariesTree,kSummariesTree);
+    m_summaries.reset(new SummaryStorage(summariesTree,&m_nameStorage));
+    summariesTree->SetDirectory(m_file.get());
+    if(0 != m_autoFlush) { summariesTree->SetAutoFlush(m_autoFlush);}
+    if(setAutoSave) { summariesTree->SetAutoSave(m_autoSave);}
+  }
   
   unsigned int i = 0;
   for(std::vector<boost::shared_ptr<TreeHelperBase> >::iterator it = m_treeHelpers.begin(), itEnd = m_treeHelpers.end();
@@ -343,10 +1195,20 @@ DQMRootOutputModule::openFile(edm::FileBlock const&)
   ++it,++i) {
     //std::cout <<"making "<<kTypeNames[i]<<std::endl;
     TTree* tree = new TTree(kTypeNames[i],kTypeNames[i]);
-    *it = boost::shared_ptr<TreeHelperBase>(makeHelper(i,tree,m_fullNameBufferPtr));
+    *it = boost::shared_ptr<TreeHelperBase>(makeHelper(i,tree,&m_nameStorage,m_fileFormatVersion,m_sparseDensityThreshold));
+    (*it)->setSummaries(m_summaries.get());
     tree->SetDirectory(m_file.get()); //TFile takes ownership
+    m_typeTrees[i] = tree;
+    if(0 != m_basketSizes[i]) {
+      tree->SetBasketSize("*",m_basketSizes[i]);
+    }
+    //an explicit size wins over the automatic one
+    m_basketSizeChosen[i] = (0 != m_basketSizes[i]) or not m_autoBasketSize;
+    if(0 != m_autoFlush) { tree->SetAutoFlush(m_autoFlush);}
+    if(setAutoSave) { tree->SetAutoSave(m_autoSave);}
   }
   
+  m_dqmKindToTypeIndex.assign(MonitorElement::DQM_KIND_TPROFILE2D+1,kNoTypesStored);
   m_dqmKindToTypeIndex[MonitorElement::DQM_KIND_INT]=kIntIndex;
   m_dqmKindToTypeIndex[MonitorElement::DQM_KIND_REAL]=kFloatIndex;
   m_dqmKindToTypeIndex[MonitorElement::DQM_KIND_STRING]=kStringIndex;
@@ -359,6 +1221,10 @@ DQMRootOutputModule::openFile(edm::FileBlock const&)
   m_dqmKindToTypeIndex[MonitorElement::DQM_KIND_TH3F]=kTH3FIndex;
   m_dqmKindToTypeIndex[MonitorElement::DQM_KIND_TPROFILE]=kTProfileIndex;
   m_dqmKindToTypeIndex[MonitorElement::DQM_KIND_TPROFILE2D]=kTProfile2DIndex;
+
+  if(m_asyncWriting) {
+    startWriterThread();
+  }
 }
 
 
@@ -369,38 +1235,205 @@ DQMRootOutputModule::write(edm::EventPrincipal const& ){
 void 
 DQMRootOutputModule::writeLuminosityBlock(edm::LuminosityBlockPrincipal const& iLumi) {
   //std::cout << "DQMRootOutputModule::writeLuminosityBlock"<< std::endl;
-  edm::Service<DQMStore> dstore;
-  m_run=iLumi.id().run();
-  m_lumi = iLumi.id().value();
-  m_beginTime = iLumi.beginTime().value();
-  m_endTime = iLumi.endTime().value();
+  unsigned int run = iLumi.id().run();
+  unsigned int lumi = iLumi.id().value();
+  bool shouldWrite = (m_filterOnRun == 0 ||
+		      (m_filterOnRun != 0 && m_filterOnRun == run));
+
+  if (! shouldWrite)
+    return;
+
+  writeElements(true,run,lumi,iLumi.beginTime().value(),iLumi.endTime().value(),
+                historyIndex(iLumi.processHistoryID()));
+
+  edm::Service<edm::JobReport> jr;
+  jr->reportLumiSection(run,lumi);
+
+  ++m_lumisInFile;
+  if(not rolloverIfNeeded()) {
+    checkpointIfNeeded();
+  }
+}
+
+//Closes the file and opens the next one if one of the limits was reached. Only
+// done between lumis so a lumi is never split across files.
+bool
+DQMRootOutputModule::rolloverIfNeeded() {
+  bool rollover = (0 != m_maxLumisPerFile and m_lumisInFile >= m_maxLumisPerFile);
+  if(not rollover and 0 != m_maxSecondsPerFile) {
+    rollover = std::chrono::steady_clock::now()-m_fileOpenTime >= std::chrono::seconds(m_maxSecondsPerFile);
+  }
+  if(not rollover and 0 != m_maxFileSizeMB) {
+    //baskets not yet flushed are not counted
+    rollover = m_fileEnd >= static_cast<long long>(m_maxFileSizeMB)*1024*1024;
+  }
+  if(not rollover) {
+    return false;
+  }
+  startEndFile();
+  finishEndFile();
+  ++m_fileSequence;
+  reallyOpenFile();
+  return true;
+}
+
+
+void DQMRootOutputModule::writeRun(edm::RunPrincipal const& iRun){
+  //std::cout << "DQMRootOutputModule::writeRun"<< std::endl;
+  unsigned int run = iRun.id().run();
   bool shouldWrite = (m_filterOnRun == 0 ||
-		      (m_filterOnRun != 0 && m_filterOnRun == m_run));
+		      (m_filterOnRun != 0 && m_filterOnRun == run));
 
   if (! shouldWrite)
     return;
-  std::vector<MonitorElement *> items(dstore->getAllContents(""));
-  for(std::vector<MonitorElement*>::iterator it = items.begin(), itEnd=items.end();
+
+  writeElements(false,run,0,iRun.beginTime().value(),iRun.endTime().value(),
+                historyIndex(iRun.processHistoryID()));
+
+  edm::Service<edm::JobReport> jr;
+  jr->reportRunNumber(run);  
+}
+
+unsigned int
+DQMRootOutputModule::historyIndex(edm::ProcessHistoryID const& iID) {
+  std::vector<edm::ProcessHistoryID>::iterator itFind = std::find(m_seenHistories.begin(),m_seenHistories.end(),iID);
+  if(itFind == m_seenHistories.end()) {
+    m_seenHistories.push_back(iID);
+    return m_seenHistories.size()-1;
+  }
+  return itFind - m_seenHistories.begin();
+}
+
+void
+DQMRootOutputModule::writeElements(bool iLumiElements, unsigned int iRun, unsigned int iLumi,
+                                   ULong64_t iBeginTime, ULong64_t iEndTime, unsigned int iHistoryIndex) {
+  edm::Service<DQMStore> dstore;
+  std::vector<MonitorElement *> allItems(dstore->getAllContents(""));
+  std::vector<MonitorElement *> items;
+  std::vector<unsigned int> types;
+  items.reserve(allItems.size());
+  types.reserve(allItems.size());
+  for(std::vector<MonitorElement*>::iterator it = allItems.begin(), itEnd=allItems.end();
       it!=itEnd;
       ++it) {
-    if((*it)->getLumiFlag()) {
-      std::map<unsigned int,unsigned int>::iterator itFound = m_dqmKindToTypeIndex.find((*it)->kind());
-      assert(itFound !=m_dqmKindToTypeIndex.end());
-      m_treeHelpers[itFound->second]->fill(*it);
+    if((*it)->getLumiFlag() == iLumiElements) {
+      const unsigned int kind = (*it)->kind();
+      assert(kind < m_dqmKindToTypeIndex.size() and m_dqmKindToTypeIndex[kind] != kNoTypesStored);
+      items.push_back(*it);
+      types.push_back(m_dqmKindToTypeIndex[kind]);
     }
   }
 
-  edm::ProcessHistoryID id = iLumi.processHistoryID();
-  std::vector<edm::ProcessHistoryID>::iterator itFind = std::find(m_seenHistories.begin(),m_seenHistories.end(),id);
-  if(itFind == m_seenHistories.end()) {
-    m_presentHistoryIndex = m_seenHistories.size();
-    m_seenHistories.push_back(id);
-  } else {
-    m_presentHistoryIndex = itFind - m_seenHistories.begin();
+  unsigned int snapshotMarker = kNoSnapshotMarker;
+  if(m_writeOnlyChangedLumiElements) {
+    if(iLumiElements) {
+      snapshotMarker = selectChangedLumiElements(items,types,iRun,iLumi,iHistoryIndex);
+    } else {
+      //a lumi of the same run after this is unexpected but should not be a delta
+      m_hasPreviousLumiWrite = false;
+    }
+  }
+
+  if(not m_asyncWriting) {
+    if(m_summaries) {
+      m_summaries->setKey(iRun,iLumi,iHistoryIndex);
+    }
+    for(size_t i = 0; i != items.size(); ++i) {
+      m_treeHelpers[types[i]]->fill(items[i]);
+    }
+    storeIndices(iRun,iLumi,iBeginTime,iEndTime,iHistoryIndex,snapshotMarker);
+    return;
+  }
+
+  //Only copy the payloads here, the expensive serialization and compression
+  // is done by the writer thread
+  boost::shared_ptr<WriteRequest> request(new WriteRequest);
+  request->m_run = iRun;
+  request->m_lumi = iLumi;
+  request->m_beginTime = iBeginTime;
+  request->m_endTime = iEndTime;
+  request->m_historyIndex = iHistoryIndex;
+  request->m_snapshotMarker = snapshotMarker;
+  request->m_elements.reserve(items.size());
+  for(size_t i = 0; i != items.size(); ++i) {
+    request->m_elements.push_back(std::make_pair(types[i],ElementSnapshot()));
+    m_treeHelpers[types[i]]->snapshot(items[i],request->m_elements.back().second);
+  }
+  queueForWriting(request);
+}
+
+//Removes from ioItems the elements whose content is the same as when the previous lumi
+// was written and returns the marker to store in the Indices tree.
+unsigned int
+DQMRootOutputModule::selectChangedLumiElements(std::vector<MonitorElement*>& ioItems, std::vector<unsigned int>& ioTypes,
+                                               unsigned int iRun, unsigned int iLumi, unsigned int iHistoryIndex) {
+  //Only write a delta against the lumi written just before this one, which must be an
+  // earlier lumi of the same run. A repeated lumi number would be merged with its other
+  // occurrences by the reader so it is always written completely.
+  bool carryForward = m_hasPreviousLumiWrite and
+                      m_previousLumiRun == iRun and
+                      m_previousLumiHistoryIndex == iHistoryIndex and
+                      m_previousLumi < iLumi;
+  m_hasPreviousLumiWrite = true;
+  m_previousLumiRun = iRun;
+  m_previousLumi = iLumi;
+  m_previousLumiHistoryIndex = iHistoryIndex;
+
+  std::vector<std::pair<std::string,uint64_t> > hashes;
+  hashes.reserve(ioItems.size());
+  size_t nKnown = 0;
+  for(size_t i = 0; i != ioItems.size(); ++i) {
+    hashes.push_back(std::make_pair(ioItems[i]->getFullname(),m_treeHelpers[ioTypes[i]]->contentHash(ioItems[i])));
+    if(m_lumiContentHashes.find(hashes.back().first) != m_lumiContentHashes.end()) {
+      ++nKnown;
+    }
+  }
+  if(nKnown != m_lumiContentHashes.size()) {
+    //an element went away, which a delta can not express
+    carryForward = false;
+  }
+  if(not carryForward) {
+    m_lumiContentHashes.clear();
+  }
+
+  size_t nKeep = 0;
+  for(size_t i = 0; i != ioItems.size(); ++i) {
+    std::pair<std::unordered_map<std::string, uint64_t>::iterator,bool> inserted =
+      m_lumiContentHashes.insert(hashes[i]);
+    if(carryForward and not inserted.second and inserted.first->second == hashes[i].second) {
+      continue;
+    }
+    inserted.first->second = hashes[i].second;
+    ioItems[nKeep] = ioItems[i];
+    ioTypes[nKeep] = ioTypes[i];
+    ++nKeep;
+  }
+  ioItems.resize(nKeep);
+  ioTypes.resize(nKeep);
+  return carryForward ? kCarryForwardSnapshot : kFullSnapshot;
+}
+
+void
+DQMRootOutputModule::storeIndices(unsigned int iRun, unsigned int iLumi,
+                                  ULong64_t iBeginTime, ULong64_t iEndTime, unsigned int iHistoryIndex,
+                                  unsigned int iSnapshotMarker) {
+  m_run = iRun;
+  m_lumi = iLumi;
+  m_beginTime = iBeginTime;
+  m_endTime = iEndTime;
+  m_presentHistoryIndex = iHistoryIndex;
+
+  bool storedIndex = false;
+  if(iSnapshotMarker != kNoSnapshotMarker) {
+    //must come before the entries of this write so the reader can find where it starts
+    m_type = iSnapshotMarker;
+    m_firstIndex=0;
+    m_lastIndex=0;
+    storedIndex = true;
+    fillIndices();
   }
 
   //Now store the relationship between run/lumi and indices in the other TTrees
-  bool storedLumiIndex = false;
   unsigned int typeIndex = 0;
   for(std::vector<boost::shared_ptr<TreeHelperBase> >::iterator it = m_treeHelpers.begin(), itEnd = m_treeHelpers.end();
       it != itEnd;
@@ -408,134 +1441,381 @@ DQMRootOutputModule::writeLuminosityBlock(edm::LuminosityBlockPrincipal const& i
     if((*it)->wasFilled()) {
       m_type = typeIndex;
       (*it)->getRangeAndReset(m_firstIndex,m_lastIndex);
-      storedLumiIndex = true;
-      m_indicesTree->Fill();
+      storedIndex = true;
+      fillIndices();
+      if(not m_basketSizeChosen[typeIndex]) {
+        chooseBasketSize(typeIndex);
+      }
     }
   }
-  if(not storedLumiIndex) {
+  if(not storedIndex and iLumi != 0) {
     //need to record lumis even if we stored no MonitorElements since some later DQM modules
     // look to see what lumis were processed
     m_type = kNoTypesStored;
     m_firstIndex=0;
     m_lastIndex=0;
-    m_indicesTree->Fill();
+    fillIndices();
   }
-  
-  edm::Service<edm::JobReport> jr;
-  jr->reportLumiSection(m_run,m_lumi);
+  m_fileEnd = m_file->GetEND();
 }
 
+//Sizes the Value basket of a type tree from the mean size of the entries stored by
+// the first write so that a basket holds about kAutoBasketEntries elements
+void
+DQMRootOutputModule::chooseBasketSize(unsigned int iTypeIndex) {
+  TTree* tree = m_typeTrees[iTypeIndex];
+  //the contents are by far the largest part of histograms stored as columns
+  TBranch* valueBranch = tree->GetBranch(kValueBranch);
+  if(0 == valueBranch) {
+    valueBranch = tree->GetBranch(kContentsBranch);
+  }
+  if(0 == valueBranch or 0 == tree->GetEntries()) {
+    return;
+  }
+  //GetTotBytes only counts the baskets already written, which the first entries rarely fill
+  const Long64_t meanEntrySize = valueBranch->GetTotalSize()/tree->GetEntries();
+  const Long64_t size = std::min(std::max(meanEntrySize*kAutoBasketEntries,kMinAutoBasketSize),kMaxAutoBasketSize);
+  tree->SetBasketSize(valueBranch->GetName(),static_cast<Int_t>(size));
+  m_basketSizeChosen[iTypeIndex] = true;
+}
 
-void DQMRootOutputModule::writeRun(edm::RunPrincipal const& iRun){
-  //std::cout << "DQMRootOutputModule::writeRun"<< std::endl;
-  edm::Service<DQMStore> dstore;
-  m_run=iRun.id().run();
-  m_lumi = 0;
-  m_beginTime = iRun.beginTime().value();
-  m_endTime = iRun.endTime().value();
-  bool shouldWrite = (m_filterOnRun == 0 ||
-		      (m_filterOnRun != 0 && m_filterOnRun == m_run));
+void
+DQMRootOutputModule::fillIndices() {
+  m_indicesTree->Fill();
+  IndexKey key = {m_presentHistoryIndex,m_run,m_lumi};
+  m_indexKeys.push_back(key);
+}
 
-  if (! shouldWrite)
+//Flags the file if the Indices entries are already grouped the way DQMRootSource
+// processes them, so it can find the order in one pass when reading the file.
+void
+DQMRootOutputModule::writeOrderedIndices(TDirectory* iMetaDataDirectory) {
+  edm::ProcessHistoryRegistry* phr = edm::ProcessHistoryRegistry::instance();
+  assert(0!=phr);
+  std::vector<edm::ProcessHistoryID> reducedIDs;
+  reducedIDs.reserve(m_seenHistories.size());
+  for(std::vector<edm::ProcessHistoryID>::iterator it = m_seenHistories.begin(), itEnd = m_seenHistories.end();
+      it !=itEnd;
+      ++it) {
+    reducedIDs.push_back(phr->extra().reduceProcessHistoryID(*it));
+  }
+  std::vector<unsigned int> reducedIndices;
+  reducedIndices.reserve(reducedIDs.size());
+  for(std::vector<edm::ProcessHistoryID>::const_iterator it = reducedIDs.begin(), itEnd = reducedIDs.end();
+      it != itEnd;
+      ++it) {
+    std::vector<edm::ProcessHistoryID>::const_iterator itFirst = reducedIDs.begin();
+    reducedIndices.push_back(std::find(itFirst,it+1,*it) - itFirst);
+  }
+
+  GroupedIndexOrder order;
+  for(std::vector<IndexKey>::const_iterator it = m_indexKeys.begin(), itEnd = m_indexKeys.end();
+      it != itEnd and order.grouped();
+      ++it) {
+    order.add(reducedIndices[it->m_historyIndex],it->m_run,it->m_lumi);
+  }
+  if(not order.grouped()) {
+    //the reader has to work it out
     return;
+  }
 
-  std::vector<MonitorElement *> items(dstore->getAllContents(""));
-  for(std::vector<MonitorElement*>::iterator it = items.begin(), itEnd=items.end();
-      it!=itEnd;
+  TTree* reducedHistoriesTree = new TTree(kReducedHistoriesTree,kReducedHistoriesTree);
+  reducedHistoriesTree->SetDirectory(iMetaDataDirectory);
+  unsigned int reducedIndex = 0;
+  reducedHistoriesTree->Branch(kReducedHistoryIndexBranch,&reducedIndex);
+  for(std::vector<unsigned int>::const_iterator it = reducedIndices.begin(), itEnd = reducedIndices.end();
+      it != itEnd;
       ++it) {
-    if(not (*it)->getLumiFlag()) {
-      std::map<unsigned int,unsigned int>::iterator itFound = m_dqmKindToTypeIndex.find((*it)->kind());
-      assert  (itFound !=m_dqmKindToTypeIndex.end());
-      m_treeHelpers[itFound->second]->fill(*it);
-    }
+    reducedIndex = *it;
+    reducedHistoriesTree->Fill();
   }
 
-  edm::ProcessHistoryID id = iRun.processHistoryID();
-  std::vector<edm::ProcessHistoryID>::iterator itFind = std::find(m_seenHistories.begin(),m_seenHistories.end(),id);
-  if(itFind == m_seenHistories.end()) {
-    m_presentHistoryIndex = m_seenHistories.size();
-    m_seenHistories.push_back(id);
-  } else {
-    m_presentHistoryIndex = itFind - m_seenHistories.begin();
+  //no entries means grouped
+  TTree* orderedIndicesTree = new TTree(kOrderedIndicesTree,kOrderedIndicesTree);
+  orderedIndicesTree->SetDirectory(iMetaDataDirectory);
+  unsigned int index = 0;
+  orderedIndicesTree->Branch(kOrderedIndexBranch,&index);
+}
+
+void
+DQMRootOutputModule::startWriterThread() {
+  assert(not m_writerThread.joinable());
+  //the writer streams and compresses objects while the framework thread uses ROOT
+  TThread::Initialize();
+  m_stopWriter = false;
+  m_writerException = std::exception_ptr();
+  m_writerThread = std::thread(&DQMRootOutputModule::writerLoop,this);
+}
+
+void
+DQMRootOutputModule::stopWriterThread() {
+  if(not m_writerThread.joinable()) {
+    return;
   }
-  
-  //Now store the relationship between run/lumi and indices in the other TTrees
-  unsigned int typeIndex = 0;
-  for(std::vector<boost::shared_ptr<TreeHelperBase> >::iterator it = m_treeHelpers.begin(), itEnd = m_treeHelpers.end();
-      it != itEnd;
-      ++it,++typeIndex) {
-    if((*it)->wasFilled()) {
-      m_type = typeIndex;
-      (*it)->getRangeAndReset(m_firstIndex,m_lastIndex);
-      m_indicesTree->Fill();
+  {
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    m_stopWriter = true;
+  }
+  m_queueChanged.notify_all();
+  //the writer only stops once the queue is empty
+  m_writerThread.join();
+  m_stopWriter = false;
+  if(m_writerException) {
+    std::exception_ptr e = m_writerException;
+    m_writerException = std::exception_ptr();
+    std::rethrow_exception(e);
+  }
+}
+
+void
+DQMRootOutputModule::queueForWriting(boost::shared_ptr<WriteRequest> iRequest) {
+  std::unique_lock<std::mutex> lock(m_queueMutex);
+  //bound the memory used by the snapshots by waiting for the writer to catch up
+  while(m_writeQueue.size() >= m_asyncQueueDepth and not m_writerException) {
+    m_queueChanged.wait(lock);
+  }
+  if(m_writerException) {
+    std::exception_ptr e = m_writerException;
+    m_writerException = std::exception_ptr();
+    std::rethrow_exception(e);
+  }
+  m_writeQueue.push_back(iRequest);
+  lock.unlock();
+  m_queueChanged.notify_all();
+}
+
+void
+DQMRootOutputModule::writerLoop() {
+  while(true) {
+    boost::shared_ptr<WriteRequest> request;
+    {
+      std::unique_lock<std::mutex> lock(m_queueMutex);
+      while(m_writeQueue.empty() and not m_stopWriter) {
+        m_queueChanged.wait(lock);
+      }
+      if(m_writeQueue.empty()) {
+        //asked to stop and everything has been written
+        return;
+      }
+      request = m_writeQueue.front();
+      m_writeQueue.pop_front();
+    }
+    //there is now room in the queue
+    m_queueChanged.notify_all();
+
+    try {
+      if(m_summaries) {
+        m_summaries->setKey(request->m_run,request->m_lumi,request->m_historyIndex);
+      }
+      for(std::vector<std::pair<unsigned int, ElementSnapshot> >::const_iterator it = request->m_elements.begin(),
+          itEnd = request->m_elements.end();
+          it != itEnd;
+          ++it) {
+        m_treeHelpers[it->first]->fill(it->second);
+      }
+      storeIndices(request->m_run,request->m_lumi,request->m_beginTime,request->m_endTime,request->m_historyIndex,
+                   request->m_snapshotMarker);
+    } catch(...) {
+      //hand the problem to the framework thread, nothing more will be written
+      std::lock_guard<std::mutex> lock(m_queueMutex);
+      m_writerException = std::current_exception();
+      m_writeQueue.clear();
+      m_queueChanged.notify_all();
+      return;
     }
   }
-  
-  edm::Service<edm::JobReport> jr;
-  jr->reportRunNumber(m_run);  
 }
 
 void DQMRootOutputModule::startEndFile() {
   //std::cout << "DQMRootOutputModule::startEndFile"<< std::endl;
-  //fill in the meta data
-  m_file->cd();
-  TDirectory* metaDataDirectory = m_file->mkdir(kMetaDataDirectory);
+  //The writer thread must be done with the trees before anything else is added
+  // to the file so the drain can not wait until finishEndFile
+  stopWriterThread();
 
+  updateMetaData();
+  writeOrderedIndices(m_metaData.m_directory);
+}
 
-  //Write out the Process History
-  TTree* processHistoryTree = new TTree(kProcessHistoryTree,kProcessHistoryTree);
-  processHistoryTree->SetDirectory(metaDataDirectory);
-  
-  unsigned int index = 0;
-  processHistoryTree->Branch(kPHIndexBranch,&index);
-  std::string processName;
-  processHistoryTree->Branch(kProcessConfigurationProcessNameBranch,&processName);
-  std::string parameterSetID;
-  processHistoryTree->Branch(kProcessConfigurationParameterSetIDBranch,&parameterSetID);
-  std::string releaseVersion;
-  processHistoryTree->Branch(kProcessConfigurationReleaseVersion,&releaseVersion);
-  std::string passID;
-  processHistoryTree->Branch(kProcessConfigurationPassID,&passID);
+//Adds to the meta data trees what was not stored at the previous checkpoint
+void DQMRootOutputModule::updateMetaData() {
+  MetaData& md = m_metaData;
+  if(0 == md.m_directory) {
+    //fill in the meta data
+    m_file->cd();
+    md.m_directory = m_file->mkdir(kMetaDataDirectory);
 
+    md.m_processHistoryTree = new TTree(kProcessHistoryTree,kProcessHistoryTree);
+    md.m_processHistoryTree->SetDirectory(md.m_directory);
+    md.m_processHistoryTree->Branch(kPHIndexBranch,&md.m_index);
+    md.m_processHistoryTree->Branch(kProcessConfigurationProcessNameBranch,&md.m_processName);
+    md.m_processHistoryTree->Branch(kProcessConfigurationParameterSetIDBranch,&md.m_parameterSetID);
+    md.m_processHistoryTree->Branch(kProcessConfigurationReleaseVersion,&md.m_releaseVersion);
+    md.m_processHistoryTree->Branch(kProcessConfigurationPassID,&md.m_passID);
+
+    md.m_parameterSetsTree = new TTree(kParameterSetTree,kParameterSetTree);
+    md.m_parameterSetsTree->SetDirectory(md.m_directory);
+    md.m_parameterSetsTree->Branch(kParameterSetBranch,&md.m_blob);
+    md.m_parameterSetsTree->Branch(kParameterSetIDBranch,&md.m_psetID);
+
+    if(m_nameStorage.useNameTable()) {
+      md.m_nameTree = new TTree(kNameTree,kNameTree);
+      md.m_nameTree->SetDirectory(md.m_directory);
+      md.m_nameTree->Branch(kNameFullNameBranch,&md.m_pFullName);
+      //Store the split name as well so the reader does not have to do it
+      md.m_nameTree->Branch(kNamePathBranch,&md.m_pPath);
+      md.m_nameTree->Branch(kNameLeafBranch,&md.m_pName);
+    }
+
+    if(m_fileFormatVersion >= kColumnarFileFormatVersion) {
+      md.m_shapesDirectory = md.m_directory->mkdir(kShapesDirectory);
+      for(unsigned int type = 0; type != kNIndicies; ++type) {
+        if(0 == m_treeHelpers[type]->shapes()) {
+          continue;
+        }
+        TTree* tree = new TTree(kTypeNames[type],kTypeNames[type]);
+        tree->SetDirectory(md.m_shapesDirectory);
+        tree->Branch(kShapeBranch,kTypeClassNames[type],&md.m_shape,32*1024,0);
+        md.m_shapeTrees[type] = tree;
+      }
+    }
+
+    md.m_checkpointsTree = new TTree(kCheckpointsTree,kCheckpointsTree);
+    md.m_checkpointsTree->SetDirectory(md.m_directory);
+    md.m_checkpointsTree->Branch(kCheckpointNIndicesBranch,&md.m_nIndices);
+  }
+
+  //Write out the Process History
   edm::ProcessHistoryRegistry* phr = edm::ProcessHistoryRegistry::instance();
   assert(0!=phr);
-  for(std::vector<edm::ProcessHistoryID>::iterator it = m_seenHistories.begin(), itEnd = m_seenHistories.end();
+  edm::pset::Registry* psr = edm::pset::Registry::instance();
+  assert(0!=psr);
+  //only the ParameterSets used by the stored histories are needed by the reader
+  std::set<edm::ParameterSetID> reachedParameterSets;
+  for(std::vector<edm::ProcessHistoryID>::iterator it = m_seenHistories.begin()+md.m_nHistoriesStored, itEnd = m_seenHistories.end();
       it !=itEnd;
       ++it) {
     const edm::ProcessHistory* history = phr->getMapped(*it);
     assert(0!=history);
-    index = 0;
+    md.m_index = 0;
     for(edm::ProcessHistory::collection_type::const_iterator itPC = history->begin(), itPCEnd = history->end();
         itPC != itPCEnd;
-        ++itPC,++index) {
-      processName = itPC->processName();
-      releaseVersion = itPC->releaseVersion();
-      passID = itPC->passID();
-      parameterSetID = itPC->parameterSetID().compactForm();
-      processHistoryTree->Fill();
+        ++itPC,++md.m_index) {
+      md.m_processName = itPC->processName();
+      md.m_releaseVersion = itPC->releaseVersion();
+      md.m_passID = itPC->passID();
+      md.m_parameterSetID = itPC->parameterSetID().compactForm();
+      md.m_processHistoryTree->Fill();
+      addReachableParameterSets(*psr,itPC->parameterSetID(),reachedParameterSets);
     }
   }
+  md.m_nHistoriesStored = m_seenHistories.size();
   
   //Store the ParameterSets
-  TTree* parameterSetsTree = new TTree(kParameterSetTree,kParameterSetTree);
-  parameterSetsTree->SetDirectory(metaDataDirectory);
-  std::string blob;
-  parameterSetsTree->Branch(kParameterSetBranch,&blob);
-  
-  edm::pset::Registry* psr = edm::pset::Registry::instance();
-  assert(0!=psr);
-  for(edm::pset::Registry::const_iterator it = psr->begin(), itEnd = psr->end();
-  it != itEnd;
-  ++it) {
-    blob.clear();
-    it->second.toString(blob);
-    parameterSetsTree->Fill();
+  for(std::set<edm::ParameterSetID>::const_iterator it = reachedParameterSets.begin(), itEnd = reachedParameterSets.end();
+      it != itEnd;
+      ++it) {
+    const edm::ParameterSet* pset = psr->getMapped(*it);
+    if(0 == pset or not md.m_storedParameterSets.insert(*it).second) {
+      continue;
+    }
+    md.m_blob.clear();
+    pset->toString(md.m_blob);
+    //the reader can then skip the digest of the blob
+    md.m_psetID = it->compactForm();
+    md.m_parameterSetsTree->Fill();
+  }
+
+  if(0 != md.m_nameTree) {
+    for(std::vector<std::string>::const_iterator it = m_nameStorage.names().begin()+md.m_nNamesStored, itEnd = m_nameStorage.names().end();
+        it != itEnd;
+        ++it) {
+      md.m_fullName = *it;
+      size_t index = md.m_fullName.find_last_of('/');
+      if(index == std::string::npos) {
+        md.m_path.clear();
+        md.m_name = md.m_fullName;
+      } else {
+        md.m_path = md.m_fullName.substr(0,index);
+        md.m_name = md.m_fullName.substr(index+1);
+      }
+      md.m_nameTree->Fill();
+    }
+    md.m_nNamesStored = m_nameStorage.names().size();
+  }
+
+  for(unsigned int type = 0; type != kNIndicies; ++type) {
+    if(0 == md.m_shapeTrees[type]) {
+      continue;
+    }
+    const std::vector<std::unique_ptr<TH1> >& shapes = m_treeHelpers[type]->shapes()->shapes();
+    for(std::vector<std::unique_ptr<TH1> >::const_iterator it = shapes.begin()+md.m_nShapesStored[type], itEnd = shapes.end();
+        it != itEnd;
+        ++it) {
+      md.m_shape = it->get();
+      md.m_shapeTrees[type]->Fill();
+    }
+    md.m_nShapesStored[type] = shapes.size();
+  }
+
+  md.m_nIndices = m_indicesTree->GetEntries();
+  md.m_checkpointsTree->Fill();
+}
+
+//Makes what was written so far readable even if the job never closes the file
+void
+DQMRootOutputModule::checkpointIfNeeded() {
+  ++m_lumisSinceCheckpoint;
+  bool checkpoint = (0 != m_checkpointEveryNLumis and m_lumisSinceCheckpoint >= m_checkpointEveryNLumis);
+  if(not checkpoint and 0 != m_checkpointEverySeconds) {
+    checkpoint = std::chrono::steady_clock::now()-m_lastCheckpointTime >= std::chrono::seconds(m_checkpointEverySeconds);
+  }
+  if(not checkpoint) {
+    return;
+  }
+  //the trees must not change while they are saved
+  stopWriterThread();
+
+  updateMetaData();
+  for(std::vector<TTree*>::iterator it = m_typeTrees.begin(), itEnd = m_typeTrees.end();
+      it != itEnd;
+      ++it) {
+    (*it)->AutoSave("SaveSelf");
+  }
+  m_indicesTree->AutoSave("SaveSelf");
+  if(m_summaries) {
+    m_summaries->tree()->AutoSave("SaveSelf");
+  }
+  m_metaData.m_processHistoryTree->AutoSave("SaveSelf");
+  m_metaData.m_parameterSetsTree->AutoSave("SaveSelf");
+  if(0 != m_metaData.m_nameTree) {
+    m_metaData.m_nameTree->AutoSave("SaveSelf");
+  }
+  for(std::vector<TTree*>::iterator it = m_metaData.m_shapeTrees.begin(), itEnd = m_metaData.m_shapeTrees.end();
+      it != itEnd;
+      ++it) {
+    if(0 != *it) {
+      (*it)->AutoSave("SaveSelf");
+    }
+  }
+  if(0 != m_metaData.m_shapesDirectory) {
+    m_metaData.m_shapesDirectory->SaveSelf(kTRUE);
+  }
+  m_metaData.m_checkpointsTree->AutoSave("SaveSelf");
+  m_metaData.m_directory->SaveSelf(kTRUE);
+  m_file->SaveSelf(kTRUE);
+  m_file->Flush();
+
+  m_lumisSinceCheckpoint = 0;
+  m_lastCheckpointTime = std::chrono::steady_clock::now();
+  if(m_asyncWriting) {
+    startWriterThread();
   }
-  
 }
 
 void DQMRootOutputModule::finishEndFile() {
   //std::cout << "DQMRootOutputModule::finishEndFile"<< std::endl;
+  //normally already done in startEndFile
+  stopWriterThread();
   m_file->Write();
   m_file->Close();
   edm::Service<edm::JobReport> jr;
@@ -16,14 +16,22 @@
 #include <string>
 #include <map>
 #include <memory>
-#include <list>
 #include <set>
+#include <cstdlib>
+#include <algorithm>
+#include <future>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <unordered_set>
 #include "TFile.h"
 #include "TTree.h"
 #include "TString.h"
 #include "TH1.h"
 #include "TH2.h"
 #include "TProfile.h"
+#include "TThread.h"
+#include "TROOT.h"
 
 // user include files
 #include "FWCore/Framework/interface/InputSource.h"
@@ -54,11 +62,20 @@
 #include "DataFormats/Provenance/interface/ProcessHistory.h"
 #include "DataFormats/Provenance/interface/ProcessHistoryID.h"
 #include "DataFormats/Provenance/interface/ProcessHistoryRegistry.h"
+#include "DataFormats/Provenance/interface/LuminosityBlockRange.h"
 #include "FWCore/ParameterSet/interface/Registry.h"
 
 #include "FWCore/Utilities/interface/Digest.h"
 
 #include "format.h"
+#include "IndexOrderBuilder.h"
+#include "ElementMergeRules.h"
+#include "ParallelElementDecoder.h"
+#include "HistogramColumns.h"
+#include "RootFileMutex.h"
+#include "CacheEntryRanges.h"
+#include "ElementSelector.h"
+#include "RunLumiSelector.h"
 
 namespace {
   //adapter functions
@@ -66,29 +83,18 @@ namespace {
     //std::cout <<"create: hist size "<<iName <<" "<<iHist->GetEffectiveEntries()<<std::endl;
     return iStore.book1D(iName, iHist);
   }
-  //NOTE: the merge logic comes from DataFormats/Histograms/interface/MEtoEDMFormat.h
-  void mergeTogether(TH1* iOriginal,TH1* iToAdd) {
-    if(iOriginal->TestBit(TH1::kCanRebin)==true && iToAdd->TestBit(TH1::kCanRebin) ==true) {
-      TList list;
-      list.Add(iToAdd);
-      if( -1 == iOriginal->Merge(&list)) {
+  template<class T>
+  void mergeTogether(T* iOriginal,T* iToAdd) {
+    switch(ElementMergeRules::mergeHistograms(iOriginal,iToAdd)) {
+      case ElementMergeRules::kMergeFailed:
         edm::LogError("MergeFailure")<<"Failed to merge DQM element "<<iOriginal->GetName();
-      }
-    } else {
-      if (iOriginal->GetNbinsX() == iToAdd->GetNbinsX() &&
-          iOriginal->GetXaxis()->GetXmin() == iToAdd->GetXaxis()->GetXmin() &&
-          iOriginal->GetXaxis()->GetXmax() == iToAdd->GetXaxis()->GetXmax() &&
-          iOriginal->GetNbinsY() == iToAdd->GetNbinsY() &&
-          iOriginal->GetYaxis()->GetXmin() == iToAdd->GetYaxis()->GetXmin() &&
-          iOriginal->GetYaxis()->GetXmax() == iToAdd->GetYaxis()->GetXmax() &&
-          iOriginal->GetNbinsZ() == iToAdd->GetNbinsZ() &&
-          iOriginal->GetZaxis()->GetXmin() == iToAdd->GetZaxis()->GetXmin() &&
-          iOriginal->GetZaxis()->GetXmax() == iToAdd->GetZaxis()->GetXmax()) {
-        iOriginal->Add(iToAdd);
-      } else {
+        break;
+      case ElementMergeRules::kDifferentAxes:
         edm::LogError("MergeFailure")<<"Found histograms with different axis limits '"<<iOriginal->GetName()<<"' not merged.";
-      }
-    } 
+        break;
+      case ElementMergeRules::kMerged:
+        break;
+    }
   }
   void mergeWithElement(MonitorElement* iElement, TH1F* iHist) {
     //std::cout <<"merge: hist size "<<iElement->getName() <<" "<<iHist->GetEffectiveEntries()<<std::endl;
@@ -149,18 +155,10 @@ namespace {
     return e;
   }
 
-  //NOTE: the merge logic comes from DataFormats/Histograms/interface/MEtoEDMFormat.h
   void mergeWithElement(MonitorElement* iElement, Long64_t& iValue) {
-    const std::string& name = iElement->getFullname();
-    if(name.find("EventInfo/processedEvents") != std::string::npos) {
-      iElement->Fill(iValue+iElement->getIntValue());
-    } else {
-      if(name.find("EventInfo/iEvent") != std::string::npos ||
-         name.find("EventInfo/iLumiSection") != std::string::npos) {
-        if(iValue > iElement->getIntValue()) {
-          iElement->Fill(iValue);
-        }
-      }
+    const Long64_t merged = ElementMergeRules::mergeInts(iElement->getFullname(),iElement->getIntValue(),iValue);
+    if(merged != iElement->getIntValue()) {
+      iElement->Fill(merged);
     }
   }
 
@@ -199,89 +197,633 @@ namespace {
     unsigned int m_type; //A value in TypeIndex
   };
 
+  //An entry of the name table, kept split so it never has to be parsed again
+  struct NameEntry {
+    std::string m_fullName;
+    std::string m_path;
+    std::string m_name;
+  };
+
+  //Everything DQMRootSource needs from a file which can be read without using
+  // the framework registries. This allows it to be read on a separate thread.
+  // Only the contents read are handed over, the TFile must still be closed holding rootFileMutex.
+  struct ProcessConfigurationEntry {
+    unsigned int m_index;
+    std::string m_processName;
+    std::string m_parameterSetID;
+    std::string m_releaseVersion;
+    std::string m_passID;
+  };
+  struct FileContents {
+    FileContents(): m_fileFormatVersion(0), m_endsAtCheckpoint(false), m_hasStoredOrder(false), m_isGrouped(false) {}
+    std::unique_ptr<TFile> m_file;
+    unsigned int m_fileFormatVersion;
+    std::vector<std::string> m_parameterSetBlobs;
+    //compact form of the ID of each blob, empty for files written before the IDs were stored
+    std::vector<std::string> m_parameterSetIDs;
+    std::vector<ProcessConfigurationEntry> m_processConfigurations;
+    std::vector<NameEntry> m_names;
+    //indexed by type, only filled if the histograms are stored as columns
+    std::vector<std::vector<HistogramShape> > m_shapes;
+    std::vector<RunLumiToRange> m_runlumiToRange;
+    //true if the file was not closed properly and only what was saved by the last checkpoint is used
+    bool m_endsAtCheckpoint;
+    //as written by DQMRootOutputModule, still needs to be checked before being used
+    bool m_hasStoredOrder;
+    //the OrderedIndices tree is empty, which flags that the entries are grouped
+    bool m_isGrouped;
+    std::vector<unsigned int> m_storedReducedHistories;
+  };
+
+  //everything done here opens the file or reads objects from it, so all of it holds
+  // rootFileMutex whichever thread it runs on
+  std::unique_ptr<FileContents> readFileContents(const std::string& iFileName) {
+    std::lock_guard<std::mutex> guard(rootFileMutex());
+    std::unique_ptr<FileContents> contents(new FileContents);
+    try {
+      contents->m_file.reset(TFile::Open(iFileName.c_str()));
+    } catch(cms::Exception const& e) {
+      edm::Exception ex(edm::errors::FileOpenError,"",e);
+      ex.addContext("Opening DQM Root file");
+      ex <<"\nInput file " << iFileName << " was not found, could not be opened, or is corrupted.\n";
+      throw ex;
+    }
+    if(0 == contents->m_file.get() || contents->m_file->IsZombie()) {
+      edm::Exception ex(edm::errors::FileOpenError);
+      ex<<"Input file "<<iFileName.c_str() <<" could not be opened.\n";
+      ex.addContext("Opening DQM Root file");
+      throw ex;
+    }
+    TFile* file = contents->m_file.get();
+    //Check file format version, which is encoded in the Title of the TFile
+    contents->m_fileFormatVersion = atoi(file->GetTitle());
+    if(contents->m_fileFormatVersion < kFirstFileFormatVersion || contents->m_fileFormatVersion > kLatestFileFormatVersion) {
+      edm::Exception ex(edm::errors::FileReadError);
+      ex<<"Input file "<<iFileName.c_str() <<" does not appear to be a DQM Root file"
+        " or was written with a newer file format version ("<<file->GetTitle()<<").\n";
+      ex.addContext("Opening DQM Root file");
+      throw ex;
+    }
+
+    //Get meta Data
+    TDirectory* metaDir = file->GetDirectory(kMetaDataDirectoryAbsolute);
+    if(0==metaDir) {
+      edm::Exception ex(edm::errors::FileReadError);
+      ex<<"Input file "<<iFileName.c_str() <<" appears to be corrupted since it does not have the proper internal structure.\n"
+        " Check to see if the file was closed properly.\n";    
+      ex.addContext("Opening DQM Root file");
+      throw ex;    
+    }
+    TTree* parameterSetTree = dynamic_cast<TTree*>(metaDir->Get(kParameterSetTree));
+    assert(0!=parameterSetTree);
+    {
+      std::string blob;
+      std::string* pBlob = &blob;
+      parameterSetTree->SetBranchAddress(kParameterSetBranch,&pBlob);
+      std::string psetID;
+      std::string* pPSetID = &psetID;
+      const bool hasIDs = 0 != parameterSetTree->GetBranch(kParameterSetIDBranch);
+      if(hasIDs) {
+        parameterSetTree->SetBranchAddress(kParameterSetIDBranch,&pPSetID);
+        contents->m_parameterSetIDs.reserve(parameterSetTree->GetEntries());
+      }
+      contents->m_parameterSetBlobs.reserve(parameterSetTree->GetEntries());
+      for(unsigned int index = 0; index != parameterSetTree->GetEntries();++index)
+      {
+        parameterSetTree->GetEntry(index);
+        contents->m_parameterSetBlobs.push_back(blob);
+        if(hasIDs) {
+          contents->m_parameterSetIDs.push_back(psetID);
+        }
+      } 
+    }
+
+    {
+      TTree* processHistoryTree = dynamic_cast<TTree*>(metaDir->Get(kProcessHistoryTree));
+      assert(0!=processHistoryTree);
+      ProcessConfigurationEntry entry;
+      processHistoryTree->SetBranchAddress(kPHIndexBranch,&entry.m_index);
+      std::string* pProcessName = &entry.m_processName;
+      processHistoryTree->SetBranchAddress(kProcessConfigurationProcessNameBranch,&pProcessName);
+      std::string* pParameterSetIDBlob = &entry.m_parameterSetID;
+      processHistoryTree->SetBranchAddress(kProcessConfigurationParameterSetIDBranch,&pParameterSetIDBlob);
+      std::string* pReleaseVersion = &entry.m_releaseVersion;
+      processHistoryTree->SetBranchAddress(kProcessConfigurationReleaseVersion,&pReleaseVersion);
+      std::string* pPassID = &entry.m_passID;
+      processHistoryTree->SetBranchAddress(kProcessConfigurationPassID,&pPassID);
+      contents->m_processConfigurations.reserve(processHistoryTree->GetEntries());
+      for(unsigned int i=0; i != processHistoryTree->GetEntries(); ++i) {
+        processHistoryTree->GetEntry(i);
+        contents->m_processConfigurations.push_back(entry);
+      }
+    }
+
+    if(contents->m_fileFormatVersion >= kNameTableFileFormatVersion) {
+      TTree* nameTree = dynamic_cast<TTree*>(metaDir->Get(kNameTree));
+      if(0==nameTree) {
+        edm::Exception ex(edm::errors::FileReadError);
+        ex<<"Input file "<<iFileName.c_str() <<" appears to be corrupted since it does not have a name table.\n";
+        ex.addContext("Opening DQM Root file");
+        throw ex;
+      }
+      NameEntry entry;
+      std::string* pFullName = &entry.m_fullName;
+      nameTree->SetBranchAddress(kNameFullNameBranch,&pFullName);
+      std::string* pPath = &entry.m_path;
+      nameTree->SetBranchAddress(kNamePathBranch,&pPath);
+      std::string* pName = &entry.m_name;
+      nameTree->SetBranchAddress(kNameLeafBranch,&pName);
+      contents->m_names.reserve(nameTree->GetEntries());
+      for(Long64_t index = 0; index != nameTree->GetEntries(); ++index) {
+        nameTree->GetEntry(index);
+        contents->m_names.push_back(entry);
+      }
+    }
+
+    if(contents->m_fileFormatVersion >= kColumnarFileFormatVersion) {
+      TDirectory* shapesDir = metaDir->GetDirectory(kShapesDirectory);
+      if(0==shapesDir) {
+        edm::Exception ex(edm::errors::FileReadError);
+        ex<<"Input file "<<iFileName.c_str() <<" appears to be corrupted since it does not have the histogram shapes.\n";
+        ex.addContext("Opening DQM Root file");
+        throw ex;
+      }
+      contents->m_shapes.resize(kNIndicies);
+      for(unsigned int type = kTH1FIndex; type != kNIndicies; ++type) {
+        HistogramColumns::readShapes(dynamic_cast<TTree*>(shapesDir->Get(kTypeNames[type])),type,contents->m_shapes[type]);
+      }
+    }
+
+    //Setup the indices
+    TTree* indicesTree = dynamic_cast<TTree*>(file->Get(kIndicesTree));
+    assert(0!=indicesTree);
+    RunLumiToRange temp;
+    indicesTree->SetBranchAddress(kRunBranch,&temp.m_run);
+    indicesTree->SetBranchAddress(kLumiBranch,&temp.m_lumi);
+    indicesTree->SetBranchAddress(kBeginTimeBranch,&temp.m_beginTime);
+    indicesTree->SetBranchAddress(kEndTimeBranch,&temp.m_endTime);
+    indicesTree->SetBranchAddress(kProcessHistoryIndexBranch,&temp.m_historyIDIndex);
+    indicesTree->SetBranchAddress(kTypeBranch,&temp.m_type);
+    indicesTree->SetBranchAddress(kFirstIndex,&temp.m_firstIndex);
+    indicesTree->SetBranchAddress(kLastIndex,&temp.m_lastIndex);
+    contents->m_runlumiToRange.reserve(indicesTree->GetEntries());
+    for (Long64_t index = 0; index != indicesTree->GetEntries(); ++index)
+    {
+      indicesTree->GetEntry(index);
+//       std::cout <<"read r:"<<temp.m_run
+//              <<" l:"<<temp.m_lumi
+//              <<" b:"<<temp.m_beginTime
+//              <<" e:"<<temp.m_endTime
+//              <<" fi:" << temp.m_firstIndex
+//              <<" li:" << temp.m_lastIndex
+//              <<" type:" << temp.m_type << std::endl;
+      contents->m_runlumiToRange.push_back(temp);
+    }
+
+    TTree* checkpointsTree = dynamic_cast<TTree*>(metaDir->Get(kCheckpointsTree));
+    if(0 != checkpointsTree && checkpointsTree->GetEntries() > 0) {
+      ULong64_t nIndices = 0;
+      checkpointsTree->SetBranchAddress(kCheckpointNIndicesBranch,&nIndices);
+      checkpointsTree->GetEntry(checkpointsTree->GetEntries()-1);
+      if(nIndices < contents->m_runlumiToRange.size()) {
+        //the job writing the file did not finish, the later entries may not be usable
+        contents->m_runlumiToRange.resize(nIndices);
+        contents->m_endsAtCheckpoint = true;
+      }
+    }
+
+    TTree* reducedHistoriesTree = dynamic_cast<TTree*>(metaDir->Get(kReducedHistoriesTree));
+    TTree* orderedIndicesTree = dynamic_cast<TTree*>(metaDir->Get(kOrderedIndicesTree));
+    //older releases did not store them, and the writer does not if the entries are not grouped
+    if(0 != reducedHistoriesTree && 0 != orderedIndicesTree) {
+      contents->m_hasStoredOrder = true;
+      contents->m_isGrouped = 0 == orderedIndicesTree->GetEntries();
+      unsigned int index = 0;
+      reducedHistoriesTree->SetBranchAddress(kReducedHistoryIndexBranch,&index);
+      contents->m_storedReducedHistories.reserve(reducedHistoriesTree->GetEntries());
+      for(Long64_t i = 0; i != reducedHistoriesTree->GetEntries(); ++i) {
+        reducedHistoriesTree->GetEntry(i);
+        contents->m_storedReducedHistories.push_back(index);
+      }
+    }
+    return contents;
+  }
+
+  bool isSnapshotMarker(unsigned int iType) {
+    return iType == kFullSnapshot || iType == kCarryForwardSnapshot;
+  }
+
+  //The DQMStore can delete a MonitorElement at any time (e.g. DQMStore::rmdir) so the
+  // source can only keep pointers to the elements it filled if it is told when
+  // one goes away. Deleting an element deletes its ROOT object which, because of the
+  // kMustCleanup bit, makes ROOT call RecursiveRemove on the objects in its list of
+  // cleanups. Elements without a ROOT object (the scalars) can not be watched.
+  class ElementRemovalWatcher : public TObject {
+    public:
+      ElementRemovalWatcher(): m_generation(0) {
+        gROOT->GetListOfCleanups()->Add(this);
+      }
+      virtual ~ElementRemovalWatcher() {
+        gROOT->GetListOfCleanups()->Remove(this);
+      }
+
+      bool watch(MonitorElement* iElement) {
+        TObject* object = iElement->getRootObject();
+        if(0 == object) {
+          return false;
+        }
+        object->SetBit(kMustCleanup);
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_watched[object] = iElement;
+        return true;
+      }
+      //changes each time a watched element is deleted
+      unsigned int generation() const { return m_generation;}
+
+      //Remembers an element filled by the source so it can be reset at the next
+      // transition. Returns false if the element can not be watched.
+      bool track(MonitorElement* iElement) {
+        ElementSet& elements = iElement->getLumiFlag() ? m_lumiElements : m_runElements;
+        {
+          std::lock_guard<std::mutex> guard(m_mutex);
+          if(elements.find(iElement) != elements.end()) {
+            return true;
+          }
+        }
+        if(not watch(iElement)) {
+          return false;
+        }
+        std::lock_guard<std::mutex> guard(m_mutex);
+        elements.insert(iElement);
+        return true;
+      }
+      //Copies the tracked elements under the lock so they can be used without it. Only the
+      // framework thread deletes MonitorElements so the copies stay valid on that thread.
+      void copyElements(bool iLumiElements, std::vector<MonitorElement*>& oElements) {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        const ElementSet& elements = iLumiElements ? m_lumiElements : m_runElements;
+        oElements.assign(elements.begin(),elements.end());
+      }
+
+      virtual void RecursiveRemove(TObject* iObject) {
+        //ROOT calls this for every object with kMustCleanup deleted on any thread, e.g. the
+        // histograms of the next file dropped by the thread reading it
+        std::lock_guard<std::mutex> guard(m_mutex);
+        WatchedMap::iterator itFound = m_watched.find(iObject);
+        if(itFound != m_watched.end()) {
+          m_lumiElements.erase(itFound->second);
+          m_runElements.erase(itFound->second);
+          m_watched.erase(itFound);
+          ++m_generation;
+        }
+      }
+    private:
+      ElementRemovalWatcher(const ElementRemovalWatcher&); // stop default
+      const ElementRemovalWatcher& operator=(const ElementRemovalWatcher&); // stop default
+
+      typedef std::unordered_map<const TObject*, MonitorElement*> WatchedMap;
+      typedef std::unordered_set<MonitorElement*> ElementSet;
+      std::mutex m_mutex;
+      WatchedMap m_watched;
+      std::atomic<unsigned int> m_generation;
+      ElementSet m_lumiElements;
+      ElementSet m_runElements;
+  };
+
+  //where the readers find the value of a DecodedElement
+  template<class T>
+  T* decodedBuffer(DecodedElement& iDecoded, T*) {
+    return static_cast<T*>(iDecoded.m_hist.get());
+  }
+  std::string* decodedBuffer(DecodedElement& iDecoded, std::string*) {
+    return &iDecoded.m_string;
+  }
+  //the buffer a histogram stored as columns is rebuilt into
+  TH1* asHistogram(TH1* iHist) {
+    return iHist;
+  }
+  TH1* asHistogram(std::string*) {
+    assert(false);
+    return 0;
+  }
+  Long64_t& decodedValue(DecodedElement& iDecoded, Long64_t*) {
+    return iDecoded.m_int;
+  }
+  double& decodedValue(DecodedElement& iDecoded, double*) {
+    return iDecoded.m_float;
+  }
+
   class TreeReaderBase {
     public:
-      TreeReaderBase() {}
+      TreeReaderBase(): m_fullName(0), m_decodedFullName(0), m_nameId(0), m_names(0), m_nameBranch(0), m_watcher(0), m_cacheGeneration(0) {}
       virtual ~TreeReaderBase() {}
 
       MonitorElement* read(ULong64_t iIndex, DQMStore& iStore, bool iIsLumi){
+        m_decodedFullName = 0;
         return doRead(iIndex,iStore,iIsLumi);
       }
-      virtual void setTree(TTree* iTree) =0;
+      //same as read for an entry already read and decoded by a ParallelElementDecoder
+      MonitorElement* readDecoded(DecodedElement& iDecoded, DQMStore& iStore, bool iIsLumi){
+        m_nameId = iDecoded.m_nameId;
+        m_decodedFullName = &iDecoded.m_fullName;
+        MonitorElement* element = doReadDecoded(iDecoded,iStore,iIsLumi);
+        m_decodedFullName = 0;
+        return element;
+      }
+      //iNames is 0 if the file stores the full name with each entry and
+      // iShapes is 0 unless the histograms of the tree are stored as columns
+      void setTree(TTree* iTree, const std::vector<NameEntry>* iNames, const std::vector<HistogramShape>* iShapes) {
+        m_names = iNames;
+        //the name ids are only valid for one file
+        m_elementsByNameId.clear();
+        if(0 != m_names) {
+          m_elementsByNameId.resize(m_names->size(),static_cast<MonitorElement*>(0));
+        }
+        if(0 != m_names) {
+          iTree->SetBranchAddress(kNameIdBranch,&m_nameId);
+          m_nameBranch = iTree->GetBranch(kNameIdBranch);
+        } else {
+          iTree->SetBranchAddress(kFullNameBranch,&m_fullName);
+          m_nameBranch = iTree->GetBranch(kFullNameBranch);
+        }
+        doSetTree(iTree,iShapes);
+      }
+      //only reads the name of the element, not its content
+      const std::string& readName(ULong64_t iIndex) {
+        m_decodedFullName = 0;
+        m_nameBranch->GetEntry(iIndex);
+        return fullName();
+      }
+      //only valid after the entry or its name was read from a file with a name table
+      uint32_t nameId() const { return m_nameId;}
+      //allows elements to be found without asking the DQMStore
+      void setElementRemovalWatcher(ElementRemovalWatcher* iWatcher) {
+        m_watcher = iWatcher;
+        m_cacheGeneration = iWatcher->generation();
+      }
     protected:
-      TTree* m_tree;
+      //returns the element for the entry which was just read
+      MonitorElement* findElement(DQMStore& iStore) {
+        if(0 != m_watcher) {
+          if(m_cacheGeneration != m_watcher->generation()) {
+            //can not tell which element was deleted
+            m_elementsByName.clear();
+            std::fill(m_elementsByNameId.begin(),m_elementsByNameId.end(),static_cast<MonitorElement*>(0));
+            m_cacheGeneration = m_watcher->generation();
+          }
+          if(0 != m_names && m_nameId < m_elementsByNameId.size() && 0 != m_elementsByNameId[m_nameId]) {
+            return m_elementsByNameId[m_nameId];
+          }
+          ElementMap::const_iterator itFound = m_elementsByName.find(fullName());
+          if(itFound != m_elementsByName.end()) {
+            if(0 != m_names && m_nameId < m_elementsByNameId.size()) {
+              m_elementsByNameId[m_nameId] = itFound->second;
+            }
+            return itFound->second;
+          }
+        }
+        MonitorElement* element = iStore.get(fullName());
+        if(0 != element) {
+          cacheElement(element);
+        }
+        return element;
+      }
+      void cacheElement(MonitorElement* iElement) {
+        if(0 == m_watcher || not m_watcher->watch(iElement)) {
+          return;
+        }
+        m_elementsByName[fullName()] = iElement;
+        if(0 != m_names && m_nameId < m_elementsByNameId.size()) {
+          m_elementsByNameId[m_nameId] = iElement;
+        }
+      }
+      //only valid after the entry was read
+      const std::string& fullName() const {
+        if(0 != m_names) {
+          return nameEntry().m_fullName;
+        }
+        return 0 != m_decodedFullName ? *m_decodedFullName : *m_fullName;
+      }
+      //sets the folder where the element for the entry belongs and
+      // returns the name of the element within that folder
+      const char* goToFolder(DQMStore& iStore) const {
+        if(0 != m_names) {
+          const NameEntry& entry = nameEntry();
+          iStore.setCurrentFolder(entry.m_path);
+          return entry.m_name.c_str();
+        }
+        std::string path;
+        const char* name;
+        splitName(fullName(), path,name);
+        iStore.setCurrentFolder(path);
+        return name;
+      }
     private:
+      const NameEntry& nameEntry() const {
+        if(m_nameId >= m_names->size()) {
+          edm::Exception ex(edm::errors::FileReadError);
+          ex<<"The name index "<<m_nameId<<" is larger than the name table (size "<<m_names->size()<<").\n"
+            " The file appears to be corrupted.\n";
+          ex.addContext("Reading DQM Root file");
+          throw ex;
+        }
+        return (*m_names)[m_nameId];
+      }
       virtual MonitorElement* doRead(ULong64_t iIndex, DQMStore& iStore, bool iIsLumi)=0;
+      virtual MonitorElement* doReadDecoded(DecodedElement& iDecoded, DQMStore& iStore, bool iIsLumi)=0;
+      virtual void doSetTree(TTree* iTree, const std::vector<HistogramShape>* iShapes) =0;
+
+      std::string* m_fullName;
+      const std::string* m_decodedFullName;
+      uint32_t m_nameId;
+      const std::vector<NameEntry>* m_names;
+      TBranch* m_nameBranch;
+
+      //elements already filled by this reader. Kept across files when looked up by name.
+      typedef std::unordered_map<std::string, MonitorElement*> ElementMap;
+      ElementMap m_elementsByName;
+      std::vector<MonitorElement*> m_elementsByNameId;
+      ElementRemovalWatcher* m_watcher;
+      unsigned int m_cacheGeneration;
   };
 
   template<class T>
     class TreeObjectReader: public TreeReaderBase {
       public:
-        TreeObjectReader():m_tree(0),m_fullName(0),m_buffer(0),m_tag(0){
+        explicit TreeObjectReader(unsigned int iType):m_tree(0),m_buffer(0),m_tag(0),m_type(iType),m_shapes(0),m_rebuiltShapeId(kNoShapeId),
+          m_sameAs(0),m_resolvedEntry(kNoEntry){
         }
         virtual MonitorElement* doRead(ULong64_t iIndex, DQMStore& iStore, bool iIsLumi) {
           m_tree->GetEntry(iIndex);
-          MonitorElement* element = iStore.get(*m_fullName);
+          if(0 != m_shapes) {
+            if(0 != m_sameAs) {
+              return fillFromColumns(resolvedContent(iIndex),m_tag,iStore,iIsLumi);
+            }
+            return fillFromColumns(m_columns->content(),m_tag,iStore,iIsLumi);
+          }
+          if(0 != m_sameAs) {
+            //the value branch is read again, now for the entry holding the payload
+            readBranchEntry(kValueBranch,referencedEntry(iIndex));
+          }
+          return fill(m_buffer,m_tag,iStore,iIsLumi);
+        }
+        virtual MonitorElement* doReadDecoded(DecodedElement& iDecoded, DQMStore& iStore, bool iIsLumi) {
+          if(0 != iDecoded.m_content.get()) {
+            return fillFromColumns(*iDecoded.m_content,iDecoded.m_tag,iStore,iIsLumi);
+          }
+          return fill(decodedBuffer(iDecoded,static_cast<T*>(0)),iDecoded.m_tag,iStore,iIsLumi);
+        }
+        virtual void doSetTree(TTree* iTree, const std::vector<HistogramShape>* iShapes)  {
+          m_tree = iTree;
+          m_shapes = iShapes;
+          m_tree->SetBranchAddress(kFlagBranch,&m_tag);
+          //only files starting with kDeduplicatedFileFormatVersion have it
+          m_sameAs = 0;
+          if(0 != m_tree->GetBranch(kSameAsBranch)) {
+            m_tree->SetBranchAddress(kSameAsBranch,&m_sameAs);
+          }
+          //the entry numbers are only valid for one file
+          m_resolvedEntry = kNoEntry;
+          if(0 != m_shapes) {
+            if(0 == m_columns.get()) {
+              m_columns.reset(new HistogramColumns(m_type));
+            }
+            m_columns->setBranchAddresses(m_tree);
+            //the shape ids are only valid for one file
+            m_rebuiltShapeId = kNoShapeId;
+          } else {
+            m_tree->SetBranchAddress(kValueBranch,&m_buffer);
+          }
+        }
+      private:
+        MonitorElement* fill(T* iBuffer, uint32_t iTag, DQMStore& iStore, bool iIsLumi) {
+          MonitorElement* element = findElement(iStore);
           if(0 == element) {
-            std::string path;
-            const char* name;
-            splitName(*m_fullName, path,name);
-            iStore.setCurrentFolder(path);
-            element = createElement(iStore,name,m_buffer);
+            const char* name = goToFolder(iStore);
+            element = createElement(iStore,name,iBuffer);
             if(iIsLumi) { element->setLumiFlag();}
+            cacheElement(element);
           } else {
-            mergeWithElement(element,m_buffer);
+            mergeWithElement(element,iBuffer);
           }
-          if(0!= m_tag) {
-            iStore.tag(element,m_tag);
+          if(0!= iTag) {
+            iStore.tag(element,iTag);
           }
           return element;
         }
-        virtual void setTree(TTree* iTree)  {
-          m_tree = iTree;
-          m_tree->SetBranchAddress(kFullNameBranch,&m_fullName);
-          m_tree->SetBranchAddress(kFlagBranch,&m_tag);
-          m_tree->SetBranchAddress(kValueBranch,&m_buffer);
+
+        MonitorElement* fillFromColumns(const HistogramContent& iContent, uint32_t iTag, DQMStore& iStore, bool iIsLumi) {
+          if(iContent.m_shapeId >= m_shapes->size()) {
+            edm::Exception ex(edm::errors::FileReadError);
+            ex<<"The shape index "<<iContent.m_shapeId<<" is larger than the shape table of the "<<kTypeNames[m_type]
+              <<" (size "<<m_shapes->size()<<").\n The file appears to be corrupted.\n";
+            ex.addContext("Reading DQM Root file");
+            throw ex;
+          }
+          const HistogramShape& shape = (*m_shapes)[iContent.m_shapeId];
+          //merging is the common case and does not need the histogram
+          MonitorElement* element = findElement(iStore);
+          if(0 != element && HistogramColumns::add(iContent,*shape.m_hist,*element->getTH1())) {
+            if(0!= iTag) {
+              iStore.tag(element,iTag);
+            }
+            return element;
+          }
+          if(0 == m_rebuilt.get()) {
+            m_rebuilt.reset(new T());
+          }
+          HistogramColumns::rebuild(iContent,shape,*asHistogram(m_rebuilt.get()),iContent.m_shapeId == m_rebuiltShapeId);
+          m_rebuiltShapeId = iContent.m_shapeId;
+          return fill(m_rebuilt.get(),iTag,iStore,iIsLumi);
         }
-      private:
+
+        //the entry holding the payload of the entry iIndex refers to
+        ULong64_t referencedEntry(ULong64_t iIndex) const {
+          const ULong64_t entry = m_sameAs-1;
+          if(entry >= iIndex) {
+            edm::Exception ex(edm::errors::FileReadError);
+            ex<<"The entry "<<iIndex<<" of the "<<kTypeNames[m_type]<<" tree refers to the entry "<<entry
+              <<" which is not an earlier one.\n The file appears to be corrupted.\n";
+            ex.addContext("Reading DQM Root file");
+            throw ex;
+          }
+          return entry;
+        }
+        void readBranchEntry(const char* iBranchName, ULong64_t iEntry) {
+          if(m_tree->GetBranch(iBranchName)->GetEntry(iEntry) < 0) {
+            edm::Exception ex(edm::errors::FileReadError);
+            ex<<"The entry "<<iEntry<<" of the "<<kTypeNames[m_type]<<" tree could not be read.\n";
+            ex.addContext("Reading DQM Root file");
+            throw ex;
+          }
+        }
+        //the last payload read for another entry is kept since the entries referring to
+        // the same payload, e.g. empty histograms, usually come together
+        const HistogramContent& resolvedContent(ULong64_t iIndex) {
+          const ULong64_t entry = referencedEntry(iIndex);
+          const uint32_t shapeId = m_columns->content().m_shapeId;
+          if(entry != m_resolvedEntry) {
+            m_columns->readPayload(m_tree,entry);
+            m_resolved = m_columns->content();
+            m_resolvedEntry = entry;
+          }
+          m_resolved.m_shapeId = shapeId;
+          return m_resolved;
+        }
+
+        static const uint32_t kNoShapeId = 0xFFFFFFFF;
+        static const ULong64_t kNoEntry = 0xFFFFFFFFFFFFFFFFULL;
+
         TTree* m_tree;
-        std::string* m_fullName;
         T* m_buffer;
         uint32_t m_tag;
+        unsigned int m_type;
+        //only used if the histograms are stored as columns
+        const std::vector<HistogramShape>* m_shapes;
+        std::unique_ptr<HistogramColumns> m_columns;
+        std::unique_ptr<T> m_rebuilt;
+        uint32_t m_rebuiltShapeId;
+        //only used for files starting with kDeduplicatedFileFormatVersion
+        ULong64_t m_sameAs;
+        ULong64_t m_resolvedEntry;
+        HistogramContent m_resolved;
     };
 
   template<class T>
     class TreeSimpleReader : public TreeReaderBase {
       public:
-        TreeSimpleReader():m_tree(0),m_fullName(0),m_buffer(),m_tag(0){
+        TreeSimpleReader():m_tree(0),m_buffer(),m_tag(0){
         }
         virtual MonitorElement* doRead(ULong64_t iIndex, DQMStore& iStore,bool iIsLumi) {
           m_tree->GetEntry(iIndex);
-          MonitorElement* element = iStore.get(*m_fullName);
+          return fill(m_buffer,m_tag,iStore,iIsLumi);
+        }
+        virtual MonitorElement* doReadDecoded(DecodedElement& iDecoded, DQMStore& iStore, bool iIsLumi) {
+          return fill(decodedValue(iDecoded,static_cast<T*>(0)),iDecoded.m_tag,iStore,iIsLumi);
+        }
+        virtual void doSetTree(TTree* iTree, const std::vector<HistogramShape>*)  {
+          m_tree = iTree;
+          m_tree->SetBranchAddress(kFlagBranch,&m_tag);
+          m_tree->SetBranchAddress(kValueBranch,&m_buffer);
+        }
+      private:
+        MonitorElement* fill(T& iBuffer, uint32_t iTag, DQMStore& iStore, bool iIsLumi) {
+          MonitorElement* element = findElement(iStore);
           if(0 == element) {
-            std::string path;
-            const char* name;
-            splitName(*m_fullName, path,name);
-            iStore.setCurrentFolder(path);
-            element = createElement(iStore,name,m_buffer);
+            const char* name = goToFolder(iStore);
+            element = createElement(iStore,name,iBuffer);
             if(iIsLumi) { element->setLumiFlag();}
+            cacheElement(element);
           } else {
-            mergeWithElement(element, m_buffer);
+            mergeWithElement(element, iBuffer);
           }
-          if(0!=m_tag) {
-            iStore.tag(element,m_tag);
+          if(0!=iTag) {
+            iStore.tag(element,iTag);
           }
           return element;
         }
-        virtual void setTree(TTree* iTree)  {
-          m_tree = iTree;
-          m_tree->SetBranchAddress(kFullNameBranch,&m_fullName);
-          m_tree->SetBranchAddress(kFlagBranch,&m_tag);
-          m_tree->SetBranchAddress(kValueBranch,&m_buffer);
-        }
-      private:
+
         TTree* m_tree;
-        std::string* m_fullName;
         T m_buffer;
         uint32_t m_tag;
     };
@@ -306,45 +848,6 @@ class DQMRootSource : public edm::InputSource
 
       DQMRootSource(const DQMRootSource&); // stop default
 
-      class RunPHIDKey {
-      public:
-        RunPHIDKey(edm::ProcessHistoryID const& phid, unsigned int run) : 
-          processHistoryID_(phid), run_(run) { }
-        edm::ProcessHistoryID const& processHistoryID() const { return processHistoryID_; }
-        unsigned int run() const { return run_; }
-        bool operator<(RunPHIDKey const& right) const {
-          if (processHistoryID_ == right.processHistoryID()) {
-            return run_ < right.run();
-          }
-          return processHistoryID_ < right.processHistoryID();
-        }
-      private:
-        edm::ProcessHistoryID processHistoryID_;
-        unsigned int run_;
-      };
-
-      class RunLumiPHIDKey {
-      public:
-        RunLumiPHIDKey(edm::ProcessHistoryID const& phid, unsigned int run, unsigned int lumi) : 
-          processHistoryID_(phid), run_(run), lumi_(lumi) { }
-        edm::ProcessHistoryID const& processHistoryID() const { return processHistoryID_; }
-        unsigned int run() const { return run_; }
-        unsigned int lumi() const { return lumi_; }
-        bool operator<(RunLumiPHIDKey const& right) const {
-          if (processHistoryID_ == right.processHistoryID()) {
-            if (run_ == right.run()) {
-              return lumi_ < right.lumi();
-            }
-            return run_ < right.run();
-          }
-          return processHistoryID_ < right.processHistoryID();
-        }
-      private:
-        edm::ProcessHistoryID processHistoryID_;
-        unsigned int run_;
-        unsigned int lumi_;
-      };
-
       virtual edm::InputSource::ItemType getNextItemType();
       //NOTE: the following is really read next run auxiliary
       virtual boost::shared_ptr<edm::RunAuxiliary> readRunAuxiliary_() ;
@@ -360,7 +863,20 @@ class DQMRootSource : public edm::InputSource
       
       void readNextItemType();
       void setupFile(unsigned int iIndex);
+      void discardNextFile();
+      bool useStoredOrder(FileContents& iContents, const std::vector<unsigned int>& iReducedHistoryOrdinals);
+      void selectRunsAndLumis();
       void readElements();
+      void prefetchUpcomingEntries();
+      void addCarriedForwardElements(unsigned int iSnapshotStart);
+      void readDecodedElements(DQMStore& iStore);
+      void trackElement(MonitorElement* iElement);
+      bool isSelected(unsigned int iType, ULong64_t iIndex);
+      bool isSelected(const std::string& iFullName);
+      void resetElements(DQMStore& iStore, bool iLumiElements);
+      void resolveSnapshot(unsigned int iSnapshotStart);
+      unsigned int previousSnapshotStart(unsigned int iSnapshotStart) const;
+      void addSnapshotElements(unsigned int iSnapshotStart);
       
       const DQMRootSource& operator=(const DQMRootSource&); // stop default
 
@@ -372,26 +888,74 @@ class DQMRootSource : public edm::InputSource
 
       size_t m_fileIndex;
       size_t m_presentlyOpenFileIndex;
-      std::list<unsigned int>::iterator m_nextIndexItr;
-      std::list<unsigned int>::iterator m_presentIndexItr;
+      std::vector<unsigned int>::const_iterator m_nextIndexItr;
+      std::vector<unsigned int>::const_iterator m_presentIndexItr;
       std::vector<RunLumiToRange> m_runlumiToRange;
       std::auto_ptr<TFile> m_file;
       std::vector<TTree*> m_trees;
+      ElementRemovalWatcher m_elementRemovalWatcher;
       std::vector<boost::shared_ptr<TreeReaderBase> > m_treeReaders;
       
-      std::list<unsigned int> m_orderedIndices;
+      std::vector<unsigned int> m_orderedIndices;
       edm::ProcessHistoryID m_lastSeenReducedPHID;
       unsigned int m_lastSeenRun;
       edm::ProcessHistoryID m_lastSeenReducedPHID2;
       unsigned int m_lastSeenRun2;
       unsigned int m_lastSeenLumi2;
       unsigned int m_filterOnRun;
+      //the runs and lumis which are not selected are removed from m_orderedIndices
+      RunLumiSelector m_runLumiSelector;
       bool m_justOpenedFileSoNeedToGenerateRunTransition;
       bool m_shouldReadMEs;
-      std::set<MonitorElement*> m_lumiElements;
-      std::set<MonitorElement*> m_runElements;
+      //the scalar elements filled by the source, they can not be watched
+      std::set<std::string> m_lumiScalarNames;
+      std::set<std::string> m_runScalarNames;
       std::vector<edm::ProcessHistoryID> m_historyIDs;
       std::vector<edm::ProcessHistoryID> m_reducedHistoryIDs;
+      std::vector<NameEntry> m_names;
+      bool m_hasNameTable;
+      //the shapes of the histograms of each type, see HistogramColumns
+      std::vector<std::vector<HistogramShape> > m_shapes;
+
+      //which MonitorElements are read
+      ElementSelector m_selector;
+      //the selection for each name id of the present file, only filled if the names matter
+      std::vector<char> m_selectedNameIds;
+      //the selection for files without a name table
+      std::unordered_map<std::string, bool> m_selectedNames;
+
+      //Where to find the content of each lumi element for a lumi written with
+      // kCarryForwardSnapshot. The key is the full name of the element.
+      struct SnapshotElement {
+        unsigned int m_type;
+        ULong64_t m_index;
+        unsigned int m_snapshotStart; //index in m_runlumiToRange of the marker of the write holding it
+      };
+      std::map<std::string, SnapshotElement> m_snapshotElements;
+      unsigned int m_resolvedSnapshotStart;
+
+      //the entries of the type trees needed by the run or lumi being read, in the order they are merged
+      struct ElementRead {
+        unsigned int m_type;
+        ULong64_t m_index;
+        bool m_isLumi;
+      };
+      std::vector<ElementRead> m_elementReads;
+
+      //TTreeCache configuration for the type trees
+      unsigned int m_cacheSize;
+      unsigned int m_prefetchDepth;
+      //position in m_orderedIndices up to which the caches were told what to read
+      size_t m_prefetchedEnd;
+      std::vector<CacheEntryRanges> m_cacheRanges;
+
+      //the next file is read on a separate thread while the present one is processed
+      bool m_prefetchNextFile;
+      size_t m_nextFileIndex;
+      std::future<std::unique_ptr<FileContents> > m_nextFileContents;
+
+      //reads and decodes the elements on separate threads, 0 if done by readElements itself
+      std::unique_ptr<ParallelElementDecoder> m_decoder;
       
       edm::JobReport::Token m_jrToken;
 };
@@ -400,6 +964,8 @@ class DQMRootSource : public edm::InputSource
 // constants, enums and typedefs
 //
 
+static const unsigned int kNoResolvedSnapshot = 0xFFFFFFFF;
+
 //
 // static data member definitions
 //
@@ -411,8 +977,35 @@ DQMRootSource::fillDescriptions(edm::ConfigurationDescriptions& descriptions) {
     ->setComment("Names of files to be processed.");
   desc.addUntracked<unsigned int>("filterOnRun",0)
     ->setComment("Just limit the process to the selected run.");
+  desc.addUntracked<std::vector<std::string> >("includeFolders",std::vector<std::string>())
+    ->setComment("Only read the MonitorElements in these folders (and their sub folders) or matching includePatterns. Everything is read if both are empty.");
+  desc.addUntracked<std::vector<std::string> >("excludeFolders",std::vector<std::string>())
+    ->setComment("Do not read the MonitorElements in these folders (and their sub folders).");
+  desc.addUntracked<std::vector<std::string> >("includePatterns",std::vector<std::string>())
+    ->setComment("Only read the MonitorElements whose full name matches one of these regular expressions or is in includeFolders.");
+  desc.addUntracked<std::vector<std::string> >("excludePatterns",std::vector<std::string>())
+    ->setComment("Do not read the MonitorElements whose full name matches one of these regular expressions.");
+  desc.addUntracked<std::vector<std::string> >("skipTypes",std::vector<std::string>())
+    ->setComment("Do not read the MonitorElements of these types, given by the name of their tree (e.g. 'TH3Fs'). Their trees are not even opened.");
+  desc.addUntracked<unsigned int>("firstRun",0)
+    ->setComment("Skip the runs before this one. 0 means no limit.");
+  desc.addUntracked<unsigned int>("lastRun",0)
+    ->setComment("Skip the runs after this one. 0 means no limit.");
+  desc.addUntracked<std::vector<edm::LuminosityBlockRange> >("lumisToProcess",std::vector<edm::LuminosityBlockRange>())
+    ->setComment("Only process these lumis, and the runs they belong to. Everything else, including whole files, is skipped without being read.");
   desc.addUntracked<std::string>("overrideCatalog",std::string())
     ->setComment("An alternate file catalog to use instead of the standard site one.");
+  desc.addUntracked<unsigned int>("cacheSize",10*1024*1024)
+    ->setComment("Size in bytes of the TTreeCache used for each type of MonitorElement. 0 turns off the cache.");
+  desc.addUntracked<unsigned int>("prefetchDepth",2)
+    ->setComment("Number of runs/lumis, starting with the one being read, whose MonitorElements are put in the cache together.");
+  desc.addUntracked<bool>("prefetchNextFile",false)
+    ->setComment("Open the next file and read its meta data and indices on a separate thread while the present file is processed.");
+  desc.addUntracked<unsigned int>("decodeThreads",0)
+    ->setComment("Number of threads reading and decoding the MonitorElements of a run or lumi, one type of MonitorElement per thread,"
+                 " while they are put in the DQMStore. Each thread opens the file itself. 0 does everything on the framework thread.");
+  desc.addUntracked<unsigned int>("decodeQueueSize",64)
+    ->setComment("Maximum number of decoded MonitorElements of one type waiting to be put in the DQMStore when decodeThreads is used.");
   descriptions.addDefault(desc);
 }
 //
@@ -433,24 +1026,52 @@ DQMRootSource::DQMRootSource(edm::ParameterSet const& iPSet, const edm::InputSou
   m_lastSeenRun2(0),
   m_lastSeenLumi2(0),
   m_filterOnRun(iPSet.getUntrackedParameter<unsigned int>("filterOnRun", 0)),
+  m_runLumiSelector(iPSet.getUntrackedParameter<unsigned int>("firstRun",0),
+                    iPSet.getUntrackedParameter<unsigned int>("lastRun",0),
+                    iPSet.getUntrackedParameter<std::vector<edm::LuminosityBlockRange> >("lumisToProcess",std::vector<edm::LuminosityBlockRange>())),
   m_justOpenedFileSoNeedToGenerateRunTransition(false),
-  m_shouldReadMEs(true)
+  m_shouldReadMEs(true),
+  m_hasNameTable(false),
+  m_selector(iPSet.getUntrackedParameter<std::vector<std::string> >("includeFolders",std::vector<std::string>()),
+             iPSet.getUntrackedParameter<std::vector<std::string> >("excludeFolders",std::vector<std::string>()),
+             iPSet.getUntrackedParameter<std::vector<std::string> >("includePatterns",std::vector<std::string>()),
+             iPSet.getUntrackedParameter<std::vector<std::string> >("excludePatterns",std::vector<std::string>()),
+             iPSet.getUntrackedParameter<std::vector<std::string> >("skipTypes",std::vector<std::string>())),
+  m_resolvedSnapshotStart(kNoResolvedSnapshot),
+  m_cacheSize(iPSet.getUntrackedParameter<unsigned int>("cacheSize",10*1024*1024)),
+  m_prefetchDepth(std::max(1U,iPSet.getUntrackedParameter<unsigned int>("prefetchDepth",2))),
+  m_prefetchedEnd(0),
+  m_cacheRanges(kNIndicies),
+  m_prefetchNextFile(iPSet.getUntrackedParameter<bool>("prefetchNextFile",false)),
+  m_nextFileIndex(0)
 {
+  const unsigned int decodeThreads = iPSet.getUntrackedParameter<unsigned int>("decodeThreads",0);
+  if(m_prefetchNextFile || 0 != decodeThreads) {
+    //needed for ROOT to be used from more than one thread
+    TThread::Initialize();
+  }
+  if(0 != decodeThreads) {
+    m_decoder.reset(new ParallelElementDecoder(decodeThreads,m_cacheSize,
+                                               iPSet.getUntrackedParameter<unsigned int>("decodeQueueSize",64)));
+  }
   if(m_fileIndex ==m_catalog.fileNames().size()) {
     m_nextItemType=edm::InputSource::IsStop;
   } else{
     m_treeReaders[kIntIndex].reset(new TreeSimpleReader<Long64_t>());
     m_treeReaders[kFloatIndex].reset(new TreeSimpleReader<double>());
-    m_treeReaders[kStringIndex].reset(new TreeObjectReader<std::string>());
-    m_treeReaders[kTH1FIndex].reset(new TreeObjectReader<TH1F>());
-    m_treeReaders[kTH1SIndex].reset(new TreeObjectReader<TH1S>());
-    m_treeReaders[kTH1DIndex].reset(new TreeObjectReader<TH1D>());
-    m_treeReaders[kTH2FIndex].reset(new TreeObjectReader<TH2F>());
-    m_treeReaders[kTH2SIndex].reset(new TreeObjectReader<TH2S>());
-    m_treeReaders[kTH2DIndex].reset(new TreeObjectReader<TH2D>());
-    m_treeReaders[kTH3FIndex].reset(new TreeObjectReader<TH3F>());
-    m_treeReaders[kTProfileIndex].reset(new TreeObjectReader<TProfile>());
-    m_treeReaders[kTProfile2DIndex].reset(new TreeObjectReader<TProfile2D>());
+    m_treeReaders[kStringIndex].reset(new TreeObjectReader<std::string>(kStringIndex));
+    m_treeReaders[kTH1FIndex].reset(new TreeObjectReader<TH1F>(kTH1FIndex));
+    m_treeReaders[kTH1SIndex].reset(new TreeObjectReader<TH1S>(kTH1SIndex));
+    m_treeReaders[kTH1DIndex].reset(new TreeObjectReader<TH1D>(kTH1DIndex));
+    m_treeReaders[kTH2FIndex].reset(new TreeObjectReader<TH2F>(kTH2FIndex));
+    m_treeReaders[kTH2SIndex].reset(new TreeObjectReader<TH2S>(kTH2SIndex));
+    m_treeReaders[kTH2DIndex].reset(new TreeObjectReader<TH2D>(kTH2DIndex));
+    m_treeReaders[kTH3FIndex].reset(new TreeObjectReader<TH3F>(kTH3FIndex));
+    m_treeReaders[kTProfileIndex].reset(new TreeObjectReader<TProfile>(kTProfileIndex));
+    m_treeReaders[kTProfile2DIndex].reset(new TreeObjectReader<TProfile2D>(kTProfile2DIndex));
+    for(size_t index = 0; index < kNIndicies; ++index) {
+      m_treeReaders[index]->setElementRemovalWatcher(&m_elementRemovalWatcher);
+    }
   }
 
 }
@@ -462,7 +1083,9 @@ DQMRootSource::DQMRootSource(edm::ParameterSet const& iPSet, const edm::InputSou
 
 DQMRootSource::~DQMRootSource()
 {
+  discardNextFile();
   if(m_file.get() != 0 && m_file->IsOpen()) {
+    std::lock_guard<std::mutex> guard(rootFileMutex());
     m_file->Close();
     logFileAction("  Closed file ", m_catalog.fileNames()[m_presentlyOpenFileIndex].c_str());
   }
@@ -541,27 +1164,22 @@ DQMRootSource::readRun_(boost::shared_ptr<edm::RunPrincipal> rpCache)
   //   std::cout <<"m_shouldReadMEs " << m_shouldReadMEs <<std::endl;
 
   /** If the collate option is not set for the DQMStore, we should
-      indeed be sure to reset all histograms after a run transition,
-      but we should definitely avoid doing it using a local, private
-      copy of the actual content of the DQMStore.
+      indeed be sure to reset all histograms after a run transition.
       Clients are completely free to delete/add
-      MonitorElements from the DQMStore and the local copy stored in
-      the std::set will never notice it until it will try to reset a
-      deleted object.  That's why the resetting directly queries the
-      DQMStore for its current content.  */
+      MonitorElements from the DQMStore so the elements filled by
+      this source are tracked by m_elementRemovalWatcher which
+      forgets an element as soon as it is deleted. Scalars can not
+      be watched and are looked up by name.  */
   
   //NOTE: need to reset all run elements at this point
   if( m_lastSeenRun != runID ||
       m_lastSeenReducedPHID != m_reducedHistoryIDs.at(runLumiRange.m_historyIDIndex) ) {
     if (m_shouldReadMEs) {
       edm::Service<DQMStore> store;
-      std::vector<MonitorElement*> allMEs = (*store).getAllContents("");
-      for(auto const& ME : allMEs) {
+      if ( !(*store).isCollate() ) {
         // We do not want to reset here Lumi products, since a dedicated
         // resetting is done at every lumi transition.
-        if (ME->getLumiFlag()) continue;
-	if ( !(*store).isCollate() )
-	  ME->Reset();
+        resetElements(*store,false);
       }
     }
     m_lastSeenReducedPHID = m_reducedHistoryIDs.at(runLumiRange.m_historyIDIndex);
@@ -597,13 +1215,8 @@ DQMRootSource::readLuminosityBlock_( boost::shared_ptr<edm::LuminosityBlockPrinc
       && m_shouldReadMEs) {
 
     edm::Service<DQMStore> store;
-    std::vector<MonitorElement*> allMEs = (*store).getAllContents("");
-    for(auto const& ME : allMEs) {
-      // We do not want to reset Run Products here!
-      if (ME->getLumiFlag()) {
-        ME->Reset();
-      }
-    }
+    // We do not want to reset Run Products here!
+    resetElements(*store,true);
     m_lastSeenReducedPHID2 = m_reducedHistoryIDs.at(runLumiRange.m_historyIDIndex);
     m_lastSeenRun2 = runLumiRange.m_run;
     m_lastSeenLumi2 = runLumiRange.m_lumi;
@@ -625,7 +1238,16 @@ DQMRootSource::readFile_() {
   //std::cout <<"readFile_"<<std::endl;
   setupFile(m_fileIndex);
   ++m_fileIndex;
-  readNextItemType();
+  //files without any selected run or lumi are not processed
+  while(m_orderedIndices.empty() && m_fileIndex != m_catalog.fileNames().size()) {
+    setupFile(m_fileIndex);
+    ++m_fileIndex;
+  }
+  if(m_orderedIndices.empty()) {
+    m_nextItemType = edm::InputSource::IsStop;
+  } else {
+    readNextItemType();
+  }
 
   edm::Service<edm::JobReport> jr;
   m_jrToken = jr->inputFileOpened(m_catalog.fileNames()[m_fileIndex-1],
@@ -649,31 +1271,32 @@ DQMRootSource::closeFile_() {
 
 void DQMRootSource::readElements() {
   edm::Service<DQMStore> store;
+  if(m_shouldReadMEs && 0 == m_decoder.get()) {
+    prefetchUpcomingEntries();
+  }
+  m_elementReads.clear();
   RunLumiToRange runLumiRange = m_runlumiToRange[*m_presentIndexItr];
   bool shouldContinue = false;
   do
   {
     shouldContinue = false;
+    const unsigned int entry = *m_presentIndexItr;
     ++m_presentIndexItr;
-    if(runLumiRange.m_type == kNoTypesStored) {continue;}
-    boost::shared_ptr<TreeReaderBase> reader = m_treeReaders[runLumiRange.m_type];
+    if(runLumiRange.m_type == kCarryForwardSnapshot && m_shouldReadMEs) {
+      addCarriedForwardElements(entry);
+    }
+    //markers and kNoTypesStored have no elements
+    const bool hasElements = runLumiRange.m_type < kNIndicies;
     ULong64_t index = runLumiRange.m_firstIndex;
-    ULong64_t endIndex = runLumiRange.m_lastIndex+1;
+    ULong64_t endIndex = hasElements ? runLumiRange.m_lastIndex+1 : index;
     for (; index != endIndex; ++index)
     {
       bool isLumi = runLumiRange.m_lumi !=0;
-      if (m_shouldReadMEs)
-        reader->read(index,*store,isLumi);
-//       if (isLumi)
-//       {
-//         std::cout << runLumiRange.m_run << " " << runLumiRange.m_lumi << "  lumi element "<< element->getFullname()<<" "<<index<< " " << runLumiRange.m_type << std::endl;
-//         m_lumiElements.insert(element);
-//       }
-//       else
-//       {
-//         std::cout << runLumiRange.m_run << " " << runLumiRange.m_lumi << "  run element "<< element->getFullname()<<" "<<index<< " " << runLumiRange.m_type << std::endl;
-//         m_runElements.insert(element);
-//       }
+      //elements which are not selected are never decoded
+      if (m_shouldReadMEs && isSelected(runLumiRange.m_type,index)) {
+        const ElementRead read = {runLumiRange.m_type,index,isLumi};
+        m_elementReads.push_back(read);
+      }
     }
     if (m_presentIndexItr != m_orderedIndices.end())
     {
@@ -689,6 +1312,243 @@ void DQMRootSource::readElements() {
       }
     }
   } while(shouldContinue);
+
+  if(0 != m_decoder.get()) {
+    readDecodedElements(*store);
+    return;
+  }
+  for(std::vector<ElementRead>::const_iterator it = m_elementReads.begin(), itEnd = m_elementReads.end();
+      it != itEnd;
+      ++it) {
+    if(0 != m_cacheSize) {
+      m_cacheRanges[it->m_type].select(m_trees[it->m_type],it->m_index);
+    }
+    //reading an entry creates its histogram
+    std::lock_guard<std::mutex> guard(rootFileMutex());
+    trackElement(m_treeReaders[it->m_type]->read(it->m_index,*store,it->m_isLumi));
+  }
+}
+
+//The worker threads read and decode the entries of each type tree while the
+// elements already decoded are put in the DQMStore, in the same order as readElements
+void DQMRootSource::readDecodedElements(DQMStore& iStore) {
+  if(m_elementReads.empty()) {
+    return;
+  }
+  std::vector<std::vector<ULong64_t> > entries(kNIndicies);
+  std::vector<unsigned int> typeOrder;
+  for(std::vector<ElementRead>::const_iterator it = m_elementReads.begin(), itEnd = m_elementReads.end();
+      it != itEnd;
+      ++it) {
+    if(entries[it->m_type].empty()) {
+      typeOrder.push_back(it->m_type);
+    }
+    entries[it->m_type].push_back(it->m_index);
+  }
+  m_decoder->start(entries,typeOrder);
+  try {
+    for(std::vector<ElementRead>::const_iterator it = m_elementReads.begin(), itEnd = m_elementReads.end();
+        it != itEnd;
+        ++it) {
+      std::unique_ptr<DecodedElement> decoded = m_decoder->next(it->m_type);
+      //booking creates histograms, the lock must not be held while waiting for the workers
+      std::lock_guard<std::mutex> guard(rootFileMutex());
+      trackElement(m_treeReaders[it->m_type]->readDecoded(*decoded,iStore,it->m_isLumi));
+    }
+  } catch(...) {
+    m_decoder->cancel();
+    throw;
+  }
+}
+
+//Collects which entries of each type tree the next m_prefetchDepth runs/lumis need so
+// the cache reads each contiguous range of them with a few large requests
+void DQMRootSource::prefetchUpcomingEntries() {
+  if(0 == m_cacheSize) {
+    return;
+  }
+  const size_t position = m_presentIndexItr - m_orderedIndices.begin();
+  if(position < m_prefetchedEnd) {
+    return;
+  }
+  for(unsigned int type = 0; type != kNIndicies; ++type) {
+    m_cacheRanges[type].clear();
+  }
+  size_t index = position;
+  for(unsigned int nGroups = 0; nGroups != m_prefetchDepth and index != m_orderedIndices.size(); ++nGroups) {
+    const RunLumiToRange& groupStart = m_runlumiToRange[m_orderedIndices[index]];
+    do {
+      const RunLumiToRange& range = m_runlumiToRange[m_orderedIndices[index]];
+      if(range.m_type < kNIndicies && not m_selector.skipsType(range.m_type)) {
+        m_cacheRanges[range.m_type].add(range.m_firstIndex,range.m_lastIndex+1);
+      }
+      ++index;
+    } while(index != m_orderedIndices.size() &&
+            m_runlumiToRange[m_orderedIndices[index]].m_run == groupStart.m_run &&
+            m_runlumiToRange[m_orderedIndices[index]].m_lumi == groupStart.m_lumi &&
+            m_reducedHistoryIDs.at(m_runlumiToRange[m_orderedIndices[index]].m_historyIDIndex) == m_reducedHistoryIDs.at(groupStart.m_historyIDIndex));
+  }
+  m_prefetchedEnd = index;
+  for(unsigned int type = 0; type != kNIndicies; ++type) {
+    m_cacheRanges[type].prepare();
+  }
+}
+
+//Adds the elements which were not stored for the lumi since they did not change
+// since the lumi written before it to m_elementReads
+void DQMRootSource::addCarriedForwardElements(unsigned int iSnapshotStart) {
+  resolveSnapshot(iSnapshotStart);
+
+  std::vector<std::pair<unsigned int, ULong64_t> > toRead;
+  for(std::map<std::string, SnapshotElement>::const_iterator it = m_snapshotElements.begin(), itEnd = m_snapshotElements.end();
+      it != itEnd;
+      ++it) {
+    //the ones stored with this lumi are read the usual way
+    if(it->second.m_snapshotStart != iSnapshotStart && isSelected(it->first)) {
+      toRead.push_back(std::make_pair(it->second.m_type,it->second.m_index));
+    }
+  }
+  //read in the order they are in the file
+  std::sort(toRead.begin(),toRead.end());
+  for(std::vector<std::pair<unsigned int, ULong64_t> >::const_iterator it = toRead.begin(), itEnd = toRead.end();
+      it != itEnd;
+      ++it) {
+    const ElementRead read = {it->first,it->second,true};
+    m_elementReads.push_back(read);
+  }
+}
+
+bool DQMRootSource::isSelected(unsigned int iType, ULong64_t iIndex) {
+  if(m_selector.skipsType(iType)) {
+    return false;
+  }
+  if(not m_selector.hasNameRules()) {
+    return true;
+  }
+  //only the name is read
+  TreeReaderBase& reader = *m_treeReaders[iType];
+  const std::string& fullName = reader.readName(iIndex);
+  if(m_hasNameTable) {
+    return m_selectedNameIds[reader.nameId()];
+  }
+  return isSelected(fullName);
+}
+
+bool DQMRootSource::isSelected(const std::string& iFullName) {
+  if(not m_selector.hasNameRules()) {
+    return true;
+  }
+  std::unordered_map<std::string, bool>::const_iterator itFound = m_selectedNames.find(iFullName);
+  if(itFound != m_selectedNames.end()) {
+    return itFound->second;
+  }
+  const bool selected = m_selector.selects(iFullName);
+  m_selectedNames.insert(std::make_pair(iFullName,selected));
+  return selected;
+}
+
+void DQMRootSource::trackElement(MonitorElement* iElement) {
+  if(not m_elementRemovalWatcher.track(iElement)) {
+    (iElement->getLumiFlag() ? m_lumiScalarNames : m_runScalarNames).insert(iElement->getFullname());
+  }
+}
+
+//Only the elements filled by this source need to be reset
+void DQMRootSource::resetElements(DQMStore& iStore, bool iLumiElements) {
+  //Reset is called without the watcher's lock since it can delete ROOT objects, which calls RecursiveRemove
+  std::vector<MonitorElement*> elements;
+  m_elementRemovalWatcher.copyElements(iLumiElements,elements);
+  for(std::vector<MonitorElement*>::const_iterator it = elements.begin(), itEnd = elements.end();
+      it != itEnd;
+      ++it) {
+    (*it)->Reset();
+  }
+  const std::set<std::string>& names = iLumiElements ? m_lumiScalarNames : m_runScalarNames;
+  for(std::set<std::string>::const_iterator it = names.begin(), itEnd = names.end();
+      it != itEnd;
+      ++it) {
+    MonitorElement* element = iStore.get(*it);
+    if(0 != element && element->getLumiFlag() == iLumiElements) {
+      element->Reset();
+    }
+  }
+}
+
+//Finds where the content of each element of the lumi starting at iSnapshotStart is stored.
+// The result of the previous call is reused so reading lumis in order only looks at
+// the names of each write once.
+void DQMRootSource::resolveSnapshot(unsigned int iSnapshotStart) {
+  if(iSnapshotStart == m_resolvedSnapshotStart) {
+    return;
+  }
+  //walk back to either a complete snapshot or the one already resolved
+  std::vector<unsigned int> writes;
+  unsigned int start = iSnapshotStart;
+  bool startFromResolved = false;
+  while(true) {
+    if(start == m_resolvedSnapshotStart) {
+      startFromResolved = true;
+      break;
+    }
+    writes.push_back(start);
+    if(m_runlumiToRange[start].m_type != kCarryForwardSnapshot) {
+      break;
+    }
+    start = previousSnapshotStart(start);
+  }
+  if(not startFromResolved) {
+    m_snapshotElements.clear();
+  }
+  m_resolvedSnapshotStart = kNoResolvedSnapshot;
+  for(std::vector<unsigned int>::reverse_iterator it = writes.rbegin(), itEnd = writes.rend();
+      it != itEnd;
+      ++it) {
+    addSnapshotElements(*it);
+  }
+  m_resolvedSnapshotStart = iSnapshotStart;
+}
+
+unsigned int DQMRootSource::previousSnapshotStart(unsigned int iSnapshotStart) const {
+  unsigned int index = iSnapshotStart;
+  while(index != 0) {
+    --index;
+    if(isSnapshotMarker(m_runlumiToRange[index].m_type)) {
+      const RunLumiToRange& previous = m_runlumiToRange[index];
+      const RunLumiToRange& present = m_runlumiToRange[iSnapshotStart];
+      if(previous.m_run == present.m_run && previous.m_historyIDIndex == present.m_historyIDIndex) {
+        return index;
+      }
+      break;
+    }
+  }
+  edm::Exception ex(edm::errors::FileReadError);
+  ex<<"The lumi "<<m_runlumiToRange[iSnapshotStart].m_lumi<<" of run "<<m_runlumiToRange[iSnapshotStart].m_run
+    <<" only stores elements which changed but the lumi it is based on can not be found.\n"
+      " The file appears to be corrupted.\n";
+  ex.addContext("Reading DQM Root file");
+  throw ex;
+}
+
+void DQMRootSource::addSnapshotElements(unsigned int iSnapshotStart) {
+  const RunLumiToRange& marker = m_runlumiToRange[iSnapshotStart];
+  for(unsigned int index = iSnapshotStart+1; index < m_runlumiToRange.size(); ++index) {
+    const RunLumiToRange& range = m_runlumiToRange[index];
+    if(range.m_type >= kNIndicies ||
+       range.m_run != marker.m_run || range.m_lumi != marker.m_lumi ||
+       range.m_historyIDIndex != marker.m_historyIDIndex) {
+      break;
+    }
+    //never read so not needed
+    if(m_selector.skipsType(range.m_type)) {
+      continue;
+    }
+    for(ULong64_t entry = range.m_firstIndex; entry != range.m_lastIndex+1; ++entry) {
+      SnapshotElement& element = m_snapshotElements[m_treeReaders[range.m_type]->readName(entry)];
+      element.m_type = range.m_type;
+      element.m_index = entry;
+      element.m_snapshotStart = iSnapshotStart;
+    }
+  }
 }
 
 void DQMRootSource::readNextItemType()
@@ -752,78 +1612,47 @@ void
 DQMRootSource::setupFile(unsigned int iIndex)
 {
   if(m_file.get() != 0 && iIndex > 0) {
+    std::lock_guard<std::mutex> guard(rootFileMutex());
     m_file->Close();
     logFileAction("  Closed file ", m_catalog.fileNames()[iIndex-1].c_str());
   }
   logFileAction("  Initiating request to open file ", m_catalog.fileNames()[iIndex].c_str());
   m_presentlyOpenFileIndex = iIndex;
-  try {
-    m_file = std::auto_ptr<TFile>(TFile::Open(m_catalog.fileNames()[iIndex].c_str()));
-  } catch(cms::Exception const& e) {
-    edm::Exception ex(edm::errors::FileOpenError,"",e);
-    ex.addContext("Opening DQM Root file");
-    ex <<"\nInput file " << m_catalog.fileNames()[iIndex] << " was not found, could not be opened, or is corrupted.\n";
-    throw ex;
-  }
-  if(not m_file->IsZombie()) {  
-    logFileAction("  Successfully opened file ", m_catalog.fileNames()[iIndex].c_str());
+  std::unique_ptr<FileContents> contents;
+  if(m_nextFileContents.valid() && m_nextFileIndex == iIndex) {
+    //rethrows any problem found while reading the file
+    contents = m_nextFileContents.get();
   } else {
-    edm::Exception ex(edm::errors::FileOpenError);
-    ex<<"Input file "<<m_catalog.fileNames()[iIndex].c_str() <<" could not be opened.\n";
-    ex.addContext("Opening DQM Root file");
-    throw ex;
+    discardNextFile();
+    contents = readFileContents(m_catalog.fileNames()[iIndex]);
   }
-  //Check file format version, which is encoded in the Title of the TFile
-  if(0 != strcmp(m_file->GetTitle(),"1")) {
-    edm::Exception ex(edm::errors::FileReadError);
-    ex<<"Input file "<<m_catalog.fileNames()[iIndex].c_str() <<" does not appear to be a DQM Root file.\n";
+  m_file = std::auto_ptr<TFile>(contents->m_file.release());
+  logFileAction("  Successfully opened file ", m_catalog.fileNames()[iIndex].c_str());
+  if(contents->m_endsAtCheckpoint) {
+    edm::LogWarning("DQMRootSource")<<"The file "<<m_catalog.fileNames()[iIndex]<<" was not closed properly."
+                                      " Only what was saved by its last checkpoint will be read.";
   }
-  
-  //Get meta Data
-  TDirectory* metaDir = m_file->GetDirectory(kMetaDataDirectoryAbsolute);
-  if(0==metaDir) {
-    edm::Exception ex(edm::errors::FileReadError);
-    ex<<"Input file "<<m_catalog.fileNames()[iIndex].c_str() <<" appears to be corrupted since it does not have the proper internal structure.\n"
-      " Check to see if the file was closed properly.\n";    
-    ex.addContext("Opening DQM Root file");
-    throw ex;    
-  }
-  TTree* parameterSetTree = dynamic_cast<TTree*>(metaDir->Get(kParameterSetTree));
-  assert(0!=parameterSetTree);
 
   edm::pset::Registry* psr = edm::pset::Registry::instance();
   assert(0!=psr);
-  {
-    std::string blob;
-    std::string* pBlob = &blob;
-    parameterSetTree->SetBranchAddress(kParameterSetBranch,&pBlob);
-    for(unsigned int index = 0; index != parameterSetTree->GetEntries();++index)
-    {
-      parameterSetTree->GetEntry(index);
+  const bool hasParameterSetIDs = not contents->m_parameterSetIDs.empty();
+  for(unsigned int index = 0; index != contents->m_parameterSetBlobs.size(); ++index) {
+    const std::string& blob = contents->m_parameterSetBlobs[index];
+    edm::ParameterSetID psID;
+    if(hasParameterSetIDs) {
+      psID = edm::ParameterSetID(contents->m_parameterSetIDs[index]);
+    } else {
       cms::Digest dg(blob);
-      edm::ParameterSetID psID(dg.digest().toString());
-      edm::ParameterSet temp(blob,psID);
-    } 
+      psID = edm::ParameterSetID(dg.digest().toString());
+    }
+    //files being merged usually share most of their configuration
+    if(0 != psr->getMapped(psID)) {
+      continue;
+    }
+    edm::ParameterSet temp(blob,psID);
   }
 
   {
-    TTree* processHistoryTree = dynamic_cast<TTree*>(metaDir->Get(kProcessHistoryTree));
-    assert(0!=processHistoryTree);
-    unsigned int phIndex = 0;
-    processHistoryTree->SetBranchAddress(kPHIndexBranch,&phIndex);
-    std::string processName;
-    std::string* pProcessName = &processName;
-    processHistoryTree->SetBranchAddress(kProcessConfigurationProcessNameBranch,&pProcessName);
-    std::string parameterSetIDBlob;
-    std::string* pParameterSetIDBlob = &parameterSetIDBlob;
-    processHistoryTree->SetBranchAddress(kProcessConfigurationParameterSetIDBranch,&pParameterSetIDBlob);
-    std::string releaseVersion;
-    std::string* pReleaseVersion = &releaseVersion;
-    processHistoryTree->SetBranchAddress(kProcessConfigurationReleaseVersion,&pReleaseVersion);
-    std::string passID;
-    std::string* pPassID = &passID;
-    processHistoryTree->SetBranchAddress(kProcessConfigurationPassID,&pPassID);
-
     edm::ProcessConfigurationRegistry* pcr = edm::ProcessConfigurationRegistry::instance();
     assert(0!=pcr);
     edm::ProcessHistoryRegistry* phr = edm::ProcessHistoryRegistry::instance();
@@ -832,9 +1661,11 @@ DQMRootSource::setupFile(unsigned int iIndex)
     configs.reserve(5);
     m_historyIDs.clear();
     m_reducedHistoryIDs.clear();
-    for(unsigned int i=0; i != processHistoryTree->GetEntries(); ++i) {
-      processHistoryTree->GetEntry(i);
-      if(phIndex==0) {
+    for(std::vector<ProcessConfigurationEntry>::const_iterator it = contents->m_processConfigurations.begin(),
+        itEnd = contents->m_processConfigurations.end();
+        it != itEnd;
+        ++it) {
+      if(it->m_index==0) {
         if(not configs.empty()) {
           edm::ProcessHistory ph(configs);
           m_historyIDs.push_back(ph.id());
@@ -843,8 +1674,8 @@ DQMRootSource::setupFile(unsigned int iIndex)
         }
         configs.clear();
       }
-      edm::ParameterSetID psetID(parameterSetIDBlob);
-      edm::ProcessConfiguration pc(processName, psetID,releaseVersion,passID);
+      edm::ParameterSetID psetID(it->m_parameterSetID);
+      edm::ProcessConfiguration pc(it->m_processName, psetID,it->m_releaseVersion,it->m_passID);
       pcr->insertMapped(pc);
       configs.push_back(pc);
     }
@@ -857,128 +1688,166 @@ DQMRootSource::setupFile(unsigned int iIndex)
     }
   }
 
-  //Setup the indices
-  TTree* indicesTree = dynamic_cast<TTree*>(m_file->Get(kIndicesTree));
-  assert(0!=indicesTree);
+  m_names.swap(contents->m_names);
+  m_shapes.swap(contents->m_shapes);
+  const bool hasNameTable = contents->m_fileFormatVersion >= kNameTableFileFormatVersion;
+  const bool storesColumns = contents->m_fileFormatVersion >= kColumnarFileFormatVersion;
+  m_hasNameTable = hasNameTable;
+  m_selectedNameIds.clear();
+  if(hasNameTable && m_selector.hasNameRules()) {
+    //each name is only looked at once
+    m_selectedNameIds.reserve(m_names.size());
+    for(std::vector<NameEntry>::const_iterator it = m_names.begin(), itEnd = m_names.end();
+        it != itEnd;
+        ++it) {
+      m_selectedNameIds.push_back(m_selector.selects(it->m_fullName));
+    }
+  }
+  if(0 != m_decoder.get()) {
+    m_decoder->setFile(m_catalog.fileNames()[iIndex],hasNameTable,storesColumns);
+  }
 
-  m_runlumiToRange.clear();
-  m_runlumiToRange.reserve(indicesTree->GetEntries());
+  m_runlumiToRange.swap(contents->m_runlumiToRange);
+  m_snapshotElements.clear();
+  m_resolvedSnapshotStart = kNoResolvedSnapshot;
+  m_prefetchedEnd = 0;
+  for(unsigned int type = 0; type != kNIndicies; ++type) {
+    m_cacheRanges[type].clear();
+  }
   m_orderedIndices.clear();
 
-  RunLumiToRange temp;
-  indicesTree->SetBranchAddress(kRunBranch,&temp.m_run);
-  indicesTree->SetBranchAddress(kLumiBranch,&temp.m_lumi);
-  indicesTree->SetBranchAddress(kBeginTimeBranch,&temp.m_beginTime);
-  indicesTree->SetBranchAddress(kEndTimeBranch,&temp.m_endTime);
-  indicesTree->SetBranchAddress(kProcessHistoryIndexBranch,&temp.m_historyIDIndex);
-  indicesTree->SetBranchAddress(kTypeBranch,&temp.m_type);
-  indicesTree->SetBranchAddress(kFirstIndex,&temp.m_firstIndex);
-  indicesTree->SetBranchAddress(kLastIndex,&temp.m_lastIndex);
+  //small integers are much faster to compare than the ProcessHistoryIDs
+  std::vector<unsigned int> reducedHistoryOrdinals;
+  reducedHistoryOrdinals.reserve(m_reducedHistoryIDs.size());
+  for(std::vector<edm::ProcessHistoryID>::const_iterator it = m_reducedHistoryIDs.begin(), itEnd = m_reducedHistoryIDs.end();
+      it != itEnd;
+      ++it) {
+    std::vector<edm::ProcessHistoryID>::const_iterator itFirst = m_reducedHistoryIDs.begin();
+    reducedHistoryOrdinals.push_back(std::find(itFirst,it+1,*it) - itFirst);
+  }
 
   //Need to reorder items since if there was a merge done the same Run
   //and/or Lumi can appear multiple times but we want to process them
-  //all at once
-
-  //We use a std::list for m_orderedIndices since inserting into the
-  //middle of a std::list does not disrupt the iterators to already
-  //existing entries
-
-  //The Map is used to see if a Run/Lumi pair has appeared before
-  typedef std::map<RunLumiPHIDKey, std::list<unsigned int>::iterator > RunLumiToLastEntryMap;
-  RunLumiToLastEntryMap runLumiToLastEntryMap;
-
-  //Need to group all lumis for the same run together and move the run
-  //entry to the beginning
-  typedef std::map<RunPHIDKey, std::pair< std::list<unsigned int>::iterator, std::list<unsigned int>::iterator> > RunToFirstLastEntryMap;
-  RunToFirstLastEntryMap runToFirstLastEntryMap;
-
-  for (Long64_t index = 0; index != indicesTree->GetEntries(); ++index)
-  {
-    indicesTree->GetEntry(index);
-//     std::cout <<"read r:"<<temp.m_run
-//            <<" l:"<<temp.m_lumi
-//            <<" b:"<<temp.m_beginTime
-//            <<" e:"<<temp.m_endTime
-//            <<" fi:" << temp.m_firstIndex
-//            <<" li:" << temp.m_lastIndex
-//            <<" type:" << temp.m_type << std::endl;
-    m_runlumiToRange.push_back(temp);
-
-    RunLumiPHIDKey runLumi(m_reducedHistoryIDs.at(temp.m_historyIDIndex), temp.m_run, temp.m_lumi);
-    RunPHIDKey runKey(m_reducedHistoryIDs.at(temp.m_historyIDIndex), temp.m_run);
-
-    RunLumiToLastEntryMap::iterator itFind = runLumiToLastEntryMap.find(runLumi);
-    if (itFind == runLumiToLastEntryMap.end())
-    {
-      //does not already exist
-      //does the run for this already exist?
-      std::list<unsigned int>::iterator itLastOfRun = m_orderedIndices.end();
-
-      RunToFirstLastEntryMap::iterator itRunFirstLastEntryFind = runToFirstLastEntryMap.find(runKey);
-      bool needNewEntryInRunFirstLastEntryMap = true;
-      if (itRunFirstLastEntryFind != runToFirstLastEntryMap.end())
-      {
-        needNewEntryInRunFirstLastEntryMap=false;
-        if (temp.m_lumi!=0)
-        {
-          //lumis go to the end
-          itLastOfRun = itRunFirstLastEntryFind->second.second;
-          //we want to insert after this one so must advance the iterator
-          ++itLastOfRun;
-        }
-        else
-        {
-          //runs go at the beginning
-          itLastOfRun = itRunFirstLastEntryFind->second.first;
-        }
-      }
-      std::list<unsigned int>::iterator iter = m_orderedIndices.insert(itLastOfRun,index);
-      runLumiToLastEntryMap[runLumi]=iter;
-      if (needNewEntryInRunFirstLastEntryMap)
-        runToFirstLastEntryMap[runKey]=std::make_pair(iter,iter);
-      else
-      {
-        if(temp.m_lumi!=0)
-        {
-          //lumis go at end
-          runToFirstLastEntryMap[runKey].second = iter;
-        }
-        else
-        {
-          //since we haven't yet seen this run/lumi combination it means we haven't yet seen
-          // a run so we can put this first
-          runToFirstLastEntryMap[runKey].first = iter;
-        }
-      }
-    }
-    else
-    {
-      //We need to do a merge since the run/lumi already appeared. Put it after the existing entry
-      //std::cout <<" found a second instance of "<<runLumi.first<<" "<<runLumi.second<<" at "<<index<<std::endl;
-      std::list<unsigned int>::iterator itNext = itFind->second;
-      ++itNext;
-      std::list<unsigned int>::iterator iter = m_orderedIndices.insert(itNext,index);
-      RunToFirstLastEntryMap::iterator itRunFirstLastEntryFind = runToFirstLastEntryMap.find(runKey);
-      if (itRunFirstLastEntryFind->second.second == itFind->second)
-      {
-        //if the previous one was the last in the run, we need to update to make this one the last
-        itRunFirstLastEntryFind->second.second = iter;
-      }
-      itFind->second = iter;
+  //all at once. All lumis for the same run are grouped together with
+  //the run entry at the beginning. Use the order stored by the writer
+  //if it was computed the same way we would.
+  if(not useStoredOrder(*contents,reducedHistoryOrdinals)) {
+    IndexOrderBuilder orderBuilder;
+    orderBuilder.reserve(m_runlumiToRange.size());
+    for(std::vector<RunLumiToRange>::const_iterator it = m_runlumiToRange.begin(), itEnd = m_runlumiToRange.end();
+        it != itEnd;
+        ++it) {
+      orderBuilder.add(reducedHistoryOrdinals.at(it->m_historyIDIndex), it->m_run, it->m_lumi);
     }
+    orderBuilder.build(m_orderedIndices);
+  }
+  if(not m_runLumiSelector.selectsEverything()) {
+    selectRunsAndLumis();
   }
   m_nextIndexItr = m_orderedIndices.begin();
   m_presentIndexItr = m_orderedIndices.begin();
   
   if(m_nextIndexItr != m_orderedIndices.end()) {
+    std::lock_guard<std::mutex> guard(rootFileMutex());
     for( size_t index = 0; index < kNIndicies; ++index) {
+      if(m_selector.skipsType(index)) {
+        m_trees[index] = 0;
+        continue;
+      }
       m_trees[index] = dynamic_cast<TTree*>(m_file->Get(kTypeNames[index]));
       assert(0!=m_trees[index]);
-      m_treeReaders[index]->setTree(m_trees[index]);
+      m_treeReaders[index]->setTree(m_trees[index], hasNameTable ? &m_names : static_cast<const std::vector<NameEntry>*>(0),
+                                    storesColumns && index >= kTH1FIndex ? &m_shapes[index] : static_cast<const std::vector<HistogramShape>*>(0));
+      if(0 != m_cacheSize) {
+        m_trees[index]->SetCacheSize(m_cacheSize);
+        m_trees[index]->AddBranchToCache("*",true);
+        //prefetchUpcomingEntries says what is needed so there is nothing to learn
+        m_trees[index]->StopCacheLearningPhase();
+      }
     }
   }
   //After a file open, the framework expects to see a new 'IsRun'
   m_justOpenedFileSoNeedToGenerateRunTransition=true;
+
+  if(m_prefetchNextFile && iIndex+1 < m_catalog.fileNames().size()) {
+    //read the next file while this one is being processed
+    m_nextFileIndex = iIndex+1;
+    m_nextFileContents = std::async(std::launch::async,readFileContents,m_catalog.fileNames()[iIndex+1]);
+  }
+}
+
+//A file read ahead which is not going to be used is closed like any other
+void
+DQMRootSource::discardNextFile()
+{
+  if(not m_nextFileContents.valid()) {
+    return;
+  }
+  std::unique_ptr<FileContents> contents;
+  try {
+    contents = m_nextFileContents.get();
+  } catch(...) {
+    //a problem with a file which is not used does not matter
+    return;
+  }
+  std::lock_guard<std::mutex> guard(rootFileMutex());
+  contents.reset();
+}
+
+//Returns false if the file has no stored order or if it can not be used, in which
+// case m_orderedIndices is left empty
+bool
+DQMRootSource::useStoredOrder(FileContents& iContents, const std::vector<unsigned int>& iReducedHistoryOrdinals) {
+  if(not iContents.m_hasStoredOrder) {
+    return false;
+  }
+  if(not iContents.m_isGrouped) {
+    edm::LogWarning("DQMRootSource")<<"The OrderedIndices tree of file "<<m_catalog.fileNames()[m_presentlyOpenFileIndex]
+                                    <<" has entries, only an empty tree is understood. The order will be recomputed.";
+    return false;
+  }
+  if(iContents.m_storedReducedHistories != iReducedHistoryOrdinals) {
+    //this release reduces the process histories differently than the writer
+    return false;
+  }
+  const size_t nIndices = m_runlumiToRange.size();
+  GroupedIndexOrder order;
+  order.reserve(nIndices);
+  for(std::vector<RunLumiToRange>::const_iterator it = m_runlumiToRange.begin(), itEnd = m_runlumiToRange.end();
+      it != itEnd;
+      ++it) {
+    order.add(iReducedHistoryOrdinals.at(it->m_historyIDIndex), it->m_run, it->m_lumi);
+  }
+  if(order.build(m_orderedIndices)) {
+    return true;
+  }
+  edm::LogWarning("DQMRootSource")<<"The Indices of file "<<m_catalog.fileNames()[m_presentlyOpenFileIndex]
+                                  <<" are flagged as grouped but are not, the order will be recomputed.";
+  return false;
+}
+
+//Removes the runs and lumis which are not wanted so no transition is made for them
+void
+DQMRootSource::selectRunsAndLumis() {
+  std::vector<unsigned int> selected;
+  selected.reserve(m_orderedIndices.size());
+  //the entries of a run or lumi are next to each other
+  const RunLumiToRange* previous = 0;
+  bool previousSelected = false;
+  for(std::vector<unsigned int>::const_iterator it = m_orderedIndices.begin(), itEnd = m_orderedIndices.end();
+      it != itEnd;
+      ++it) {
+    const RunLumiToRange& range = m_runlumiToRange[*it];
+    if(0 == previous || previous->m_run != range.m_run || previous->m_lumi != range.m_lumi) {
+      previousSelected = 0 == range.m_lumi ? m_runLumiSelector.selectsRun(range.m_run) :
+                                             m_runLumiSelector.selectsLumi(range.m_run,range.m_lumi);
+    }
+    previous = &range;
+    if(previousSelected) {
+      selected.push_back(*it);
+    }
+  }
+  m_orderedIndices.swap(selected);
 }
 
 void
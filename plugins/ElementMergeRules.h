@@ -0,0 +1,73 @@
+#ifndef DQMServices_FwkIO_ElementMergeRules_h
+#define DQMServices_FwkIO_ElementMergeRules_h
+// -*- C++ -*-
+//
+// Package:     FwkIO
+// Class  :     ElementMergeRules
+//
+/**\class ElementMergeRules ElementMergeRules.h DQMServices/FwkIO/plugins/ElementMergeRules.h
+
+ Description: How the content of the same MonitorElement found in several lumis, runs or files is combined
+
+ Usage:
+    Shared by DQMRootSource and the dqmMerge program so both merge the same way. It works on the
+    stored values only and leaves reporting problems to the caller.
+    NOTE: the merge logic comes from DataFormats/Histograms/interface/MEtoEDMFormat.h
+*/
+
+// system include files
+#include <string>
+
+// user include files
+#include "TList.h"
+#include "HistogramMergeKernels.h"
+
+// forward declarations
+
+class ElementMergeRules {
+public:
+  enum Result {kMerged, kMergeFailed, kDifferentAxes};
+
+  template<class T>
+  static Result mergeHistograms(T* iOriginal, T* iToAdd) {
+    if(iOriginal->TestBit(TH1::kCanRebin)==true && iToAdd->TestBit(TH1::kCanRebin) ==true) {
+      TList list;
+      list.Add(iToAdd);
+      if( -1 == iOriginal->Merge(&list)) {
+        return kMergeFailed;
+      }
+    } else if(HistogramMergeKernels::add(iOriginal,iToAdd)) {
+      //same fixed binning, no need to go through TH1::Add
+    } else {
+      if (iOriginal->GetNbinsX() == iToAdd->GetNbinsX() &&
+          iOriginal->GetXaxis()->GetXmin() == iToAdd->GetXaxis()->GetXmin() &&
+          iOriginal->GetXaxis()->GetXmax() == iToAdd->GetXaxis()->GetXmax() &&
+          iOriginal->GetNbinsY() == iToAdd->GetNbinsY() &&
+          iOriginal->GetYaxis()->GetXmin() == iToAdd->GetYaxis()->GetXmin() &&
+          iOriginal->GetYaxis()->GetXmax() == iToAdd->GetYaxis()->GetXmax() &&
+          iOriginal->GetNbinsZ() == iToAdd->GetNbinsZ() &&
+          iOriginal->GetZaxis()->GetXmin() == iToAdd->GetZaxis()->GetXmin() &&
+          iOriginal->GetZaxis()->GetXmax() == iToAdd->GetZaxis()->GetXmax()) {
+        iOriginal->Add(iToAdd);
+      } else {
+        return kDifferentAxes;
+      }
+    }
+    return kMerged;
+  }
+
+  //the value the Int element should have after the merge
+  static Long64_t mergeInts(const std::string& iFullName, Long64_t iOriginal, Long64_t iToAdd) {
+    if(iFullName.find("EventInfo/processedEvents") != std::string::npos) {
+      return iOriginal+iToAdd;
+    }
+    if(iFullName.find("EventInfo/iEvent") != std::string::npos ||
+       iFullName.find("EventInfo/iLumiSection") != std::string::npos) {
+      return iToAdd > iOriginal ? iToAdd : iOriginal;
+    }
+    return iOriginal;
+  }
+  //Floats and Strings keep the value they were first given
+};
+
+#endif
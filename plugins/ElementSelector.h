@@ -0,0 +1,159 @@
+#ifndef DQMServices_FwkIO_ElementSelector_h
+#define DQMServices_FwkIO_ElementSelector_h
+// -*- C++ -*-
+//
+// Package:     FwkIO
+// Class  :     ElementSelector
+//
+/**\class ElementSelector ElementSelector.h DQMServices/FwkIO/plugins/ElementSelector.h
+
+ Description: Decides which of the stored MonitorElements DQMRootSource reads
+
+ Usage:
+    A MonitorElement is read if its type is not skipped, its full name is in one of the
+    included folders or matches one of the included patterns (everything is included if
+    none are given), and it is neither in an excluded folder nor matches an excluded pattern.
+    Folders are matched as whole path components, so "Tracking" selects "Tracking/Foo"
+    but not "TrackingX/Foo". Patterns are regular expressions which must match the full name.
+
+    Evaluating the patterns is much slower than reading a name so the caller is expected
+    to remember the result for each name, see hasNameRules.
+*/
+
+// system include files
+#include <string>
+#include <vector>
+#include <boost/regex.hpp>
+
+// user include files
+#include "FWCore/Utilities/interface/EDMException.h"
+#include "format.h"
+
+// forward declarations
+
+class ElementSelector {
+public:
+  ElementSelector(const std::vector<std::string>& iIncludeFolders,
+                  const std::vector<std::string>& iExcludeFolders,
+                  const std::vector<std::string>& iIncludePatterns,
+                  const std::vector<std::string>& iExcludePatterns,
+                  const std::vector<std::string>& iSkipTypes):
+    m_includeFolders(folders(iIncludeFolders)),
+    m_excludeFolders(folders(iExcludeFolders)),
+    m_includePatterns(patterns(iIncludePatterns)),
+    m_excludePatterns(patterns(iExcludePatterns)),
+    m_skipType(kNIndicies,false),
+    m_skipsTypes(false) {
+    for(std::vector<std::string>::const_iterator it = iSkipTypes.begin(), itEnd = iSkipTypes.end();
+        it != itEnd;
+        ++it) {
+      unsigned int type = 0;
+      while(type != kNIndicies && *it != kTypeNames[type]) {
+        ++type;
+      }
+      if(type == kNIndicies) {
+        edm::Exception ex(edm::errors::Configuration);
+        ex<<"The type '"<<*it<<"' given to skipTypes is not known. The known types are";
+        for(unsigned int known = 0; known != kNIndicies; ++known) {
+          ex<<" "<<kTypeNames[known];
+        }
+        ex<<".\n";
+        ex.addContext("Configuring DQMRootSource");
+        throw ex;
+      }
+      m_skipType[type] = true;
+      m_skipsTypes = true;
+    }
+  }
+
+  //true if the names have to be looked at
+  bool hasNameRules() const {
+    return not (m_includeFolders.empty() && m_excludeFolders.empty() &&
+                m_includePatterns.empty() && m_excludePatterns.empty());
+  }
+  bool selectsEverything() const {
+    return not m_skipsTypes && not hasNameRules();
+  }
+  bool skipsType(unsigned int iType) const {
+    return m_skipType[iType];
+  }
+
+  bool selects(const std::string& iFullName) const {
+    if(not m_includeFolders.empty() || not m_includePatterns.empty()) {
+      if(not inFolder(iFullName,m_includeFolders) && not matches(iFullName,m_includePatterns)) {
+        return false;
+      }
+    }
+    return not inFolder(iFullName,m_excludeFolders) && not matches(iFullName,m_excludePatterns);
+  }
+
+private:
+  static std::vector<std::string> folders(const std::vector<std::string>& iFolders) {
+    std::vector<std::string> returnValue;
+    returnValue.reserve(iFolders.size());
+    for(std::vector<std::string>::const_iterator it = iFolders.begin(), itEnd = iFolders.end();
+        it != itEnd;
+        ++it) {
+      std::string folder = *it;
+      while(not folder.empty() && folder[folder.size()-1] == '/') {
+        folder.resize(folder.size()-1);
+      }
+      returnValue.push_back(folder);
+    }
+    return returnValue;
+  }
+
+  static std::vector<boost::regex> patterns(const std::vector<std::string>& iPatterns) {
+    std::vector<boost::regex> returnValue;
+    returnValue.reserve(iPatterns.size());
+    for(std::vector<std::string>::const_iterator it = iPatterns.begin(), itEnd = iPatterns.end();
+        it != itEnd;
+        ++it) {
+      try {
+        returnValue.push_back(boost::regex(*it));
+      } catch(const boost::regex_error& e) {
+        edm::Exception ex(edm::errors::Configuration);
+        ex<<"The pattern '"<<*it<<"' is not a valid regular expression: "<<e.what()<<"\n";
+        ex.addContext("Configuring DQMRootSource");
+        throw ex;
+      }
+    }
+    return returnValue;
+  }
+
+  static bool inFolder(const std::string& iFullName, const std::vector<std::string>& iFolders) {
+    for(std::vector<std::string>::const_iterator it = iFolders.begin(), itEnd = iFolders.end();
+        it != itEnd;
+        ++it) {
+      //an empty folder is the top folder which holds everything
+      if(it->empty()) {
+        return true;
+      }
+      if(iFullName.size() > it->size() && iFullName[it->size()] == '/' &&
+         0 == iFullName.compare(0,it->size(),*it)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static bool matches(const std::string& iFullName, const std::vector<boost::regex>& iPatterns) {
+    for(std::vector<boost::regex>::const_iterator it = iPatterns.begin(), itEnd = iPatterns.end();
+        it != itEnd;
+        ++it) {
+      if(boost::regex_match(iFullName,*it)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::vector<std::string> m_includeFolders;
+  std::vector<std::string> m_excludeFolders;
+  std::vector<boost::regex> m_includePatterns;
+  std::vector<boost::regex> m_excludePatterns;
+  std::vector<bool> m_skipType;
+  bool m_skipsTypes;
+};
+
+#endif
@@ -0,0 +1,578 @@
+#ifndef DQMServices_FwkIO_HistogramColumns_h
+#define DQMServices_FwkIO_HistogramColumns_h
+// -*- C++ -*-
+//
+// Package:     FwkIO
+// Class  :     HistogramColumns
+//
+/**\class HistogramColumns HistogramColumns.h DQMServices/FwkIO/plugins/HistogramColumns.h
+
+ Description: Stores histograms as flat arrays plus a shape, see kColumnarFileFormatVersion
+
+ Usage:
+    Starting with kColumnarFileFormatVersion an entry of a histogram type tree holds only
+    what changes from lumi to lumi: the bin contents, the sumw2, the bin entries of profiles,
+    the statistics and the number of entries. Everything else (binning, axis labels, title,
+    options, attached functions) is kept in the shape of the histogram, stored once in the
+    shape tree of the type in the meta data. The ShapeId branch is the entry number of the
+    shape in that tree.
+
+    Starting with kSparseFileFormatVersion a 2D or 3D histogram with a fraction of filled
+    bins below the density threshold given to store only stores the filled bins, see kBinsBranch.
+    add then only touches those bins.
+
+    Starting with kDeduplicatedFileFormatVersion an entry with the same payload as an earlier
+    one stores none, readPayload then reads the payload of the earlier entry.
+
+    makeShape gives the shape of a histogram and store extracts its content. On reading, add merges
+    the content directly into an existing histogram of the same simple binning. If that is
+    not possible, rebuild turns a histogram of the same class into the stored histogram.
+*/
+
+// system include files
+#include <vector>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+#include <stdint.h>
+
+// user include files
+#include "TTree.h"
+#include "TBranch.h"
+#include "TBufferFile.h"
+#include "TClass.h"
+#include "TH1.h"
+#include "TH2.h"
+#include "TH3.h"
+#include "TProfile.h"
+#include "TProfile2D.h"
+
+#include "FWCore/Utilities/interface/EDMException.h"
+#include "format.h"
+#include "HistogramMergeKernels.h"
+
+// forward declarations
+
+//The content of one entry. Only the contents vector matching the bin type is used.
+struct HistogramContent {
+  HistogramContent(): m_shapeId(0), m_entries(0) {}
+  uint32_t m_shapeId;
+  double m_entries;
+  std::vector<double> m_stats;
+  std::vector<float> m_floatContents;
+  std::vector<short> m_shortContents;
+  std::vector<double> m_doubleContents;
+  //empty if the histogram has no sumw2
+  std::vector<double> m_sumw2;
+  //only used by profiles
+  std::vector<double> m_binEntries;
+  std::vector<double> m_binSumw2;
+  //the bins the arrays hold if the histogram is stored sparse
+  std::vector<uint32_t> m_bins;
+
+  bool isSparse() const { return not m_bins.empty();}
+  //for an entry referring to the payload of another one
+  void clearPayload() {
+    m_entries = 0;
+    m_stats.clear();
+    m_floatContents.clear();
+    m_shortContents.clear();
+    m_doubleContents.clear();
+    m_sumw2.clear();
+    m_binEntries.clear();
+    m_binSumw2.clear();
+    m_bins.clear();
+  }
+};
+
+//A stored shape. m_streamed is m_hist streamed into a buffer which is used to turn
+// another histogram of the same class into a copy of the shape without allocating a new one.
+struct HistogramShape {
+  std::unique_ptr<TH1> m_hist;
+  std::string m_streamed;
+};
+
+class HistogramColumns {
+public:
+  explicit HistogramColumns(unsigned int iType):
+    m_contentType(contentType(iType)), m_isProfile(kTProfileIndex == iType or kTProfile2DIndex == iType),
+    m_canBeSparse(canBeSparse(iType)),
+    m_stats(&m_content.m_stats), m_floatContents(&m_content.m_floatContents),
+    m_shortContents(&m_content.m_shortContents), m_doubleContents(&m_content.m_doubleContents),
+    m_sumw2(&m_content.m_sumw2), m_binEntries(&m_content.m_binEntries), m_binSumw2(&m_content.m_binSumw2),
+    m_bins(&m_content.m_bins) {}
+
+  //only the 2D and 3D histograms are stored sparse
+  static bool canBeSparse(unsigned int iType) {
+    return kTH2FIndex == iType or kTH2SIndex == iType or kTH2DIndex == iType or
+      kTH3FIndex == iType or kTProfile2DIndex == iType;
+  }
+
+  //the branch buffers
+  HistogramContent& content() { return m_content;}
+
+  //used when writing, iWithBins starting with kSparseFileFormatVersion
+  void branch(TTree* iTree, bool iWithBins) {
+    iTree->Branch(kShapeIdBranch,&m_content.m_shapeId);
+    iTree->Branch(kEntriesBranch,&m_content.m_entries);
+    iTree->Branch(kStatsBranch,&m_stats);
+    switch(m_contentType) {
+      case kFloatContent: iTree->Branch(kContentsBranch,&m_floatContents); break;
+      case kShortContent: iTree->Branch(kContentsBranch,&m_shortContents); break;
+      case kDoubleContent: iTree->Branch(kContentsBranch,&m_doubleContents); break;
+    }
+    iTree->Branch(kSumw2Branch,&m_sumw2);
+    if(m_isProfile) {
+      iTree->Branch(kBinEntriesBranch,&m_binEntries);
+      iTree->Branch(kBinSumw2Branch,&m_binSumw2);
+    }
+    if(iWithBins and m_canBeSparse) {
+      iTree->Branch(kBinsBranch,&m_bins);
+    }
+  }
+  //used when reading
+  void setBranchAddresses(TTree* iTree) {
+    iTree->SetBranchAddress(kShapeIdBranch,&m_content.m_shapeId);
+    iTree->SetBranchAddress(kEntriesBranch,&m_content.m_entries);
+    iTree->SetBranchAddress(kStatsBranch,&m_stats);
+    switch(m_contentType) {
+      case kFloatContent: iTree->SetBranchAddress(kContentsBranch,&m_floatContents); break;
+      case kShortContent: iTree->SetBranchAddress(kContentsBranch,&m_shortContents); break;
+      case kDoubleContent: iTree->SetBranchAddress(kContentsBranch,&m_doubleContents); break;
+    }
+    iTree->SetBranchAddress(kSumw2Branch,&m_sumw2);
+    if(m_isProfile) {
+      iTree->SetBranchAddress(kBinEntriesBranch,&m_binEntries);
+      iTree->SetBranchAddress(kBinSumw2Branch,&m_binSumw2);
+    }
+    //files older than kSparseFileFormatVersion do not have it
+    m_content.m_bins.clear();
+    if(m_canBeSparse and 0 != iTree->GetBranch(kBinsBranch)) {
+      iTree->SetBranchAddress(kBinsBranch,&m_bins);
+    }
+  }
+  //reads only the payload of another entry into the branch buffers, the shape id is kept
+  void readPayload(TTree* iTree, Long64_t iEntry) {
+    const char* const names[] = {kEntriesBranch, kStatsBranch, kContentsBranch, kSumw2Branch,
+                                 kBinEntriesBranch, kBinSumw2Branch, kBinsBranch};
+    m_content.m_bins.clear();
+    for(unsigned int i = 0; i != sizeof(names)/sizeof(names[0]); ++i) {
+      TBranch* branch = iTree->GetBranch(names[i]);
+      if(0 == branch) {
+        continue;
+      }
+      if(branch->GetEntry(iEntry) < 0) {
+        edm::Exception ex(edm::errors::FileReadError);
+        ex<<"The entry "<<iEntry<<" of the "<<iTree->GetName()<<" tree could not be read.\n";
+        ex.addContext("Reading DQM Root file");
+        throw ex;
+      }
+    }
+  }
+  //hands over what was read without copying the arrays
+  void take(HistogramContent& oContent) {
+    oContent.m_shapeId = m_content.m_shapeId;
+    oContent.m_entries = m_content.m_entries;
+    oContent.m_stats.swap(m_content.m_stats);
+    oContent.m_floatContents.swap(m_content.m_floatContents);
+    oContent.m_shortContents.swap(m_content.m_shortContents);
+    oContent.m_doubleContents.swap(m_content.m_doubleContents);
+    oContent.m_sumw2.swap(m_content.m_sumw2);
+    oContent.m_binEntries.swap(m_content.m_binEntries);
+    oContent.m_binSumw2.swap(m_content.m_binSumw2);
+    oContent.m_bins.swap(m_content.m_bins);
+  }
+
+  //A copy of iHist without any content. The histogram must not have a non empty fill buffer.
+  static std::unique_ptr<TH1> makeShape(const TH1& iHist) {
+    std::unique_ptr<TH1> shape(static_cast<TH1*>(iHist.Clone()));
+    //the copy must not be owned by whatever happens to be gDirectory
+    shape->SetDirectory(0);
+    arrayOf(*shape).Set(0);
+    shape->GetSumw2()->Set(0);
+    if(TArrayD* binEntries = binEntriesOf(*shape)) {
+      binEntries->Set(0);
+      binSumw2Of(*shape)->Set(0);
+    }
+    shape->SetEntries(0);
+    Double_t stats[TH1::kNstat] = {0};
+    shape->PutStats(stats);
+    return shape;
+  }
+
+  //A histogram with less than iSparseDensityThreshold of its bins filled is stored sparse,
+  // 0 means never. The tree must then have the bins branch.
+  static void store(TH1& iHist, HistogramContent& oContent, double iSparseDensityThreshold) {
+    //a histogram filled through its buffer has the bins computed on demand
+    if(0 != iHist.GetBuffer()) {
+      iHist.BufferEmpty();
+    }
+    oContent.m_entries = iHist.GetEntries();
+    Double_t stats[TH1::kNstat] = {0};
+    iHist.GetStats(stats);
+    oContent.m_stats.assign(stats,stats+TH1::kNstat);
+    if(TArrayF* floats = dynamic_cast<TArrayF*>(&iHist)) {
+      oContent.m_floatContents.assign(floats->fArray,floats->fArray+floats->fN);
+    } else if(TArrayS* shorts = dynamic_cast<TArrayS*>(&iHist)) {
+      oContent.m_shortContents.assign(shorts->fArray,shorts->fArray+shorts->fN);
+    } else {
+      TArrayD* doubles = dynamic_cast<TArrayD*>(&iHist);
+      assert(0 != doubles);
+      oContent.m_doubleContents.assign(doubles->fArray,doubles->fArray+doubles->fN);
+    }
+    toVector(*iHist.GetSumw2(),oContent.m_sumw2);
+    if(TArrayD* binEntries = binEntriesOf(iHist)) {
+      toVector(*binEntries,oContent.m_binEntries);
+      toVector(*binSumw2Of(iHist),oContent.m_binSumw2);
+    }
+    oContent.m_bins.clear();
+    if(0. < iSparseDensityThreshold and iHist.GetDimension() > 1) {
+      makeSparse(oContent,iSparseDensityThreshold);
+    }
+  }
+
+  //Adds the content to ioOriginal, which must have iShape's class. Gives the same
+  // result as merging the rebuilt histogram. Returns false, without changing ioOriginal,
+  // if the content can not be added without rebuilding the histogram first.
+  static bool add(const HistogramContent& iContent, const TH1& iShape, TH1& ioOriginal) {
+    if(ioOriginal.IsA() != iShape.IsA()) {
+      return false;
+    }
+    if(ioOriginal.TestBit(TH1::kCanRebin) and iShape.TestBit(TH1::kCanRebin)) {
+      //needs TH1::Merge
+      return false;
+    }
+    const size_t n = ioOriginal.GetNcells();
+    if(not HistogramMergeKernels::sameSimpleBinning(&ioOriginal,&iShape) or
+       n != static_cast<size_t>(arrayOf(ioOriginal).fN)) {
+      return false;
+    }
+    //the number of values in each array of the content
+    size_t nValues = n;
+    if(iContent.isSparse()) {
+      nValues = iContent.m_bins.size();
+      for(std::vector<uint32_t>::const_iterator it = iContent.m_bins.begin(), itEnd = iContent.m_bins.end();
+          it != itEnd;
+          ++it) {
+        if(*it >= n) {
+          return false;
+        }
+      }
+    }
+    if(nValues != contentSize(iContent)) {
+      return false;
+    }
+    TArrayD& sumw2 = *ioOriginal.GetSumw2();
+    TArrayD* binEntries = binEntriesOf(ioOriginal);
+    if(0 != binEntries) {
+      const TArrayD& binSumw2 = *binSumw2Of(ioOriginal);
+      if(static_cast<size_t>(sumw2.fN) != n or iContent.m_sumw2.size() != nValues or
+         static_cast<size_t>(binEntries->fN) != n or iContent.m_binEntries.size() != nValues or
+         (0 == binSumw2.fN) != iContent.m_binSumw2.empty() or
+         (0 != binSumw2.fN and (static_cast<size_t>(binSumw2.fN) != n or iContent.m_binSumw2.size() != nValues))) {
+        return false;
+      }
+    } else if(not iContent.m_sumw2.empty() and iContent.m_sumw2.size() != nValues) {
+      return false;
+    }
+
+    Double_t stats[TH1::kNstat] = {0};
+    ioOriginal.GetStats(stats);
+    Double_t statsToAdd[TH1::kNstat] = {0};
+    std::copy(iContent.m_stats.begin(),iContent.m_stats.begin()+std::min<size_t>(iContent.m_stats.size(),TH1::kNstat),statsToAdd);
+    const Double_t entries = std::abs(ioOriginal.GetEntries()+iContent.m_entries);
+
+    const std::vector<uint32_t>& bins = iContent.m_bins;
+    if(0 == binEntries) {
+      if(0 == sumw2.fN and not iContent.m_sumw2.empty()) {
+        ioOriginal.Sumw2();
+      }
+      if(0 != sumw2.fN) {
+        if(not iContent.m_sumw2.empty()) {
+          addValues(sumw2.fArray,iContent.m_sumw2,bins);
+        } else {
+          addAbsoluteContents(sumw2.fArray,iContent);
+        }
+      }
+    } else {
+      TArrayD& binSumw2 = *binSumw2Of(ioOriginal);
+      addValues(sumw2.fArray,iContent.m_sumw2,bins);
+      addValues(binEntries->fArray,iContent.m_binEntries,bins);
+      if(0 != binSumw2.fN) {
+        addValues(binSumw2.fArray,iContent.m_binSumw2,bins);
+      }
+    }
+    addContents(ioOriginal,iContent);
+
+    HistogramMergeKernels::addStats(stats,statsToAdd);
+    ioOriginal.PutStats(stats);
+    ioOriginal.SetEntries(entries);
+    return true;
+  }
+
+  //Makes ioHist, which must have the class of the shape, the stored histogram.
+  // If iIsCopyOfShape is true ioHist was last rebuilt from the same shape.
+  static void rebuild(const HistogramContent& iContent, const HistogramShape& iShape, TH1& ioHist, bool iIsCopyOfShape) {
+    if(not iIsCopyOfShape) {
+      //reading in place reuses the arrays and axes of ioHist
+      TBufferFile buffer(TBuffer::kRead,iShape.m_streamed.size(),const_cast<char*>(iShape.m_streamed.data()),kFALSE);
+      ioHist.Streamer(buffer);
+    }
+    //the shape keeps the number of bins
+    const std::vector<uint32_t>* bins = 0;
+    if(iContent.isSparse()) {
+      bins = &iContent.m_bins;
+      const size_t n = ioHist.GetNcells();
+      for(std::vector<uint32_t>::const_iterator it = bins->begin(), itEnd = bins->end();
+          it != itEnd;
+          ++it) {
+        if(*it >= n) {
+          edm::Exception ex(edm::errors::FileReadError);
+          ex<<"The bin "<<*it<<" of a sparse stored histogram is larger than the number of bins ("<<n<<") of its shape.\n"
+            " The file appears to be corrupted.\n";
+          ex.addContext("Reading DQM Root file");
+          throw ex;
+        }
+      }
+    }
+    if(TArrayF* floats = dynamic_cast<TArrayF*>(&ioHist)) {
+      toArray(iContent.m_floatContents,bins,ioHist,*floats);
+    } else if(TArrayS* shorts = dynamic_cast<TArrayS*>(&ioHist)) {
+      toArray(iContent.m_shortContents,bins,ioHist,*shorts);
+    } else {
+      TArrayD* doubles = dynamic_cast<TArrayD*>(&ioHist);
+      assert(0 != doubles);
+      toArray(iContent.m_doubleContents,bins,ioHist,*doubles);
+    }
+    toArray(iContent.m_sumw2,bins,ioHist,*ioHist.GetSumw2());
+    if(TArrayD* binEntries = binEntriesOf(ioHist)) {
+      toArray(iContent.m_binEntries,bins,ioHist,*binEntries);
+      toArray(iContent.m_binSumw2,bins,ioHist,*binSumw2Of(ioHist));
+    }
+    Double_t stats[TH1::kNstat] = {0};
+    std::copy(iContent.m_stats.begin(),iContent.m_stats.begin()+std::min<size_t>(iContent.m_stats.size(),TH1::kNstat),stats);
+    ioHist.PutStats(stats);
+    ioHist.SetEntries(iContent.m_entries);
+  }
+
+  //reads the shapes of one type, iTree is 0 if the file has no shapes for the type
+  static void readShapes(TTree* iTree, unsigned int iType, std::vector<HistogramShape>& oShapes) {
+    oShapes.clear();
+    if(0 == iTree) {
+      return;
+    }
+    //if ROOT created the objects it would delete them once they are handed over
+    TH1* hist = newHistogram(iType);
+    iTree->SetBranchAddress(kShapeBranch,&hist);
+    oShapes.reserve(iTree->GetEntries());
+    for(Long64_t index = 0; index != iTree->GetEntries(); ++index) {
+      if(0 == hist) {
+        hist = newHistogram(iType);
+      }
+      if(iTree->GetEntry(index) <= 0) {
+        delete hist;
+        edm::Exception ex(edm::errors::FileReadError);
+        ex<<"The histogram shape "<<index<<" in "<<iTree->GetName()<<" could not be read.\n";
+        ex.addContext("Reading DQM Root file");
+        throw ex;
+      }
+      HistogramShape shape;
+      TBufferFile buffer(TBuffer::kWrite);
+      hist->Streamer(buffer);
+      shape.m_streamed.assign(buffer.Buffer(),buffer.Length());
+      shape.m_hist.reset(hist);
+      hist = 0;
+      oShapes.push_back(std::move(shape));
+    }
+    iTree->ResetBranchAddresses();
+    delete hist;
+  }
+
+private:
+  enum ContentType {kFloatContent, kShortContent, kDoubleContent};
+  static ContentType contentType(unsigned int iType) {
+    switch(iType) {
+      case kTH1FIndex:
+      case kTH2FIndex:
+      case kTH3FIndex:
+        return kFloatContent;
+      case kTH1SIndex:
+      case kTH2SIndex:
+        return kShortContent;
+      case kTH1DIndex:
+      case kTH2DIndex:
+      case kTProfileIndex:
+      case kTProfile2DIndex:
+        return kDoubleContent;
+    }
+    assert(false);
+    return kDoubleContent;
+  }
+
+  //the per bin entries of the profiles are not accessible otherwise
+  struct ProfileArrays : public TProfile {
+    static TArrayD TProfile::* binEntries() { return &ProfileArrays::fBinEntries;}
+    static TArrayD TProfile::* binSumw2() { return &ProfileArrays::fBinSumw2;}
+  };
+  struct Profile2DArrays : public TProfile2D {
+    static TArrayD TProfile2D::* binEntries() { return &Profile2DArrays::fBinEntries;}
+    static TArrayD TProfile2D::* binSumw2() { return &Profile2DArrays::fBinSumw2;}
+  };
+  //0 for histograms which are not profiles
+  static TArrayD* binEntriesOf(TH1& iHist) {
+    if(TProfile* profile = dynamic_cast<TProfile*>(&iHist)) {
+      return &(profile->*ProfileArrays::binEntries());
+    }
+    if(TProfile2D* profile = dynamic_cast<TProfile2D*>(&iHist)) {
+      return &(profile->*Profile2DArrays::binEntries());
+    }
+    return 0;
+  }
+  static TArrayD* binSumw2Of(TH1& iHist) {
+    if(TProfile* profile = dynamic_cast<TProfile*>(&iHist)) {
+      return &(profile->*ProfileArrays::binSumw2());
+    }
+    if(TProfile2D* profile = dynamic_cast<TProfile2D*>(&iHist)) {
+      return &(profile->*Profile2DArrays::binSumw2());
+    }
+    return 0;
+  }
+  static TH1* newHistogram(unsigned int iType) {
+    TH1* hist = static_cast<TH1*>(TClass::GetClass(kTypeClassNames[iType])->New());
+    hist->SetDirectory(0);
+    return hist;
+  }
+  static TArray& arrayOf(TH1& iHist) {
+    TArray* array = dynamic_cast<TArray*>(&iHist);
+    assert(0 != array);
+    return *array;
+  }
+
+  static size_t contentSize(const HistogramContent& iContent) {
+    return std::max(iContent.m_floatContents.size(),std::max(iContent.m_shortContents.size(),iContent.m_doubleContents.size()));
+  }
+  //iBins is empty unless the values are stored sparse
+  template<class T>
+  static void addValues(T* ioValues, const std::vector<T>& iValues, const std::vector<uint32_t>& iBins) {
+    if(iValues.empty()) {
+      return;
+    }
+    if(iBins.empty()) {
+      HistogramMergeKernels::addArray(ioValues,&iValues[0],iValues.size());
+    } else {
+      HistogramMergeKernels::addSparseArray(ioValues,&iValues[0],&iBins[0],iValues.size());
+    }
+  }
+  template<class T>
+  static void addAbsoluteValues(Double_t* ioValues, const std::vector<T>& iValues, const std::vector<uint32_t>& iBins) {
+    if(iValues.empty()) {
+      return;
+    }
+    if(iBins.empty()) {
+      HistogramMergeKernels::addAbsolute(ioValues,&iValues[0],iValues.size());
+    } else {
+      HistogramMergeKernels::addAbsoluteSparse(ioValues,&iValues[0],&iBins[0],iValues.size());
+    }
+  }
+  static void addContents(TH1& ioOriginal, const HistogramContent& iContent) {
+    if(TArrayF* floats = dynamic_cast<TArrayF*>(&ioOriginal)) {
+      addValues(floats->fArray,iContent.m_floatContents,iContent.m_bins);
+    } else if(TArrayS* shorts = dynamic_cast<TArrayS*>(&ioOriginal)) {
+      addValues(shorts->fArray,iContent.m_shortContents,iContent.m_bins);
+    } else {
+      TArrayD* doubles = dynamic_cast<TArrayD*>(&ioOriginal);
+      assert(0 != doubles);
+      addValues(doubles->fArray,iContent.m_doubleContents,iContent.m_bins);
+    }
+  }
+  //the error of a bin without sumw2 is sqrt(|content|)
+  static void addAbsoluteContents(Double_t* ioSumw2, const HistogramContent& iContent) {
+    addAbsoluteValues(ioSumw2,iContent.m_floatContents,iContent.m_bins);
+    addAbsoluteValues(ioSumw2,iContent.m_shortContents,iContent.m_bins);
+    addAbsoluteValues(ioSumw2,iContent.m_doubleContents,iContent.m_bins);
+  }
+
+  //keeps only the filled bins if there are few enough of them
+  static void makeSparse(HistogramContent& ioContent, double iDensityThreshold) {
+    const size_t n = contentSize(ioContent);
+    std::vector<uint32_t>& bins = ioContent.m_bins;
+    for(size_t bin = 0; bin != n; ++bin) {
+      if(isFilled(ioContent,bin)) {
+        if(bins.size()+1 >= iDensityThreshold*n) {
+          //dense storage is smaller
+          bins.clear();
+          return;
+        }
+        bins.push_back(bin);
+      }
+    }
+    if(bins.empty()) {
+      //keeps the arrays the histogram has distinguishable from the ones it does not have
+      bins.push_back(0);
+    }
+    keepBins(ioContent.m_floatContents,bins);
+    keepBins(ioContent.m_shortContents,bins);
+    keepBins(ioContent.m_doubleContents,bins);
+    keepBins(ioContent.m_sumw2,bins);
+    keepBins(ioContent.m_binEntries,bins);
+    keepBins(ioContent.m_binSumw2,bins);
+  }
+  static bool isFilled(const HistogramContent& iContent, size_t iBin) {
+    return filled(iContent.m_floatContents,iBin) or filled(iContent.m_shortContents,iBin) or
+      filled(iContent.m_doubleContents,iBin) or filled(iContent.m_sumw2,iBin) or
+      filled(iContent.m_binEntries,iBin) or filled(iContent.m_binSumw2,iBin);
+  }
+  template<class V>
+  static bool filled(const std::vector<V>& iValues, size_t iBin) {
+    return not iValues.empty() and 0 != iValues[iBin];
+  }
+  //the bins are sorted so the values can be moved in place
+  template<class V>
+  static void keepBins(std::vector<V>& ioValues, const std::vector<uint32_t>& iBins) {
+    if(ioValues.empty()) {
+      return;
+    }
+    for(size_t i = 0; i != iBins.size(); ++i) {
+      ioValues[i] = ioValues[iBins[i]];
+    }
+    ioValues.resize(iBins.size());
+  }
+
+  template<class A, class V>
+  static void toVector(const A& iArray, std::vector<V>& oValues) {
+    oValues.assign(iArray.fArray,iArray.fArray+iArray.fN);
+  }
+  //iBins is 0 unless the values are stored sparse
+  template<class V, class A>
+  static void toArray(const std::vector<V>& iValues, const std::vector<uint32_t>* iBins, const TH1& iHist, A& oArray) {
+    //an empty array, e.g. a histogram without sumw2, stays empty
+    if(0 == iBins or iValues.empty()) {
+      oArray.Set(iValues.size());
+      std::copy(iValues.begin(),iValues.end(),oArray.fArray);
+      return;
+    }
+    oArray.Set(iHist.GetNcells());
+    oArray.Reset();
+    for(size_t i = 0; i != iValues.size(); ++i) {
+      oArray.fArray[(*iBins)[i]] = iValues[i];
+    }
+  }
+
+  ContentType m_contentType;
+  bool m_isProfile;
+  bool m_canBeSparse;
+  HistogramContent m_content;
+  //ROOT needs the address of a pointer for the vectors
+  std::vector<double>* m_stats;
+  std::vector<float>* m_floatContents;
+  std::vector<short>* m_shortContents;
+  std::vector<double>* m_doubleContents;
+  std::vector<double>* m_sumw2;
+  std::vector<double>* m_binEntries;
+  std::vector<double>* m_binSumw2;
+  std::vector<uint32_t>* m_bins;
+};
+
+#endif
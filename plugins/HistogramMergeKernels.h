@@ -0,0 +1,200 @@
+#ifndef DQMServices_FwkIO_HistogramMergeKernels_h
+#define DQMServices_FwkIO_HistogramMergeKernels_h
+// -*- C++ -*-
+//
+// Package:     FwkIO
+// Class  :     HistogramMergeKernels
+//
+/**\class HistogramMergeKernels HistogramMergeKernels.h DQMServices/FwkIO/plugins/HistogramMergeKernels.h
+
+ Description: Adds histograms with identical fixed binning by working directly on their arrays
+
+ Usage:
+    HistogramMergeKernels::add(original, toAdd) gives the same result as original->Add(toAdd)
+    but avoids the per bin virtual calls of TH1::Add. It returns false, without changing
+    original, when the histograms are not simple enough, e.g. variable binning, bin labels,
+    an axis range or a non empty fill buffer. The caller must then use TH1::Add.
+
+    The one exception is a bin of a TH1S, TH2S or TH3S going past +-32767, see addArray.
+
+    The loops over the bins are written so the compiler can vectorize them.
+*/
+
+// system include files
+#include <cmath>
+
+// user include files
+#include "TH1.h"
+#include "TH2.h"
+#include "TH3.h"
+#include "TProfile.h"
+#include "TProfile2D.h"
+
+// forward declarations
+
+class HistogramMergeKernels {
+public:
+  template<class T>
+  static bool add(T* iOriginal, T* iToAdd) {
+    if(not sameSimpleBinning(iOriginal,iToAdd) or
+       iOriginal->fN != iOriginal->GetNcells() or iToAdd->fN != iOriginal->fN) {
+      return false;
+    }
+    //must be done before the bins change since they can be recomputed from the bins
+    Double_t stats[TH1::kNstat] = {0};
+    Double_t statsToAdd[TH1::kNstat] = {0};
+    iOriginal->GetStats(stats);
+    iToAdd->GetStats(statsToAdd);
+    const Double_t entries = std::abs(iOriginal->GetEntries()+iToAdd->GetEntries());
+
+    if(0 == iOriginal->GetSumw2N() and 0 != iToAdd->GetSumw2N()) {
+      iOriginal->Sumw2();
+    }
+    const int n = iOriginal->fN;
+    if(0 != iOriginal->GetSumw2N()) {
+      if(0 != iToAdd->GetSumw2N()) {
+        addArray(iOriginal->GetSumw2()->fArray, iToAdd->GetSumw2()->fArray, n);
+      } else {
+        //the error of a bin without sumw2 is sqrt(|content|)
+        addAbsolute(iOriginal->GetSumw2()->fArray, iToAdd->fArray, n);
+      }
+    }
+    addArray(iOriginal->fArray, iToAdd->fArray, n);
+
+    addStats(stats,statsToAdd);
+    iOriginal->PutStats(stats);
+    iOriginal->SetEntries(entries);
+    return true;
+  }
+
+  static bool add(TProfile* iOriginal, TProfile* iToAdd) {
+    return addProfile<TProfile, ProfileArrays>(iOriginal,iToAdd);
+  }
+  static bool add(TProfile2D* iOriginal, TProfile2D* iToAdd) {
+    return addProfile<TProfile2D, Profile2DArrays>(iOriginal,iToAdd);
+  }
+
+  //the building blocks of add, also used by HistogramColumns
+  static bool simpleAxis(const TAxis* iAxis) {
+    return 0 == iAxis->GetXbins()->fN and 0 == iAxis->GetLabels() and not iAxis->TestBit(TAxis::kAxisRange);
+  }
+  static bool sameSimpleAxis(const TAxis* iLHS, const TAxis* iRHS) {
+    return iLHS->GetNbins() == iRHS->GetNbins() and
+      iLHS->GetXmin() == iRHS->GetXmin() and
+      iLHS->GetXmax() == iRHS->GetXmax() and
+      simpleAxis(iLHS) and simpleAxis(iRHS);
+  }
+  static bool sameSimpleBinning(const TH1* iLHS, const TH1* iRHS) {
+    return 0 == iLHS->GetBuffer() and 0 == iRHS->GetBuffer() and
+      not iLHS->TestBit(TH1::kIsAverage) and not iRHS->TestBit(TH1::kIsAverage) and
+      sameSimpleAxis(iLHS->GetXaxis(),iRHS->GetXaxis()) and
+      sameSimpleAxis(iLHS->GetYaxis(),iRHS->GetYaxis()) and
+      sameSimpleAxis(iLHS->GetZaxis(),iRHS->GetZaxis());
+  }
+
+  static void addStats(Double_t* ioStats, const Double_t* iStatsToAdd) {
+    for(int i = 0; i != TH1::kNstat; ++i) {
+      ioStats[i] += iStatsToAdd[i];
+    }
+  }
+
+  static void addArray(Float_t* __restrict__ ioValues, const Float_t* __restrict__ iToAdd, int iN) {
+    for(int i = 0; i < iN; ++i) {
+      ioValues[i] += iToAdd[i];
+    }
+  }
+  static void addArray(Double_t* __restrict__ ioValues, const Double_t* __restrict__ iToAdd, int iN) {
+    for(int i = 0; i < iN; ++i) {
+      ioValues[i] += iToAdd[i];
+    }
+  }
+  //Saturates at +-32767 like TH1S::AddBinContent. TH1::Add, used when the kernels refuse
+  // the histograms, stores its sums with SetBinContent which casts to Short_t so the bin
+  // wraps instead. An overflowing short histogram therefore gets different contents
+  // depending on which path merged it.
+  static void addArray(Short_t* __restrict__ ioValues, const Short_t* __restrict__ iToAdd, int iN) {
+    for(int i = 0; i < iN; ++i) {
+      const Int_t sum = Int_t(ioValues[i]) + Int_t(iToAdd[i]);
+      ioValues[i] = Short_t(sum < -32767 ? -32767 : (sum > 32767 ? 32767 : sum));
+    }
+  }
+
+  template<class T>
+  static void addAbsolute(Double_t* __restrict__ ioValues, const T* __restrict__ iToAdd, int iN) {
+    for(int i = 0; i < iN; ++i) {
+      ioValues[i] += std::abs(Double_t(iToAdd[i]));
+    }
+  }
+
+  //as the above but iToAdd only holds the values of the bins iBins
+  static void addSparseArray(Float_t* __restrict__ ioValues, const Float_t* __restrict__ iToAdd, const UInt_t* __restrict__ iBins, int iN) {
+    for(int i = 0; i < iN; ++i) {
+      ioValues[iBins[i]] += iToAdd[i];
+    }
+  }
+  static void addSparseArray(Double_t* __restrict__ ioValues, const Double_t* __restrict__ iToAdd, const UInt_t* __restrict__ iBins, int iN) {
+    for(int i = 0; i < iN; ++i) {
+      ioValues[iBins[i]] += iToAdd[i];
+    }
+  }
+  //saturates like addArray
+  static void addSparseArray(Short_t* __restrict__ ioValues, const Short_t* __restrict__ iToAdd, const UInt_t* __restrict__ iBins, int iN) {
+    for(int i = 0; i < iN; ++i) {
+      const Int_t sum = Int_t(ioValues[iBins[i]]) + Int_t(iToAdd[i]);
+      ioValues[iBins[i]] = Short_t(sum < -32767 ? -32767 : (sum > 32767 ? 32767 : sum));
+    }
+  }
+  template<class T>
+  static void addAbsoluteSparse(Double_t* __restrict__ ioValues, const T* __restrict__ iToAdd, const UInt_t* __restrict__ iBins, int iN) {
+    for(int i = 0; i < iN; ++i) {
+      ioValues[iBins[i]] += std::abs(Double_t(iToAdd[i]));
+    }
+  }
+
+private:
+  //the per bin entries of the profiles are not accessible otherwise
+  struct ProfileArrays : public TProfile {
+    static TArrayD TProfile::* binEntries() { return &ProfileArrays::fBinEntries;}
+    static TArrayD TProfile::* binSumw2() { return &ProfileArrays::fBinSumw2;}
+  };
+  struct Profile2DArrays : public TProfile2D {
+    static TArrayD TProfile2D::* binEntries() { return &Profile2DArrays::fBinEntries;}
+    static TArrayD TProfile2D::* binSumw2() { return &Profile2DArrays::fBinSumw2;}
+  };
+
+  template<class T, class ARRAYS>
+  static bool addProfile(T* iOriginal, T* iToAdd) {
+    const TArrayD& binEntriesToAdd = iToAdd->*ARRAYS::binEntries();
+    const TArrayD& binSumw2ToAdd = iToAdd->*ARRAYS::binSumw2();
+    TArrayD& binEntries = iOriginal->*ARRAYS::binEntries();
+    TArrayD& binSumw2 = iOriginal->*ARRAYS::binSumw2();
+    const int n = iOriginal->fN;
+    if(not sameSimpleBinning(iOriginal,iToAdd) or
+       n != iOriginal->GetNcells() or iToAdd->fN != n or
+       iOriginal->GetSumw2N() != n or iToAdd->GetSumw2N() != n or
+       binEntries.fN != n or binEntriesToAdd.fN != n or
+       binSumw2.fN != binSumw2ToAdd.fN or (0 != binSumw2.fN and binSumw2.fN != n)) {
+      return false;
+    }
+    Double_t stats[TH1::kNstat] = {0};
+    Double_t statsToAdd[TH1::kNstat] = {0};
+    iOriginal->GetStats(stats);
+    iToAdd->GetStats(statsToAdd);
+    const Double_t entries = std::abs(iOriginal->GetEntries()+iToAdd->GetEntries());
+
+    addArray(iOriginal->fArray, iToAdd->fArray, n);
+    addArray(iOriginal->GetSumw2()->fArray, iToAdd->GetSumw2()->fArray, n);
+    addArray(binEntries.fArray, binEntriesToAdd.fArray, n);
+    if(0 != binSumw2.fN) {
+      addArray(binSumw2.fArray, binSumw2ToAdd.fArray, n);
+    }
+
+    addStats(stats,statsToAdd);
+    iOriginal->PutStats(stats);
+    iOriginal->SetEntries(entries);
+    return true;
+  }
+
+};
+
+#endif
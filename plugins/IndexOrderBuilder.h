@@ -0,0 +1,246 @@
+#ifndef DQMServices_FwkIO_IndexOrderBuilder_h
+#define DQMServices_FwkIO_IndexOrderBuilder_h
+// -*- C++ -*-
+//
+// Package:     FwkIO
+// Class  :     IndexOrderBuilder
+//
+/**\class IndexOrderBuilder IndexOrderBuilder.h DQMServices/FwkIO/plugins/IndexOrderBuilder.h
+
+ Description: Decides in which order the entries of the Indices tree are processed
+
+ Usage:
+    Call add for each entry of the Indices tree, in the order they are in the file, then
+    build. Entries for the same run or lumi are put next to each other so they are
+    processed all at once:
+    - runs are ordered by their first appearance
+    - within a run, the run entries (lumi 0) come first followed by the lumis ordered by
+      their first appearance
+    - entries for the same run/lumi keep the order they have in the file
+
+    The process history is passed as a small integer identifying the reduced process
+    history so no ProcessHistoryID comparison is needed per entry.
+
+    GroupedIndexOrder gives the same order in one pass without any lookup per entry, but
+    only for entries which are already grouped: the entries of each run are next to each
+    other, and so are those of each lumi within it. That is how the writers store them,
+    which then only flag the file as grouped instead of storing the order.
+*/
+
+// system include files
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstddef>
+
+// user include files
+
+// forward declarations
+
+class IndexOrderBuilder {
+public:
+  IndexOrderBuilder(): m_hasLastKey(false), m_lastGroup(0) {}
+
+  void reserve(size_t iSize) { m_entryGroups.reserve(iSize);}
+
+  void add(unsigned int iReducedHistory, unsigned int iRun, unsigned int iLumi) {
+    const Key key(iReducedHistory,iRun,iLumi);
+    //entries written by the same job for the same run/lumi are adjacent
+    if(not m_hasLastKey or not (key == m_lastKey)) {
+      std::pair<GroupMap::iterator,bool> inserted = m_groups.insert(std::make_pair(key,static_cast<unsigned int>(m_groupInfos.size())));
+      if(inserted.second) {
+        const RunKey runKey = makeRunKey(iReducedHistory,iRun);
+        std::pair<RunMap::iterator,bool> runInserted = m_runs.insert(std::make_pair(runKey,static_cast<unsigned int>(m_runs.size())));
+        GroupInfo info;
+        info.m_runOrder = runInserted.first->second;
+        info.m_isLumi = (iLumi != 0);
+        info.m_nEntries = 0;
+        m_groupInfos.push_back(info);
+      }
+      m_lastGroup = inserted.first->second;
+      m_lastKey = key;
+      m_hasLastKey = true;
+    }
+    ++m_groupInfos[m_lastGroup].m_nEntries;
+    m_entryGroups.push_back(m_lastGroup);
+  }
+
+  //oOrdered holds the indices of the entries in the order they should be processed.
+  // The builder is ready to be used again afterwards.
+  void build(std::vector<unsigned int>& oOrdered) {
+    //order the groups, ties are kept in the order of first appearance
+    std::vector<unsigned int> groupOrder(m_groupInfos.size());
+    for(unsigned int i = 0; i != groupOrder.size(); ++i) {
+      groupOrder[i] = i;
+    }
+    std::stable_sort(groupOrder.begin(),groupOrder.end(),GroupLess(m_groupInfos));
+
+    //place the entries of each group, keeping the file order within a group
+    std::vector<unsigned int> groupStart(m_groupInfos.size());
+    unsigned int start = 0;
+    for(std::vector<unsigned int>::const_iterator it = groupOrder.begin(), itEnd = groupOrder.end();
+        it != itEnd;
+        ++it) {
+      groupStart[*it] = start;
+      start += m_groupInfos[*it].m_nEntries;
+    }
+    oOrdered.resize(m_entryGroups.size());
+    for(unsigned int index = 0; index != m_entryGroups.size(); ++index) {
+      oOrdered[groupStart[m_entryGroups[index]]++] = index;
+    }
+    clear();
+  }
+
+  void clear() {
+    m_groups.clear();
+    m_runs.clear();
+    m_groupInfos.clear();
+    m_entryGroups.clear();
+    m_hasLastKey = false;
+    m_lastGroup = 0;
+  }
+
+private:
+  struct Key {
+    Key(): m_history(0), m_run(0), m_lumi(0) {}
+    Key(unsigned int iHistory, unsigned int iRun, unsigned int iLumi): m_history(iHistory), m_run(iRun), m_lumi(iLumi) {}
+    bool operator==(const Key& iOther) const {
+      return m_lumi == iOther.m_lumi and m_run == iOther.m_run and m_history == iOther.m_history;
+    }
+    unsigned int m_history;
+    unsigned int m_run;
+    unsigned int m_lumi;
+  };
+  struct KeyHash {
+    size_t operator()(const Key& iKey) const {
+      unsigned long long v = (static_cast<unsigned long long>(iKey.m_run) << 32) | iKey.m_lumi;
+      v ^= static_cast<unsigned long long>(iKey.m_history) * 0x9E3779B97F4A7C15ULL;
+      v ^= v >> 29;
+      v *= 0xBF58476D1CE4E5B9ULL;
+      v ^= v >> 32;
+      return static_cast<size_t>(v);
+    }
+  };
+  typedef unsigned long long RunKey;
+  static RunKey makeRunKey(unsigned int iHistory, unsigned int iRun) {
+    return (static_cast<unsigned long long>(iHistory) << 32) | iRun;
+  }
+
+  struct GroupInfo {
+    unsigned int m_runOrder;
+    bool m_isLumi;
+    unsigned int m_nEntries;
+  };
+  class GroupLess {
+  public:
+    explicit GroupLess(const std::vector<GroupInfo>& iInfos): m_infos(&iInfos) {}
+    bool operator()(unsigned int iLHS, unsigned int iRHS) const {
+      const GroupInfo& lhs = (*m_infos)[iLHS];
+      const GroupInfo& rhs = (*m_infos)[iRHS];
+      if(lhs.m_runOrder != rhs.m_runOrder) {
+        return lhs.m_runOrder < rhs.m_runOrder;
+      }
+      //run entries go before the lumis
+      return lhs.m_isLumi < rhs.m_isLumi;
+    }
+  private:
+    const std::vector<GroupInfo>* m_infos;
+  };
+
+  typedef std::unordered_map<Key, unsigned int, KeyHash> GroupMap;
+  typedef std::unordered_map<RunKey, unsigned int> RunMap;
+
+  GroupMap m_groups;
+  RunMap m_runs;
+  std::vector<GroupInfo> m_groupInfos;
+  //for each entry, the group it belongs to
+  std::vector<unsigned int> m_entryGroups;
+  bool m_hasLastKey;
+  Key m_lastKey;
+  unsigned int m_lastGroup;
+};
+
+class GroupedIndexOrder {
+public:
+  GroupedIndexOrder(): m_grouped(true), m_nAdded(0), m_hasLast(false), m_lastHistory(0), m_lastRun(0), m_lastLumi(0) {}
+
+  void reserve(size_t iSize) { m_ordered.reserve(iSize);}
+
+  void add(unsigned int iReducedHistory, unsigned int iRun, unsigned int iLumi) {
+    const unsigned int index = m_nAdded++;
+    if(not m_grouped) {
+      return;
+    }
+    if(not m_hasLast or iReducedHistory != m_lastHistory or iRun != m_lastRun) {
+      endRun();
+      if(not m_runs.insert((static_cast<unsigned long long>(iReducedHistory) << 32) | iRun).second) {
+        m_grouped = false;
+        return;
+      }
+      m_lastLumi = 0;
+    }
+    //the run entries do not have to be next to each other, they all go first
+    if(0 != iLumi and iLumi != m_lastLumi and not m_lumis.insert(iLumi).second) {
+      m_grouped = false;
+      return;
+    }
+    (0 == iLumi ? m_runEntries : m_lumiEntries).push_back(index);
+    m_hasLast = true;
+    m_lastHistory = iReducedHistory;
+    m_lastRun = iRun;
+    m_lastLumi = iLumi;
+  }
+
+  //true as long as all the entries added were grouped
+  bool grouped() const { return m_grouped;}
+
+  //Returns false, leaving oOrdered empty, if the entries were not grouped. The order
+  // is then the one of IndexOrderBuilder. The object is ready to be used again afterwards.
+  bool build(std::vector<unsigned int>& oOrdered) {
+    endRun();
+    const bool grouped = m_grouped;
+    oOrdered.clear();
+    if(grouped) {
+      oOrdered.swap(m_ordered);
+    }
+    clear();
+    return grouped;
+  }
+
+  void clear() {
+    m_grouped = true;
+    m_nAdded = 0;
+    m_hasLast = false;
+    m_runs.clear();
+    m_lumis.clear();
+    m_runEntries.clear();
+    m_lumiEntries.clear();
+    m_ordered.clear();
+  }
+
+private:
+  void endRun() {
+    m_ordered.insert(m_ordered.end(),m_runEntries.begin(),m_runEntries.end());
+    m_ordered.insert(m_ordered.end(),m_lumiEntries.begin(),m_lumiEntries.end());
+    m_runEntries.clear();
+    m_lumiEntries.clear();
+    m_lumis.clear();
+  }
+
+  bool m_grouped;
+  unsigned int m_nAdded;
+  bool m_hasLast;
+  unsigned int m_lastHistory;
+  unsigned int m_lastRun;
+  unsigned int m_lastLumi;
+  //only one entry per run and one per lumi of the present run
+  std::unordered_set<unsigned long long> m_runs;
+  std::unordered_set<unsigned int> m_lumis;
+  //of the present run
+  std::vector<unsigned int> m_runEntries;
+  std::vector<unsigned int> m_lumiEntries;
+  std::vector<unsigned int> m_ordered;
+};
+
+#endif
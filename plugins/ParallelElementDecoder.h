@@ -0,0 +1,461 @@
+#ifndef DQMServices_FwkIO_ParallelElementDecoder_h
+#define DQMServices_FwkIO_ParallelElementDecoder_h
+// -*- C++ -*-
+//
+// Package:     FwkIO
+// Class  :     ParallelElementDecoder
+//
+/**\class ParallelElementDecoder ParallelElementDecoder.h DQMServices/FwkIO/plugins/ParallelElementDecoder.h
+
+ Description: Reads and decodes the entries of the type trees on worker threads
+
+ Usage:
+    Each worker opens the file itself since a TFile can not be read from several threads.
+    Call start with the entries of each type tree in the order they will be asked for,
+    then call next for each of them. The entries of one type are decoded, in order, by
+    one worker at a time while the other workers decode the other types, so the caller
+    gets exactly what it would have read itself. Each decoded element is handed over as
+    soon as it is available so the caller can book and merge while the rest is still
+    being decoded. At most iMaxQueued decoded elements of a type wait for the caller, a
+    worker finding the queue of its type full moves on to another type.
+
+    TThread::Initialize must have been called before the workers use ROOT. Opening and
+    closing the files and creating the histograms holds rootFileMutex.
+*/
+
+// system include files
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <algorithm>
+#include <cassert>
+
+// user include files
+#include "TFile.h"
+#include "TTree.h"
+#include "TClass.h"
+#include "TH1.h"
+
+#include "FWCore/Utilities/interface/EDMException.h"
+#include "format.h"
+#include "HistogramColumns.h"
+#include "RootFileMutex.h"
+#include "CacheEntryRanges.h"
+
+// forward declarations
+
+//The content of one entry of a type tree. Only the members for the type are filled.
+struct DecodedElement {
+  DecodedElement(): m_nameId(0), m_tag(0), m_int(0), m_float(0) {}
+  uint32_t m_nameId;
+  std::string m_fullName; //only for files without a name table
+  uint32_t m_tag;
+  Long64_t m_int;
+  double m_float;
+  std::string m_string;
+  std::unique_ptr<TH1> m_hist;
+  std::unique_ptr<HistogramContent> m_content; //only for histograms stored as columns
+};
+
+class ParallelElementDecoder {
+public:
+  ParallelElementDecoder(unsigned int iNThreads, unsigned int iCacheSize, unsigned int iMaxQueued):
+    m_cacheSize(iCacheSize), m_maxQueued(std::max(1U,iMaxQueued)), m_hasNameTable(false), m_storesColumns(false), m_stop(false), m_workers(iNThreads) {
+    for(unsigned int i = 0; i != iNThreads; ++i) {
+      m_threads.push_back(std::thread(&ParallelElementDecoder::work,this,i));
+    }
+  }
+  ~ParallelElementDecoder() {
+    cancel();
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_changed.notify_all();
+    for(std::vector<std::thread>::iterator it = m_threads.begin(), itEnd = m_threads.end();
+        it != itEnd;
+        ++it) {
+      it->join();
+    }
+  }
+
+  //the workers open the file the first time they need it
+  void setFile(const std::string& iFileName, bool iHasNameTable, bool iStoresColumns) {
+    cancel();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_fileName = iFileName;
+    m_hasNameTable = iHasNameTable;
+    m_storesColumns = iStoresColumns;
+  }
+
+  //iEntries holds the entries of each type tree in the order they will be asked for
+  void start(const std::vector<std::vector<ULong64_t> >& iEntries, const std::vector<unsigned int>& iTypeOrder) {
+    cancel();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    //the types needed first are decoded first
+    for(std::vector<unsigned int>::const_iterator it = iTypeOrder.begin(), itEnd = iTypeOrder.end();
+        it != itEnd;
+        ++it) {
+      Job& job = m_jobs[*it];
+      if(iEntries[*it].empty() or not job.m_entries.empty()) {
+        continue;
+      }
+      job.m_entries = iEntries[*it];
+      m_order.push_back(*it);
+    }
+    m_changed.notify_all();
+  }
+
+  //waits until the next entry of the type is decoded
+  std::unique_ptr<DecodedElement> next(unsigned int iType) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    Job& job = m_jobs[iType];
+    while(job.m_decoded.empty()) {
+      if(job.m_exception) {
+        std::rethrow_exception(job.m_exception);
+      }
+      assert(not job.m_done);
+      m_changed.wait(lock);
+    }
+    std::unique_ptr<DecodedElement> element(std::move(job.m_decoded.front()));
+    job.m_decoded.pop_front();
+    if(job.m_decoded.size()+1 == m_maxQueued) {
+      //there is room again
+      m_changed.notify_all();
+    }
+    return element;
+  }
+
+  //throws away what was not asked for, e.g. when the caller failed
+  void cancel() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_order.clear();
+    for(unsigned int type = 0; type != kNIndicies; ++type) {
+      m_jobs[type].m_cancelled = true;
+    }
+    while(0 != busyWorkers()) {
+      m_changed.wait(lock);
+    }
+    for(unsigned int type = 0; type != kNIndicies; ++type) {
+      m_jobs[type] = Job();
+    }
+  }
+
+private:
+  ParallelElementDecoder(const ParallelElementDecoder&); // stop default
+  const ParallelElementDecoder& operator=(const ParallelElementDecoder&); // stop default
+
+  struct Job {
+    Job(): m_nextEntry(0), m_taken(false), m_done(false), m_cancelled(false) {}
+    std::vector<ULong64_t> m_entries;
+    //only changed by the worker which has taken the job
+    size_t m_nextEntry;
+    std::deque<std::unique_ptr<DecodedElement> > m_decoded;
+    bool m_taken;
+    bool m_done;
+    bool m_cancelled;
+    std::exception_ptr m_exception;
+  };
+
+  //The branch buffers of one type tree of the file opened by a worker
+  class TypeTree {
+  public:
+    TypeTree(TTree* iTree, unsigned int iType, bool iHasNameTable, bool iStoresColumns, unsigned int iCacheSize):
+      m_tree(iTree), m_type(iType), m_hasNameTable(iHasNameTable), m_fullNamePtr(&m_fullName),
+      m_nameId(0), m_tag(0), m_int(0), m_float(0), m_stringPtr(&m_string), m_object(0), m_sameAs(0), m_resolvedEntry(kNoEntry) {
+      if(m_hasNameTable) {
+        m_tree->SetBranchAddress(kNameIdBranch,&m_nameId);
+      } else {
+        m_tree->SetBranchAddress(kFullNameBranch,&m_fullNamePtr);
+      }
+      m_tree->SetBranchAddress(kFlagBranch,&m_tag);
+      //only files starting with kDeduplicatedFileFormatVersion have it
+      if(0 != m_tree->GetBranch(kSameAsBranch)) {
+        m_tree->SetBranchAddress(kSameAsBranch,&m_sameAs);
+      }
+      switch(m_type) {
+        case kIntIndex: m_tree->SetBranchAddress(kValueBranch,&m_int); break;
+        case kFloatIndex: m_tree->SetBranchAddress(kValueBranch,&m_float); break;
+        case kStringIndex: m_tree->SetBranchAddress(kValueBranch,&m_stringPtr); break;
+        default:
+          if(iStoresColumns) {
+            m_columns.reset(new HistogramColumns(m_type));
+            m_columns->setBranchAddresses(m_tree);
+            break;
+          }
+          //if ROOT created the object it would delete it once it is handed over
+          newObject();
+          m_tree->SetBranchAddress(kValueBranch,&m_object);
+          break;
+      }
+      if(0 != iCacheSize) {
+        m_tree->SetCacheSize(iCacheSize);
+        m_tree->AddBranchToCache("*",true);
+        m_tree->StopCacheLearningPhase();
+      }
+    }
+    ~TypeTree() {
+      m_tree->ResetBranchAddresses();
+      delete m_object;
+    }
+    //the cache only reads the contiguous ranges of these entries
+    void setCacheEntries(std::vector<ULong64_t>::const_iterator iBegin, std::vector<ULong64_t>::const_iterator iEnd) {
+      m_cacheRanges.clear();
+      for(; iBegin != iEnd; ++iBegin) {
+        m_cacheRanges.add(*iBegin,*iBegin+1);
+      }
+      m_cacheRanges.prepare();
+    }
+    std::unique_ptr<DecodedElement> read(ULong64_t iEntry) {
+      if(not m_cacheRanges.empty()) {
+        m_cacheRanges.select(m_tree,iEntry);
+      }
+      if(0 == m_object and m_type > kStringIndex and 0 == m_columns.get()) {
+        newObject();
+      }
+      if(m_tree->GetEntry(iEntry) <= 0) {
+        edm::Exception ex(edm::errors::FileReadError);
+        ex<<"The entry "<<iEntry<<" of the "<<kTypeNames[m_type]<<" tree could not be read.\n";
+        ex.addContext("Reading DQM Root file");
+        throw ex;
+      }
+      std::unique_ptr<DecodedElement> element(new DecodedElement);
+      element->m_tag = m_tag;
+      if(m_hasNameTable) {
+        element->m_nameId = m_nameId;
+      } else {
+        element->m_fullName = m_fullName;
+      }
+      switch(m_type) {
+        case kIntIndex: element->m_int = m_int; break;
+        case kFloatIndex: element->m_float = m_float; break;
+        case kStringIndex:
+          if(0 != m_sameAs) {
+            readBranchEntry(kValueBranch,referencedEntry(iEntry));
+          }
+          element->m_string = m_string;
+          break;
+        default:
+          if(0 != m_columns.get()) {
+            if(0 != m_sameAs) {
+              element->m_content.reset(new HistogramContent(resolvedContent(iEntry)));
+              break;
+            }
+            element->m_content.reset(new HistogramContent);
+            m_columns->take(*element->m_content);
+            break;
+          }
+          element->m_hist.reset(m_object);
+          m_object = 0;
+          break;
+      }
+      return element;
+    }
+  private:
+    TypeTree(const TypeTree&); // stop default
+    const TypeTree& operator=(const TypeTree&); // stop default
+
+    ULong64_t referencedEntry(ULong64_t iEntry) const {
+      const ULong64_t entry = m_sameAs-1;
+      if(entry >= iEntry) {
+        edm::Exception ex(edm::errors::FileReadError);
+        ex<<"The entry "<<iEntry<<" of the "<<kTypeNames[m_type]<<" tree refers to the entry "<<entry
+          <<" which is not an earlier one.\n The file appears to be corrupted.\n";
+        ex.addContext("Reading DQM Root file");
+        throw ex;
+      }
+      return entry;
+    }
+    void readBranchEntry(const char* iBranchName, ULong64_t iEntry) {
+      if(m_tree->GetBranch(iBranchName)->GetEntry(iEntry) < 0) {
+        edm::Exception ex(edm::errors::FileReadError);
+        ex<<"The entry "<<iEntry<<" of the "<<kTypeNames[m_type]<<" tree could not be read.\n";
+        ex.addContext("Reading DQM Root file");
+        throw ex;
+      }
+    }
+    //as in DQMRootSource the last payload read for another entry is kept
+    const HistogramContent& resolvedContent(ULong64_t iEntry) {
+      const ULong64_t entry = referencedEntry(iEntry);
+      const uint32_t shapeId = m_columns->content().m_shapeId;
+      if(entry != m_resolvedEntry) {
+        m_columns->readPayload(m_tree,entry);
+        m_resolved = m_columns->content();
+        m_resolvedEntry = entry;
+      }
+      m_resolved.m_shapeId = shapeId;
+      return m_resolved;
+    }
+
+    void newObject() {
+      std::lock_guard<std::mutex> lock(rootFileMutex());
+      m_object = static_cast<TH1*>(TClass::GetClass(kTypeClassNames[m_type])->New());
+      m_object->SetDirectory(0);
+    }
+
+    TTree* m_tree;
+    unsigned int m_type;
+    bool m_hasNameTable;
+    std::string m_fullName;
+    std::string* m_fullNamePtr;
+    uint32_t m_nameId;
+    uint32_t m_tag;
+    Long64_t m_int;
+    double m_float;
+    std::string m_string;
+    std::string* m_stringPtr;
+    TH1* m_object;
+    std::unique_ptr<HistogramColumns> m_columns;
+    CacheEntryRanges m_cacheRanges;
+    ULong64_t m_sameAs;
+    static const ULong64_t kNoEntry = 0xFFFFFFFFFFFFFFFFULL;
+    ULong64_t m_resolvedEntry;
+    HistogramContent m_resolved;
+  };
+
+  //what each worker has opened
+  struct Worker {
+    Worker(): m_busy(false) {}
+    std::string m_fileName;
+    std::vector<std::unique_ptr<TypeTree> > m_trees;
+    std::unique_ptr<TFile> m_file;
+    bool m_busy;
+  };
+
+  unsigned int busyWorkers() const {
+    unsigned int nBusy = 0;
+    for(std::vector<Worker>::const_iterator it = m_workers.begin(), itEnd = m_workers.end();
+        it != itEnd;
+        ++it) {
+      if(it->m_busy) {
+        ++nBusy;
+      }
+    }
+    return nBusy;
+  }
+
+  //the first job, in the order they are needed, which no worker has and which has room
+  // for more decoded elements. kNIndicies if there is none.
+  unsigned int runnableJob() const {
+    for(std::vector<unsigned int>::const_iterator it = m_order.begin(), itEnd = m_order.end();
+        it != itEnd;
+        ++it) {
+      const Job& job = m_jobs[*it];
+      if(not job.m_taken and not job.m_done and job.m_decoded.size() < m_maxQueued) {
+        return *it;
+      }
+    }
+    return kNIndicies;
+  }
+
+  static void closeFile(Worker& iWorker) {
+    std::lock_guard<std::mutex> lock(rootFileMutex());
+    iWorker.m_trees.clear();
+    iWorker.m_file.reset();
+  }
+
+  //called with the file name the worker should be reading
+  static void openFile(Worker& iWorker, const std::string& iFileName) {
+    closeFile(iWorker);
+    iWorker.m_fileName = iFileName;
+    {
+      std::lock_guard<std::mutex> lock(rootFileMutex());
+      iWorker.m_file.reset(TFile::Open(iFileName.c_str()));
+    }
+    if(0 == iWorker.m_file.get() or iWorker.m_file->IsZombie()) {
+      iWorker.m_file.reset();
+      edm::Exception ex(edm::errors::FileOpenError);
+      ex<<"Input file "<<iFileName<<" could not be opened by a thread decoding its MonitorElements.\n";
+      ex.addContext("Opening DQM Root file");
+      throw ex;
+    }
+    //a type tree is only opened once it is needed
+    iWorker.m_trees.resize(kNIndicies);
+  }
+
+  void work(unsigned int iWorker) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    Worker& worker = m_workers[iWorker];
+    while(true) {
+      unsigned int type = kNIndicies;
+      while(not m_stop and kNIndicies == (type = runnableJob())) {
+        m_changed.wait(lock);
+      }
+      if(m_stop) {
+        break;
+      }
+      Job& job = m_jobs[type];
+      job.m_taken = true;
+      worker.m_busy = true;
+      const std::string fileName = m_fileName;
+      const bool hasNameTable = m_hasNameTable;
+      const bool storesColumns = m_storesColumns;
+      lock.unlock();
+      try {
+        if(fileName != worker.m_fileName or 0 == worker.m_file.get()) {
+          openFile(worker,fileName);
+        }
+        if(0 == worker.m_trees[type].get()) {
+          TTree* typeTree = 0;
+          {
+            std::lock_guard<std::mutex> rootLock(rootFileMutex());
+            typeTree = dynamic_cast<TTree*>(worker.m_file->Get(kTypeNames[type]));
+          }
+          assert(0 != typeTree);
+          worker.m_trees[type].reset(new TypeTree(typeTree,type,hasNameTable,storesColumns,m_cacheSize));
+        }
+        TypeTree& tree = *worker.m_trees[type];
+        if(0 != m_cacheSize) {
+          //only what is left, an earlier part may have been decoded by another worker
+          const std::vector<ULong64_t>& entries = job.m_entries;
+          tree.setCacheEntries(entries.begin()+job.m_nextEntry,entries.end());
+        }
+        //stops once the caller has enough waiting, another worker continues when there is room
+        bool full = false;
+        while(not full) {
+          std::unique_ptr<DecodedElement> element = tree.read(job.m_entries[job.m_nextEntry]);
+          std::lock_guard<std::mutex> guard(m_mutex);
+          if(job.m_cancelled) {
+            break;
+          }
+          job.m_decoded.push_back(std::move(element));
+          ++job.m_nextEntry;
+          job.m_done = job.m_nextEntry == job.m_entries.size();
+          full = job.m_done or job.m_decoded.size() >= m_maxQueued;
+          m_changed.notify_all();
+        }
+        lock.lock();
+      } catch(...) {
+        lock.lock();
+        job.m_exception = std::current_exception();
+        job.m_done = true;
+      }
+      job.m_taken = false;
+      worker.m_busy = false;
+      m_changed.notify_all();
+    }
+    lock.unlock();
+    closeFile(worker);
+  }
+
+  unsigned int m_cacheSize;
+  unsigned int m_maxQueued;
+  std::string m_fileName;
+  bool m_hasNameTable;
+  bool m_storesColumns;
+  std::mutex m_mutex;
+  std::condition_variable m_changed;
+  Job m_jobs[kNIndicies];
+  //the types with entries to decode, in the order they are needed
+  std::vector<unsigned int> m_order;
+  bool m_stop;
+  std::vector<Worker> m_workers;
+  std::vector<std::thread> m_threads;
+};
+
+#endif
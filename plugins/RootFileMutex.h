@@ -0,0 +1,33 @@
+#ifndef DQMServices_FwkIO_RootFileMutex_h
+#define DQMServices_FwkIO_RootFileMutex_h
+// -*- C++ -*-
+//
+// Package:     FwkIO
+// Function:    rootFileMutex
+//
+/**\function rootFileMutex RootFileMutex.h DQMServices/FwkIO/plugins/RootFileMutex.h
+
+ Description: The one lock for what changes the global state ROOT keeps about files
+
+ Usage:
+    Opening or closing a TFile changes gDirectory and the list of files of gROOT, and
+    reading an object from a file or creating a histogram looks up and adds TClasses and
+    StreamerInfos. None of this is thread safe in ROOT 5 so every thread of DQMRootSource,
+    i.e. the framework thread, the thread reading the next file and the threads decoding
+    MonitorElements, holds this lock while doing it. Reading the entries of a tree whose
+    objects already exist does not need it.
+*/
+
+// system include files
+#include <mutex>
+
+// user include files
+
+// forward declarations
+
+inline std::mutex& rootFileMutex() {
+  static std::mutex s_mutex;
+  return s_mutex;
+}
+
+#endif
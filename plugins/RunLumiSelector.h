@@ -0,0 +1,110 @@
+#ifndef DQMServices_FwkIO_RunLumiSelector_h
+#define DQMServices_FwkIO_RunLumiSelector_h
+// -*- C++ -*-
+//
+// Package:     FwkIO
+// Class  :     RunLumiSelector
+//
+/**\class RunLumiSelector RunLumiSelector.h DQMServices/FwkIO/plugins/RunLumiSelector.h
+
+ Description: Decides which runs and lumis DQMRootSource processes
+
+ Usage:
+    A lumi is selected if its run is within [firstRun, lastRun] (0 means no limit) and,
+    when lumi ranges are given, it is in one of them. A run is selected if at least one
+    of its lumis could be. An end lumi of 0 stands for the whole end run.
+
+    The ranges are sorted and merged once so each lookup is a binary search.
+*/
+
+// system include files
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <stdint.h>
+
+// user include files
+#include "DataFormats/Provenance/interface/LuminosityBlockRange.h"
+
+// forward declarations
+
+class RunLumiSelector {
+public:
+  RunLumiSelector(unsigned int iFirstRun, unsigned int iLastRun, const std::vector<edm::LuminosityBlockRange>& iLumiRanges):
+    m_firstRun(iFirstRun), m_lastRun(iLastRun) {
+    std::vector<Range> ranges;
+    ranges.reserve(iLumiRanges.size());
+    for(std::vector<edm::LuminosityBlockRange>::const_iterator it = iLumiRanges.begin(), itEnd = iLumiRanges.end();
+        it != itEnd;
+        ++it) {
+      const uint64_t begin = key(it->startRun(),it->startLumi());
+      const uint64_t end = key(it->endRun(), 0 == it->endLumi() ? kMaxLumi : it->endLumi());
+      if(begin <= end) {
+        ranges.push_back(Range(begin,end));
+      }
+    }
+    std::sort(ranges.begin(),ranges.end());
+    //overlapping or adjacent ranges are merged so the ends are sorted as well
+    for(std::vector<Range>::const_iterator it = ranges.begin(), itEnd = ranges.end();
+        it != itEnd;
+        ++it) {
+      if(not m_ranges.empty() &&
+         (it->first <= m_ranges.back().second || it->first == m_ranges.back().second+1)) {
+        m_ranges.back().second = std::max(m_ranges.back().second,it->second);
+      } else {
+        m_ranges.push_back(*it);
+      }
+    }
+    m_hasLumiRanges = not iLumiRanges.empty();
+  }
+
+  bool selectsEverything() const {
+    return 0 == m_firstRun && 0 == m_lastRun && not m_hasLumiRanges;
+  }
+
+  bool selectsRun(unsigned int iRun) const {
+    if(not inRunLimits(iRun)) {
+      return false;
+    }
+    if(not m_hasLumiRanges) {
+      return true;
+    }
+    //the first range ending in or after the run must start before the run ends
+    std::vector<Range>::const_iterator itFound = std::lower_bound(m_ranges.begin(),m_ranges.end(),key(iRun,0),endsBefore);
+    return itFound != m_ranges.end() && itFound->first <= key(iRun,kMaxLumi);
+  }
+
+  bool selectsLumi(unsigned int iRun, unsigned int iLumi) const {
+    if(not inRunLimits(iRun)) {
+      return false;
+    }
+    if(not m_hasLumiRanges) {
+      return true;
+    }
+    const uint64_t lumiKey = key(iRun,iLumi);
+    std::vector<Range>::const_iterator itFound = std::lower_bound(m_ranges.begin(),m_ranges.end(),lumiKey,endsBefore);
+    return itFound != m_ranges.end() && itFound->first <= lumiKey;
+  }
+
+private:
+  typedef std::pair<uint64_t,uint64_t> Range;
+  static const unsigned int kMaxLumi = 0xFFFFFFFF;
+
+  static uint64_t key(unsigned int iRun, unsigned int iLumi) {
+    return (static_cast<uint64_t>(iRun)<<32) | iLumi;
+  }
+  static bool endsBefore(const Range& iRange, uint64_t iKey) {
+    return iRange.second < iKey;
+  }
+  bool inRunLimits(unsigned int iRun) const {
+    return (0 == m_firstRun || iRun >= m_firstRun) && (0 == m_lastRun || iRun <= m_lastRun);
+  }
+
+  unsigned int m_firstRun;
+  unsigned int m_lastRun;
+  bool m_hasLumiRanges;
+  //sorted and not overlapping
+  std::vector<Range> m_ranges;
+};
+
+#endif
@@ -20,21 +20,68 @@
 //
 
 
+//The file format version is stored as the title of the TFile
+// 1: the full name of the MonitorElement is stored with each entry
+// 2: each entry only stores an index into the name table kept in the meta data
+// 3: as 2 but the histograms are stored as flat arrays plus an index into the shape
+//    tables kept in the meta data, see HistogramColumns
+// 4: as 3 but the 2D and 3D histograms with few filled bins only store those bins
+// 5: as 4 but an entry of a string or histogram tree whose payload is the same as the one
+//    of an earlier entry of the tree only refers to that entry, see kSameAsBranch
+static const unsigned int kFirstFileFormatVersion = 1;
+static const unsigned int kNameTableFileFormatVersion = 2;
+static const unsigned int kColumnarFileFormatVersion = 3;
+static const unsigned int kSparseFileFormatVersion = 4;
+static const unsigned int kDeduplicatedFileFormatVersion = 5;
+static const unsigned int kLatestFileFormatVersion = kDeduplicatedFileFormatVersion;
+//the first version all of whose readers know the SnapshotMarker entries. Older readers
+// would take a marker for a type index or silently drop the carried forward elements.
+static const unsigned int kSnapshotMarkerFileFormatVersion = kColumnarFileFormatVersion;
+
 //These are the different types where each type has its own TTree
 enum TypeIndex {kIntIndex, kFloatIndex, kStringIndex,
                 kTH1FIndex, kTH1SIndex, kTH1DIndex,
                 kTH2FIndex,kTH2SIndex, kTH2DIndex, kTH3FIndex,
                 kTProfileIndex,kTProfile2DIndex,kNIndicies,kNoTypesStored=1000};
 
+//Only used in the Type branch of the Indices tree. When only the lumi elements
+// which changed are written, each lumi write starts with one of these entries.
+// kCarryForwardSnapshot means elements not stored for that lumi have the same
+// content as in the previous lumi write in the file. Only files starting with
+// kSnapshotMarkerFileFormatVersion have them.
+enum SnapshotMarker {kNoSnapshotMarker=0, kFullSnapshot=1001, kCarryForwardSnapshot=1002};
+
 static const char* const kTypeNames[]={"Ints","Floats","Strings",
                                        "TH1Fs","TH1Ss","TH1Ds",
                                        "TH2Fs", "TH2Ss", "TH2Ds",
                                        "TH3Fs", "TProfiles","TProfile2Ds"};
+//the class stored in the Value branch of each histogram type tree
+static const char* const kTypeClassNames[]={"","","",
+                                            "TH1F","TH1S","TH1D",
+                                            "TH2F","TH2S","TH2D",
+                                            "TH3F","TProfile","TProfile2D"};
 
 //Branches for each TTree type
 static const char* const kFullNameBranch = "FullName";
 static const char* const kFlagBranch = "Flags";
 static const char* const kValueBranch = "Value";
+//replaces kFullNameBranch starting with kNameTableFileFormatVersion
+static const char* const kNameIdBranch = "NameId";
+//replace kValueBranch of the histogram types starting with kColumnarFileFormatVersion
+static const char* const kShapeIdBranch = "ShapeId";
+static const char* const kEntriesBranch = "Entries";
+static const char* const kStatsBranch = "Stats";
+static const char* const kContentsBranch = "Contents";
+static const char* const kSumw2Branch = "Sumw2";
+//only for the profiles
+static const char* const kBinEntriesBranch = "BinEntries";
+static const char* const kBinSumw2Branch = "BinSumw2";
+//only for the 2D and 3D histograms starting with kSparseFileFormatVersion. If not empty
+// the other arrays only hold the values of these bins
+static const char* const kBinsBranch = "Bins";
+//only for the string and histogram trees starting with kDeduplicatedFileFormatVersion.
+// 0 or one plus the entry of the tree holding the payload, the payload of the entry is then empty
+static const char* const kSameAsBranch = "SameAs";
 
 
 //Storage of Run and Lumi information
@@ -48,6 +95,21 @@ static const char* const kTypeBranch = "Type";
 static const char* const kFirstIndex = "FirstIndex";
 static const char* const kLastIndex = "LastIndex";
 
+//Optional, one entry for each entry of the int, float and histogram trees with what is needed
+// for trends. Uses kRunBranch, kLumiBranch, kProcessHistoryIndexBranch, kTypeBranch and
+// kNameIdBranch or kFullNameBranch like the type trees. Entry is the entry in the type tree.
+// For ints and floats Entries and SumOfWeights are 1 and the value is the mean, minimum and maximum.
+static const char* const kSummariesTree = "Summaries";
+static const char* const kSummaryEntryBranch = "Entry";
+static const char* const kSummaryEntriesBranch = "Entries";
+static const char* const kSummarySumOfWeightsBranch = "SumOfWeights";
+//one value per axis
+static const char* const kSummaryMeanBranch = "Mean";
+static const char* const kSummaryRMSBranch = "RMS";
+//of the bins within the axes ranges
+static const char* const kSummaryMinContentBranch = "MinContent";
+static const char* const kSummaryMaxContentBranch = "MaxContent";
+
 //Meta data info
 static const char* const kMetaDataDirectoryAbsolute = "/MetaData";
 static const char* const kMetaDataDirectory = kMetaDataDirectoryAbsolute+1;
@@ -61,4 +123,34 @@ static const char* const kProcessConfigurationPassID = "PassID";
 
 static const char* const kParameterSetTree = "ParameterSets";
 static const char* const kParameterSetBranch = "ParameterSetBlob";
+//compact form of the ParameterSetID of the blob, missing in older files
+static const char* const kParameterSetIDBranch = "ID";
+
+//the entry number in the tree is the id stored in kNameIdBranch
+static const char* const kNameTree = "Names";
+static const char* const kNameFullNameBranch = "FullName";
+static const char* const kNamePathBranch = "Path";
+static const char* const kNameLeafBranch = "Name";
+
+//Directory in the meta data directory holding one tree of shapes for each histogram type,
+// named as the type tree. The entry number in the tree is the id stored in kShapeIdBranch.
+static const char* const kShapesDirectory = "Shapes";
+static const char* const kShapeBranch = "Shape";
+
+//Order in which the entries of the Indices tree should be processed, see IndexOrderBuilder.
+// The order was computed grouping the process histories as given in kReducedHistoriesTree,
+// where each entry is the index of the first process history with the same reduced history.
+// Without entries the tree flags that the Indices entries are already grouped that way so
+// the order is found in one pass, see GroupedIndexOrder. When the entries are not grouped
+// neither tree is written.
+static const char* const kOrderedIndicesTree = "OrderedIndices";
+static const char* const kOrderedIndexBranch = "Index";
+static const char* const kReducedHistoriesTree = "ReducedHistories";
+static const char* const kReducedHistoryIndexBranch = "Index";
+
+//Each entry is the number of entries of the Indices tree when the meta data was last
+// brought up to date. Entries after the last one are ignored when reading since they
+// may refer to elements, names or histories which were never saved.
+static const char* const kCheckpointsTree = "Checkpoints";
+static const char* const kCheckpointNIndicesBranch = "NIndices";
 #endif
@@ -0,0 +1,252 @@
+// -*- C++ -*-
+//
+// Package:    FwkIO
+// Class:      BenchmarkFillDQMStore
+//
+/**\class BenchmarkFillDQMStore BenchmarkFillDQMStore.cc DQMServices/FwkIO/test/BenchmarkFillDQMStore.cc
+
+ Description: Books and fills a synthetic DQMStore of configurable size for the benchmarks
+
+ Implementation:
+     The elements are spread round robin over the given types, so listing a type twice
+     doubles its share, and over nFolders folders. The first lumiFraction of the elements
+     of each type are lumi elements, reset at the beginning of each lumi. Every element is
+     filled fillsPerLumi times at the end of each lumi with random values covering the
+     whole binning, so both the run and the lumi elements have realistic contents.
+*/
+//
+
+
+// system include files
+#include <memory>
+#include <string>
+#include <algorithm>
+#include <cassert>
+#include <vector>
+#include <sstream>
+#include <boost/shared_ptr.hpp>
+#include "TRandom3.h"
+
+// user include files
+#include "FWCore/Framework/interface/Frameworkfwd.h"
+#include "FWCore/Framework/interface/EDAnalyzer.h"
+
+#include "FWCore/Framework/interface/Event.h"
+#include "FWCore/Framework/interface/MakerMacros.h"
+
+#include "FWCore/ParameterSet/interface/ParameterSet.h"
+#include "FWCore/Utilities/interface/EDMException.h"
+
+#include "DQMServices/Core/interface/DQMStore.h"
+#include "DQMServices/Core/interface/MonitorElement.h"
+#include "FWCore/ServiceRegistry/interface/Service.h"
+
+#include "DQMServices/FwkIO/plugins/format.h"
+
+//
+// class declaration
+//
+namespace {
+  struct Binning {
+    int m_nBinsX;
+    int m_nBinsY;
+    int m_nBinsZ;
+  };
+
+  //the axes all go from 0 to the number of bins
+  MonitorElement* book(DQMStore& iStore, unsigned int iType, const std::string& iName, const Binning& iBins) {
+    const int x = iBins.m_nBinsX;
+    const int y = iBins.m_nBinsY;
+    const int z = iBins.m_nBinsZ;
+    switch(iType) {
+      case kIntIndex: return iStore.bookInt(iName);
+      case kFloatIndex: return iStore.bookFloat(iName);
+      case kStringIndex: return iStore.bookString(iName,iName);
+      case kTH1FIndex: return iStore.book1D(iName,iName,x,0,x);
+      case kTH1SIndex: return iStore.book1S(iName,iName,x,0,x);
+      case kTH1DIndex: return iStore.book1DD(iName,iName,x,0,x);
+      case kTH2FIndex: return iStore.book2D(iName,iName,x,0,x,y,0,y);
+      case kTH2SIndex: return iStore.book2S(iName,iName,x,0,x,y,0,y);
+      case kTH2DIndex: return iStore.book2DD(iName,iName,x,0,x,y,0,y);
+      case kTH3FIndex: return iStore.book3D(iName,iName,x,0,x,y,0,y,z,0,z);
+      case kTProfileIndex: return iStore.bookProfile(iName,iName,x,0,x,0,100);
+      case kTProfile2DIndex: return iStore.bookProfile2D(iName,iName,x,0,x,y,0,y,0,100);
+    }
+    assert(false);
+    return 0;
+  }
+
+  class Filler {
+  public:
+    Filler(MonitorElement* iElement, unsigned int iType, const Binning& iBins):
+      m_element(iElement), m_type(iType), m_bins(iBins) {}
+
+    void reset() {
+      if(m_type != kStringIndex) {
+        m_element->Reset();
+      }
+    }
+    void fill(TRandom3& iRandom, unsigned int iNFills) {
+      switch(m_type) {
+        case kIntIndex:
+          m_element->Fill(static_cast<long long>(iRandom.Integer(1000)));
+          return;
+        case kFloatIndex:
+          m_element->Fill(iRandom.Uniform(1000));
+          return;
+        case kStringIndex:
+          return;
+      }
+      const unsigned int dimension = (m_type >= kTH2FIndex and m_type <= kTH2DIndex) or m_type == kTProfileIndex ? 2 :
+                                     (m_type == kTH3FIndex or m_type == kTProfile2DIndex ? 3 : 1);
+      for(unsigned int i = 0; i != iNFills; ++i) {
+        //a profile's last coordinate is the value
+        const double x = iRandom.Uniform(m_bins.m_nBinsX);
+        if(1 == dimension) {
+          m_element->Fill(x);
+          continue;
+        }
+        const double y = m_type == kTProfileIndex ? iRandom.Uniform(100) : iRandom.Uniform(m_bins.m_nBinsY);
+        if(2 == dimension) {
+          m_element->Fill(x,y);
+          continue;
+        }
+        m_element->Fill(x,y,m_type == kTProfile2DIndex ? iRandom.Uniform(100) : iRandom.Uniform(m_bins.m_nBinsZ));
+      }
+    }
+  private:
+    MonitorElement* m_element;
+    unsigned int m_type;
+    Binning m_bins;
+  };
+}
+
+class BenchmarkFillDQMStore :  public edm::EDAnalyzer {
+   public:
+      explicit BenchmarkFillDQMStore(const edm::ParameterSet&);
+      ~BenchmarkFillDQMStore();
+
+      static void fillDescriptions(edm::ConfigurationDescriptions& descriptions);
+
+
+   private:
+      virtual void analyze(edm::Event const&, edm::EventSetup const&);
+      virtual void beginLuminosityBlock(edm::LuminosityBlock const&, edm::EventSetup const&);
+      virtual void endLuminosityBlock(edm::LuminosityBlock const&, edm::EventSetup const&);
+
+      // ----------member data ---------------------------
+      std::vector<boost::shared_ptr<Filler> > m_runFillers;
+      std::vector<boost::shared_ptr<Filler> > m_lumiFillers;
+      unsigned int m_fillsPerLumi;
+      TRandom3 m_random;
+};
+
+//
+// constructors and destructor
+//
+BenchmarkFillDQMStore::BenchmarkFillDQMStore(const edm::ParameterSet& iConfig):
+m_fillsPerLumi(iConfig.getUntrackedParameter<unsigned int>("fillsPerLumi",100)),
+m_random(iConfig.getUntrackedParameter<unsigned int>("seed",42))
+{
+  edm::Service<DQMStore> dstore;
+
+  const unsigned int nElements = iConfig.getUntrackedParameter<unsigned int>("nElements");
+  const unsigned int nFolders = std::max(1U,iConfig.getUntrackedParameter<unsigned int>("nFolders",10));
+  const double lumiFraction = iConfig.getUntrackedParameter<double>("lumiFraction",0.5);
+  Binning bins;
+  bins.m_nBinsX = iConfig.getUntrackedParameter<int>("nBinsX",100);
+  bins.m_nBinsY = iConfig.getUntrackedParameter<int>("nBinsY",100);
+  bins.m_nBinsZ = iConfig.getUntrackedParameter<int>("nBinsZ",10);
+
+  const std::vector<std::string> typeNames = iConfig.getUntrackedParameter<std::vector<std::string> >("types");
+  std::vector<unsigned int> types;
+  for(std::vector<std::string>::const_iterator it = typeNames.begin(), itEnd = typeNames.end(); it != itEnd; ++it) {
+    const char* const* itFound = std::find(kTypeNames,kTypeNames+kNIndicies,*it);
+    if(itFound == kTypeNames+kNIndicies) {
+      throw edm::Exception(edm::errors::Configuration)<<"BenchmarkFillDQMStore types contains '"<<*it<<"' which is not the name of a type tree.";
+    }
+    types.push_back(itFound-kTypeNames);
+  }
+  if(types.empty()) {
+    throw edm::Exception(edm::errors::Configuration)<<"BenchmarkFillDQMStore needs at least one entry in types.";
+  }
+
+  //how many of each type there are, to decide which are lumi elements
+  std::vector<unsigned int> nOfType(types.size(),0);
+  for(unsigned int i = 0; i != nElements; ++i) {
+    ++nOfType[i%types.size()];
+  }
+  std::vector<unsigned int> nBooked(types.size(),0);
+  for(unsigned int i = 0; i != nElements; ++i) {
+    const unsigned int slot = i%types.size();
+    const unsigned int type = types[slot];
+    const bool isLumi = nBooked[slot] < lumiFraction*nOfType[slot];
+    ++nBooked[slot];
+
+    std::ostringstream folder;
+    folder <<"Benchmark/Folder"<<i%nFolders;
+    dstore->setCurrentFolder(folder.str());
+    std::ostringstream name;
+    name <<kTypeNames[type]<<"_"<<i<<(isLumi ? "_lumi" : "");
+    MonitorElement* element = book(*dstore,type,name.str(),bins);
+    if(isLumi) {
+      element->setLumiFlag();
+      m_lumiFillers.push_back(boost::shared_ptr<Filler>(new Filler(element,type,bins)));
+    } else {
+      m_runFillers.push_back(boost::shared_ptr<Filler>(new Filler(element,type,bins)));
+    }
+  }
+}
+
+
+BenchmarkFillDQMStore::~BenchmarkFillDQMStore()
+{
+}
+
+
+//
+// member functions
+//
+
+void
+BenchmarkFillDQMStore::analyze(edm::Event const&, edm::EventSetup const&)
+{
+}
+
+void
+BenchmarkFillDQMStore::beginLuminosityBlock(edm::LuminosityBlock const&, edm::EventSetup const&)
+{
+  for(std::vector<boost::shared_ptr<Filler> >::iterator it = m_lumiFillers.begin(), itEnd = m_lumiFillers.end();
+  it != itEnd;
+  ++it) {
+    (*it)->reset();
+  }
+}
+
+void
+BenchmarkFillDQMStore::endLuminosityBlock(edm::LuminosityBlock const&, edm::EventSetup const&)
+{
+  for(std::vector<boost::shared_ptr<Filler> >::iterator it = m_lumiFillers.begin(), itEnd = m_lumiFillers.end();
+  it != itEnd;
+  ++it) {
+    (*it)->fill(m_random,m_fillsPerLumi);
+  }
+  for(std::vector<boost::shared_ptr<Filler> >::iterator it = m_runFillers.begin(), itEnd = m_runFillers.end();
+  it != itEnd;
+  ++it) {
+    (*it)->fill(m_random,m_fillsPerLumi);
+  }
+}
+
+// ------------ method fills 'descriptions' with the allowed parameters for the module  ------------
+void
+BenchmarkFillDQMStore::fillDescriptions(edm::ConfigurationDescriptions& descriptions) {
+  //The following says we do not know what parameters are allowed so do no validation
+  // Please change this to state exactly what you do use, even if it is no parameters
+  edm::ParameterSetDescription desc;
+  desc.setUnknown();
+  descriptions.addDefault(desc);
+}
+
+//define this as a plug-in
+DEFINE_FWK_MODULE(BenchmarkFillDQMStore);
@@ -0,0 +1,101 @@
+// -*- C++ -*-
+//
+// Package:    FwkIO
+// Class:      BenchmarkTimer
+//
+/**\class BenchmarkTimer BenchmarkTimer.cc DQMServices/FwkIO/test/BenchmarkTimer.cc
+
+ Description: Prints the wall clock time between the beginning and the end of the job
+
+ Implementation:
+     The time runs from beginJob to endJob so it leaves out loading the libraries,
+     parsing the configuration and constructing the modules, which are the same in every
+     benchmark job but vary a lot from job to job. Files are opened after beginJob and
+     the output files are closed before endJob, so both are included. run_benchmarks.py
+     reads the printed line.
+*/
+//
+
+
+// system include files
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+
+// user include files
+#include "FWCore/Framework/interface/Frameworkfwd.h"
+#include "FWCore/Framework/interface/EDAnalyzer.h"
+
+#include "FWCore/Framework/interface/Event.h"
+#include "FWCore/Framework/interface/MakerMacros.h"
+
+#include "FWCore/ParameterSet/interface/ParameterSet.h"
+
+//
+// class declaration
+//
+
+class BenchmarkTimer :  public edm::EDAnalyzer {
+   public:
+      explicit BenchmarkTimer(const edm::ParameterSet&);
+      ~BenchmarkTimer();
+
+      static void fillDescriptions(edm::ConfigurationDescriptions& descriptions);
+
+
+   private:
+      virtual void beginJob();
+      virtual void analyze(edm::Event const&, edm::EventSetup const&);
+      virtual void endJob();
+
+      // ----------member data ---------------------------
+      std::chrono::steady_clock::time_point m_start;
+};
+
+//
+// constructors and destructor
+//
+BenchmarkTimer::BenchmarkTimer(const edm::ParameterSet&)
+{
+}
+
+
+BenchmarkTimer::~BenchmarkTimer()
+{
+}
+
+
+//
+// member functions
+//
+
+void
+BenchmarkTimer::beginJob()
+{
+  m_start = std::chrono::steady_clock::now();
+}
+
+void
+BenchmarkTimer::analyze(edm::Event const&, edm::EventSetup const&)
+{
+}
+
+void
+BenchmarkTimer::endJob()
+{
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - m_start;
+  std::cout <<"BenchmarkTimer seconds "<<std::setprecision(9)<<elapsed.count()<<std::endl;
+}
+
+// ------------ method fills 'descriptions' with the allowed parameters for the module  ------------
+void
+BenchmarkTimer::fillDescriptions(edm::ConfigurationDescriptions& descriptions) {
+  //The following says we do not know what parameters are allowed so do no validation
+  // Please change this to state exactly what you do use, even if it is no parameters
+  edm::ParameterSetDescription desc;
+  desc.setUnknown();
+  descriptions.addDefault(desc);
+}
+
+//define this as a plug-in
+DEFINE_FWK_MODULE(BenchmarkTimer);
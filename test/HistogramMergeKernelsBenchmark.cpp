@@ -0,0 +1,216 @@
+// Compares the result of HistogramMergeKernels::add with TH1::Add and times both
+// when repeatedly adding histograms sized like the tracker maps.
+//
+// Usage: HistogramMergeKernelsBenchmark [number of additions]
+
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <chrono>
+#include <memory>
+
+#include "TH1.h"
+#include "TH2.h"
+#include "TProfile.h"
+#include "TProfile2D.h"
+#include "TRandom3.h"
+
+#include "DQMServices/FwkIO/plugins/HistogramMergeKernels.h"
+
+namespace {
+  bool close(double iLHS, double iRHS) {
+    return std::abs(iLHS-iRHS) <= 1e-9*std::max(1.,std::max(std::abs(iLHS),std::abs(iRHS)));
+  }
+
+  template<class T>
+  bool sameResult(const std::string& iName, T* iFast, T* iSlow) {
+    for(int bin = 0; bin != iSlow->GetNcells(); ++bin) {
+      if(not close(iFast->GetBinContent(bin),iSlow->GetBinContent(bin)) ||
+         not close(iFast->GetBinError(bin),iSlow->GetBinError(bin))) {
+        std::cout <<"ERROR: "<<iName<<" differs in bin "<<bin<<" content "<<iFast->GetBinContent(bin)<<" "<<iSlow->GetBinContent(bin)
+                  <<" error "<<iFast->GetBinError(bin)<<" "<<iSlow->GetBinError(bin)<<std::endl;
+        return false;
+      }
+    }
+    Double_t fastStats[TH1::kNstat] = {0};
+    Double_t slowStats[TH1::kNstat] = {0};
+    iFast->GetStats(fastStats);
+    iSlow->GetStats(slowStats);
+    for(int i = 0; i != TH1::kNstat; ++i) {
+      if(not close(fastStats[i],slowStats[i])) {
+        std::cout <<"ERROR: "<<iName<<" differs in statistic "<<i<<" "<<fastStats[i]<<" "<<slowStats[i]<<std::endl;
+        return false;
+      }
+    }
+    if(not close(iFast->GetEntries(),iSlow->GetEntries())) {
+      std::cout <<"ERROR: "<<iName<<" differs in entries "<<iFast->GetEntries()<<" "<<iSlow->GetEntries()<<std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  void fill(TH1* iHist, TRandom3& iRandom, unsigned int iNFills) {
+    for(unsigned int i = 0; i != iNFills; ++i) {
+      iHist->Fill(iRandom.Gaus(0,30));
+    }
+  }
+  void fill(TH2* iHist, TRandom3& iRandom, unsigned int iNFills) {
+    for(unsigned int i = 0; i != iNFills; ++i) {
+      iHist->Fill(iRandom.Gaus(0,30),iRandom.Gaus(0,30),iRandom.Uniform(2));
+    }
+  }
+  void fill(TProfile* iHist, TRandom3& iRandom, unsigned int iNFills) {
+    for(unsigned int i = 0; i != iNFills; ++i) {
+      iHist->Fill(iRandom.Gaus(0,30),iRandom.Gaus(5,2));
+    }
+  }
+  void fill(TProfile2D* iHist, TRandom3& iRandom, unsigned int iNFills) {
+    for(unsigned int i = 0; i != iNFills; ++i) {
+      iHist->Fill(iRandom.Gaus(0,30),iRandom.Gaus(0,30),iRandom.Gaus(5,2));
+    }
+  }
+
+  //iToAdd is added iNAdds times to two copies of iOriginal, once with each method
+  template<class T>
+  bool compare(const std::string& iName, const T& iOriginal, const T& iToAdd, unsigned int iNAdds) {
+    std::unique_ptr<T> fast(static_cast<T*>(iOriginal.Clone()));
+    std::unique_ptr<T> slow(static_cast<T*>(iOriginal.Clone()));
+    std::unique_ptr<T> toAdd(static_cast<T*>(iToAdd.Clone()));
+
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    for(unsigned int i = 0; i != iNAdds; ++i) {
+      if(not HistogramMergeKernels::add(fast.get(),toAdd.get())) {
+        std::cout <<"ERROR: "<<iName<<" was not handled by HistogramMergeKernels"<<std::endl;
+        return false;
+      }
+    }
+    Clock::time_point middle = Clock::now();
+    for(unsigned int i = 0; i != iNAdds; ++i) {
+      slow->Add(toAdd.get());
+    }
+    Clock::time_point end = Clock::now();
+    if(not sameResult(iName,fast.get(),slow.get())) {
+      return false;
+    }
+    std::cout <<iName<<" ("<<iOriginal.GetNcells()<<" cells) x "<<iNAdds<<"\n"
+              <<" TH1::Add: "<<std::chrono::duration<double>(end-middle).count()<<" s\n"
+              <<" HistogramMergeKernels: "<<std::chrono::duration<double>(middle-start).count()<<" s"<<std::endl;
+    return true;
+  }
+
+  template<class T>
+  bool compareFilled(const std::string& iName, T& iOriginal, T& iToAdd, unsigned int iNAdds, TRandom3& iRandom) {
+    fill(&iOriginal,iRandom,100000);
+    fill(&iToAdd,iRandom,100000);
+    return compare(iName,iOriginal,iToAdd,iNAdds);
+  }
+
+  //Bins going past the range of a Short_t saturate at +-32767, unlike TH1::Add whose
+  // SetBinContent wraps, so the result is checked against the saturated values
+  bool checkShortOverflow() {
+    TH2S original("th2s_overflow","",10,0,10,10,0,10);
+    TH2S toAdd("th2s_overflow_add","",10,0,10,10,0,10);
+    const int high = original.GetBin(2,3);
+    const int low = original.GetBin(5,5);
+    const int inRange = original.GetBin(7,1);
+    original.SetBinContent(high,30000);
+    toAdd.SetBinContent(high,5000);
+    original.SetBinContent(low,-30000);
+    toAdd.SetBinContent(low,-5000);
+    original.SetBinContent(inRange,30000);
+    toAdd.SetBinContent(inRange,2000);
+    if(not HistogramMergeKernels::add(&original,&toAdd)) {
+      std::cout <<"ERROR: TH2S overflow was not handled by HistogramMergeKernels"<<std::endl;
+      return false;
+    }
+    if(original.GetBinContent(high) != 32767 or original.GetBinContent(low) != -32767 or
+       original.GetBinContent(inRange) != 32000) {
+      std::cout <<"ERROR: TH2S overflow gives "<<original.GetBinContent(high)<<" "<<original.GetBinContent(low)
+                <<" "<<original.GetBinContent(inRange)<<" instead of 32767 -32767 32000"<<std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  //the kernels must leave alone what they can not add exactly like TH1::Add
+  bool checkRefused() {
+    TH1F variable("variable","",3,0,3);
+    const double edges[] = {0,1,2,4};
+    TH1F variableToAdd("variableToAdd","",3,edges);
+    TH1F labeled("labeled","",3,0,3);
+    TH1F labeledToAdd("labeledToAdd","",3,0,3);
+    labeledToAdd.GetXaxis()->SetBinLabel(1,"a");
+    TH1F ranged("ranged","",3,0,3);
+    TH1F rangedToAdd("rangedToAdd","",3,0,3);
+    rangedToAdd.GetXaxis()->SetRange(2,3);
+    TH1F limits("limits","",3,0,3);
+    TH1F limitsToAdd("limitsToAdd","",3,0,4);
+    if(HistogramMergeKernels::add(&variable,&variableToAdd) ||
+       HistogramMergeKernels::add(&labeled,&labeledToAdd) ||
+       HistogramMergeKernels::add(&ranged,&rangedToAdd) ||
+       HistogramMergeKernels::add(&limits,&limitsToAdd)) {
+      std::cout <<"ERROR: HistogramMergeKernels added histograms it should have refused"<<std::endl;
+      return false;
+    }
+    return true;
+  }
+}
+
+int main(int argc, char** argv) {
+  unsigned int nAdds = 200;
+  if(argc > 1) {
+    nAdds = std::atoi(argv[1]);
+  }
+  TH1::AddDirectory(kFALSE);
+  TRandom3 random(42);
+
+  if(not checkRefused()) {
+    return 1;
+  }
+
+  bool succeeded = true;
+  {
+    TH1F original("th1f","",100,-100,100);
+    TH1F toAdd("th1f_add","",100,-100,100);
+    succeeded = compareFilled("TH1F",original,toAdd,nAdds,random) && succeeded;
+  }
+  {
+    //one with and one without sumw2
+    TH1D original("th1d","",100,-100,100);
+    TH1D toAdd("th1d_add","",100,-100,100);
+    toAdd.Sumw2();
+    succeeded = compareFilled("TH1D",original,toAdd,nAdds,random) && succeeded;
+  }
+  {
+    TH2F original("th2f","",1500,-100,100,600,-100,100);
+    TH2F toAdd("th2f_add","",1500,-100,100,600,-100,100);
+    original.Sumw2();
+    toAdd.Sumw2();
+    succeeded = compareFilled("TH2F",original,toAdd,nAdds,random) && succeeded;
+  }
+  {
+    TH2S original("th2s","",1500,-100,100,600,-100,100);
+    TH2S toAdd("th2s_add","",1500,-100,100,600,-100,100);
+    succeeded = compareFilled("TH2S",original,toAdd,nAdds,random) && succeeded;
+  }
+  succeeded = checkShortOverflow() && succeeded;
+  {
+    TProfile original("tprofile","",1000,-100,100);
+    TProfile toAdd("tprofile_add","",1000,-100,100);
+    succeeded = compareFilled("TProfile",original,toAdd,nAdds,random) && succeeded;
+  }
+  {
+    TProfile2D original("tprofile2d","",400,-100,100,800,-100,100);
+    TProfile2D toAdd("tprofile2d_add","",400,-100,100,800,-100,100);
+    succeeded = compareFilled("TProfile2D",original,toAdd,nAdds,random) && succeeded;
+  }
+  if(not succeeded) {
+    std::cout <<"FAILED"<<std::endl;
+    return 1;
+  }
+  std::cout <<"SUCCEEDED"<<std::endl;
+  return 0;
+}
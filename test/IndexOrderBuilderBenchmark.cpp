@@ -0,0 +1,225 @@
+// Compares the order produced by IndexOrderBuilder with the std::list/std::map
+// algorithm DQMRootSource used before and times both on a large Indices tree.
+//
+// Usage: IndexOrderBuilderBenchmark [number of entries]
+
+#include <iostream>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <chrono>
+
+#include "DQMServices/FwkIO/plugins/IndexOrderBuilder.h"
+
+namespace {
+  struct Entry {
+    unsigned int m_history;
+    unsigned int m_run;
+    unsigned int m_lumi;
+  };
+
+  //stand in for the ProcessHistoryID digests used as keys by the old algorithm
+  std::string historyDigest(unsigned int iHistory) {
+    std::string digest(32,'0');
+    for(unsigned int i = 0; i != 8; ++i) {
+      digest[31-i] = "0123456789abcdef"[(iHistory >> (4*i)) & 0xF];
+    }
+    return digest;
+  }
+
+  typedef std::pair<std::string, unsigned int> RunKey;
+  struct RunLumiKey {
+    std::string m_history;
+    unsigned int m_run;
+    unsigned int m_lumi;
+    bool operator<(const RunLumiKey& iOther) const {
+      if(m_history == iOther.m_history) {
+        if(m_run == iOther.m_run) {
+          return m_lumi < iOther.m_lumi;
+        }
+        return m_run < iOther.m_run;
+      }
+      return m_history < iOther.m_history;
+    }
+  };
+
+  //the algorithm from DQMRootSource::setupFile before IndexOrderBuilder
+  void oldOrder(const std::vector<Entry>& iEntries, const std::vector<std::string>& iDigests,
+                std::list<unsigned int>& oOrdered) {
+    typedef std::map<RunLumiKey, std::list<unsigned int>::iterator > RunLumiToLastEntryMap;
+    RunLumiToLastEntryMap runLumiToLastEntryMap;
+    typedef std::map<RunKey, std::pair< std::list<unsigned int>::iterator, std::list<unsigned int>::iterator> > RunToFirstLastEntryMap;
+    RunToFirstLastEntryMap runToFirstLastEntryMap;
+
+    for(unsigned int index = 0; index != iEntries.size(); ++index) {
+      const Entry& temp = iEntries[index];
+      RunLumiKey runLumi = {iDigests[temp.m_history],temp.m_run,temp.m_lumi};
+      RunKey runKey(iDigests[temp.m_history],temp.m_run);
+
+      RunLumiToLastEntryMap::iterator itFind = runLumiToLastEntryMap.find(runLumi);
+      if(itFind == runLumiToLastEntryMap.end()) {
+        std::list<unsigned int>::iterator itLastOfRun = oOrdered.end();
+        RunToFirstLastEntryMap::iterator itRunFirstLastEntryFind = runToFirstLastEntryMap.find(runKey);
+        bool needNewEntryInRunFirstLastEntryMap = true;
+        if(itRunFirstLastEntryFind != runToFirstLastEntryMap.end()) {
+          needNewEntryInRunFirstLastEntryMap=false;
+          if(temp.m_lumi!=0) {
+            itLastOfRun = itRunFirstLastEntryFind->second.second;
+            ++itLastOfRun;
+          } else {
+            itLastOfRun = itRunFirstLastEntryFind->second.first;
+          }
+        }
+        std::list<unsigned int>::iterator iter = oOrdered.insert(itLastOfRun,index);
+        runLumiToLastEntryMap[runLumi]=iter;
+        if(needNewEntryInRunFirstLastEntryMap) {
+          runToFirstLastEntryMap[runKey]=std::make_pair(iter,iter);
+        } else {
+          if(temp.m_lumi!=0) {
+            runToFirstLastEntryMap[runKey].second = iter;
+          } else {
+            runToFirstLastEntryMap[runKey].first = iter;
+          }
+        }
+      } else {
+        std::list<unsigned int>::iterator itNext = itFind->second;
+        ++itNext;
+        std::list<unsigned int>::iterator iter = oOrdered.insert(itNext,index);
+        RunToFirstLastEntryMap::iterator itRunFirstLastEntryFind = runToFirstLastEntryMap.find(runKey);
+        if(itRunFirstLastEntryFind->second.second == itFind->second) {
+          itRunFirstLastEntryFind->second.second = iter;
+        }
+        itFind->second = iter;
+      }
+    }
+  }
+
+  void newOrder(const std::vector<Entry>& iEntries, std::vector<unsigned int>& oOrdered) {
+    IndexOrderBuilder builder;
+    builder.reserve(iEntries.size());
+    for(std::vector<Entry>::const_iterator it = iEntries.begin(), itEnd = iEntries.end();
+        it != itEnd;
+        ++it) {
+      builder.add(it->m_history,it->m_run,it->m_lumi);
+    }
+    builder.build(oOrdered);
+  }
+
+  //Looks like the Indices tree of a file made by merging iNFiles files, each holding
+  // the same runs with a few types stored per lumi. Some entries for runs are stored
+  // before the lumis to exercise the reordering.
+  std::vector<Entry> makeMergedIndices(unsigned int iNEntries, unsigned int iNFiles) {
+    std::vector<Entry> entries;
+    entries.reserve(iNEntries);
+    const unsigned int nTypesPerLumi = 4;
+    const unsigned int nLumisPerRun = 200;
+    unsigned int file = 0;
+    while(entries.size() < iNEntries) {
+      const unsigned int history = file % 3;
+      for(unsigned int run = 1; run <= 5 and entries.size() < iNEntries; ++run) {
+        if(file % 2 == 1) {
+          Entry e = {history,run+file % 7,0};
+          entries.push_back(e);
+        }
+        for(unsigned int lumi = 1; lumi <= nLumisPerRun and entries.size() < iNEntries; ++lumi) {
+          for(unsigned int t = 0; t != nTypesPerLumi and entries.size() < iNEntries; ++t) {
+            Entry e = {history,run+file % 7,(lumi*7+file) % nLumisPerRun + 1};
+            entries.push_back(e);
+          }
+        }
+        if(file % 2 == 0 and entries.size() < iNEntries) {
+          Entry e = {history,run+file % 7,0};
+          entries.push_back(e);
+        }
+      }
+      file = (file+1) % iNFiles;
+    }
+    return entries;
+  }
+
+  //several small hand made cases which cover each branch of the old algorithm
+  std::vector<std::vector<Entry> > makeSpecialCases() {
+    std::vector<std::vector<Entry> > cases;
+    const Entry c1[] = {{0,1,1},{0,1,0},{0,1,2},{0,1,1},{0,2,1},{0,1,2},{0,1,0},{0,2,0}};
+    cases.push_back(std::vector<Entry>(c1,c1+sizeof(c1)/sizeof(Entry)));
+    const Entry c2[] = {{0,1,0},{1,1,0},{0,1,1},{1,1,1},{0,1,1},{0,1,0},{1,1,2}};
+    cases.push_back(std::vector<Entry>(c2,c2+sizeof(c2)/sizeof(Entry)));
+    const Entry c3[] = {{0,3,5},{0,3,4},{0,3,5},{0,3,4},{0,3,0}};
+    cases.push_back(std::vector<Entry>(c3,c3+sizeof(c3)/sizeof(Entry)));
+    cases.push_back(std::vector<Entry>());
+    //random interleaving of a few histories, runs and lumis
+    unsigned int seed = 12345;
+    std::vector<Entry> random;
+    for(unsigned int i = 0; i != 10000; ++i) {
+      seed = seed*1103515245U + 12345U;
+      Entry e = {(seed >> 8) % 3, (seed >> 12) % 4 + 1, (seed >> 16) % 6};
+      random.push_back(e);
+    }
+    cases.push_back(random);
+    return cases;
+  }
+
+  bool compare(const std::vector<Entry>& iEntries, const std::vector<std::string>& iDigests,
+               double* oOldTime = 0, double* oNewTime = 0) {
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    std::list<unsigned int> oldOrdered;
+    oldOrder(iEntries,iDigests,oldOrdered);
+    Clock::time_point middle = Clock::now();
+    std::vector<unsigned int> newOrdered;
+    newOrder(iEntries,newOrdered);
+    Clock::time_point end = Clock::now();
+    if(oOldTime) { *oOldTime = std::chrono::duration<double>(middle-start).count();}
+    if(oNewTime) { *oNewTime = std::chrono::duration<double>(end-middle).count();}
+
+    if(oldOrdered.size() != newOrdered.size()) {
+      std::cout <<"ERROR: different number of entries "<<oldOrdered.size()<<" "<<newOrdered.size()<<std::endl;
+      return false;
+    }
+    std::vector<unsigned int>::const_iterator itNew = newOrdered.begin();
+    unsigned int position = 0;
+    for(std::list<unsigned int>::const_iterator it = oldOrdered.begin(), itEnd = oldOrdered.end();
+        it != itEnd;
+        ++it,++itNew,++position) {
+      if(*it != *itNew) {
+        std::cout <<"ERROR: different order at position "<<position<<" expected "<<*it<<" found "<<*itNew<<std::endl;
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+int main(int argc, char** argv) {
+  unsigned int nEntries = 2000000;
+  if(argc > 1) {
+    nEntries = std::atoi(argv[1]);
+  }
+  std::vector<std::string> digests;
+  for(unsigned int i = 0; i != 3; ++i) {
+    digests.push_back(historyDigest(i));
+  }
+
+  std::vector<std::vector<Entry> > cases = makeSpecialCases();
+  for(unsigned int i = 0; i != cases.size(); ++i) {
+    if(not compare(cases[i],digests)) {
+      std::cout <<"FAILED special case "<<i<<std::endl;
+      return 1;
+    }
+  }
+
+  std::vector<Entry> entries = makeMergedIndices(nEntries,10);
+  double oldTime = 0;
+  double newTime = 0;
+  if(not compare(entries,digests,&oldTime,&newTime)) {
+    std::cout <<"FAILED merged indices"<<std::endl;
+    return 1;
+  }
+  std::cout <<"entries: "<<entries.size()<<"\n"
+            <<" std::list/std::map: "<<oldTime<<" s\n"
+            <<" IndexOrderBuilder: "<<newTime<<" s"<<std::endl;
+  std::cout <<"SUCCEEDED"<<std::endl;
+  return 0;
+}
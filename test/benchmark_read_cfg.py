@@ -0,0 +1,26 @@
+#Reads files written by benchmark_write_cfg.py, see run_benchmarks.py
+# cmsRun benchmark_read_cfg.py inputFiles=file:dqm_benchmark.root
+import FWCore.ParameterSet.Config as cms
+from FWCore.ParameterSet.VarParsing import VarParsing
+
+options = VarParsing()
+options.register('inputFiles', '', VarParsing.multiplicity.list, VarParsing.varType.string,
+                 "the files to read, the same run and lumis in several files are merged")
+options.register('skipAllTypes', False, VarParsing.multiplicity.singleton, VarParsing.varType.bool,
+                 "only open the files and build the processing order, no MonitorElement is read")
+options.parseArguments()
+
+#ordered like kTypeNames in plugins/format.h
+allTypes = ["Ints","Floats","Strings","TH1Fs","TH1Ss","TH1Ds","TH2Fs","TH2Ss","TH2Ds","TH3Fs","TProfiles","TProfile2Ds"]
+
+process = cms.Process("READ")
+
+process.source = cms.Source("DQMRootSource",
+                            fileNames = cms.untracked.vstring(*options.inputFiles),
+                            skipTypes = cms.untracked.vstring(*(allTypes if options.skipAllTypes else [])))
+
+#prints the time from beginJob to endJob which run_benchmarks.py uses
+process.timer = cms.EDAnalyzer("BenchmarkTimer")
+process.t = cms.Path(process.timer)
+
+process.add_(cms.Service("DQMStore"))
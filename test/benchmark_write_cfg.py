@@ -0,0 +1,52 @@
+#Writes a synthetic DQMStore, see run_benchmarks.py
+# cmsRun benchmark_write_cfg.py nElements=1000 types=TH1Fs,TH2Fs nLumis=10 outputFile=dqm_benchmark.root
+import FWCore.ParameterSet.Config as cms
+from FWCore.ParameterSet.VarParsing import VarParsing
+
+options = VarParsing()
+options.register('nElements', 1000, VarParsing.multiplicity.singleton, VarParsing.varType.int,
+                 "number of MonitorElements")
+options.register('types', 'TH1Fs', VarParsing.multiplicity.list, VarParsing.varType.string,
+                 "type tree names, the elements are spread round robin over them")
+options.register('nBinsX', 100, VarParsing.multiplicity.singleton, VarParsing.varType.int, "bins along x")
+options.register('nBinsY', 100, VarParsing.multiplicity.singleton, VarParsing.varType.int, "bins along y")
+options.register('nBinsZ', 10, VarParsing.multiplicity.singleton, VarParsing.varType.int, "bins along z")
+options.register('nLumis', 10, VarParsing.multiplicity.singleton, VarParsing.varType.int, "lumis of the one run")
+options.register('fillsPerLumi', 100, VarParsing.multiplicity.singleton, VarParsing.varType.int,
+                 "fills of each histogram in each lumi")
+options.register('lumiFraction', 0.5, VarParsing.multiplicity.singleton, VarParsing.varType.float,
+                 "fraction of the elements which are lumi elements")
+options.register('fileFormatVersion', 1, VarParsing.multiplicity.singleton, VarParsing.varType.int,
+                 "file format version to write")
+options.register('outputFile', '', VarParsing.multiplicity.singleton, VarParsing.varType.string,
+                 "the file to write, nothing is written when empty")
+options.parseArguments()
+
+process =cms.Process("BENCHMARK")
+
+process.source = cms.Source("EmptySource", numberEventsInRun = cms.untracked.uint32(options.nLumis),
+                            numberEventsInLuminosityBlock = cms.untracked.uint32(1))
+
+process.filler = cms.EDAnalyzer("BenchmarkFillDQMStore",
+                                nElements = cms.untracked.uint32(options.nElements),
+                                types = cms.untracked.vstring(*options.types),
+                                nBinsX = cms.untracked.int32(options.nBinsX),
+                                nBinsY = cms.untracked.int32(options.nBinsY),
+                                nBinsZ = cms.untracked.int32(options.nBinsZ),
+                                fillsPerLumi = cms.untracked.uint32(options.fillsPerLumi),
+                                lumiFraction = cms.untracked.double(options.lumiFraction))
+
+#prints the time from beginJob to endJob which run_benchmarks.py uses
+process.timer = cms.EDAnalyzer("BenchmarkTimer")
+
+process.p = cms.Path(process.filler+process.timer)
+
+if options.outputFile:
+    process.out = cms.OutputModule("DQMRootOutputModule",
+                                   fileName = cms.untracked.string(options.outputFile),
+                                   fileFormatVersion = cms.untracked.uint32(options.fileFormatVersion))
+    process.o = cms.EndPath(process.out)
+
+process.maxEvents = cms.untracked.PSet(input = cms.untracked.int32(options.nLumis))
+
+process.add_(cms.Service("DQMStore"))
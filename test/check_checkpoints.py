@@ -0,0 +1,22 @@
+import ROOT as R
+import sys
+
+#file written by create_run_lumi_file_checkpoint_cfg.py, one Indices entry per lumi
+# and a checkpoint every 3 lumis followed by the one made when the file is closed
+f = R.TFile.Open(sys.argv[1])
+
+expected = [3,6,9,11]
+
+checkpoints = f.Get("MetaData/Checkpoints")
+found = list()
+for i in xrange(0,checkpoints.GetEntries()):
+    checkpoints.GetEntry(i)
+    found.append(checkpoints.NIndices)
+
+if found != expected:
+    print "ERROR: found checkpoints",found,"expected",expected
+    sys.exit(1)
+
+if f.Get("Indices").GetEntries() != expected[-1]:
+    print "ERROR: wrong number of entries in Indices",f.Get("Indices").GetEntries()
+    sys.exit(1)
@@ -0,0 +1,43 @@
+import ROOT as R
+import sys
+
+#Checks that dqmFastCopy of dqm_run_lumi_name_table.root and dqm_run_lumi_name_table_other.root,
+# whose name tables differ, resolves every NameId of the copy to the right name
+f = R.TFile.Open(sys.argv[1])
+
+names = list()
+nameTree = f.Get("MetaData/Names")
+for i in xrange(0,nameTree.GetEntries()):
+    nameTree.GetEntry(i)
+    names.append(str(nameTree.FullName))
+
+if len(set(names)) != len(names):
+    print "ERROR: the name table has duplicates",names
+    sys.exit(1)
+
+def expectedMean(name):
+    #FooN is filled with N and BarN with 10+N, for the run and the lumi elements
+    base = name.split("_")[0]
+    if base.startswith("Foo"):
+        return float(base[3:])
+    return 10.+float(base[3:])
+
+th1fs = f.Get("TH1Fs")
+nBar = 0
+for i in xrange(0,th1fs.GetEntries()):
+    th1fs.GetEntry(i)
+    if th1fs.NameId >= len(names):
+        print "ERROR: NameId",th1fs.NameId,"is not in the name table"
+        sys.exit(1)
+    name = names[th1fs.NameId]
+    if name.startswith("Bar"):
+        nBar += 1
+    if abs(th1fs.Value.GetMean() - expectedMean(name)) > 1e-6:
+        print "ERROR: entry",i,"named",name,"has mean",th1fs.Value.GetMean()
+        sys.exit(1)
+
+if nBar == 0:
+    print "ERROR: the entries of the second file are missing"
+    sys.exit(1)
+
+print "SUCCEEDED"
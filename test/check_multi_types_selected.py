@@ -0,0 +1,31 @@
+import ROOT as R
+import sys
+
+f = R.TFile.Open(sys.argv[1])
+
+th1fs = f.Get("TH1Fs")
+th2fs = f.Get("TH2Fs")
+
+nRuns = 1
+nLumiPerRun = 10
+#only Foo0 to Foo4 are selected and the TH2Fs are skipped
+nSelected = 5
+
+if 0 != th2fs.GetEntries():
+    print "wrong number of entries in TH2Fs",th2fs.GetEntries(),"expected 0"
+    sys.exit(1)
+
+expected = nRuns*nSelected+nRuns*nLumiPerRun*nSelected
+if expected != th1fs.GetEntries():
+    print "wrong number of entries in TH1Fs",th1fs.GetEntries(),"expected",expected
+    sys.exit(1)
+
+selected = ["Foo"+str(j) for j in xrange(0,nSelected)]
+selected += [name+"_lumi" for name in selected]
+for i in xrange(0,th1fs.GetEntries()):
+    th1fs.GetEntry(i)
+    if th1fs.FullName not in selected:
+        print "ERROR: unexpected element",th1fs.FullName
+        sys.exit(1)
+
+print "SUCCEEDED"
@@ -0,0 +1,83 @@
+import ROOT as R
+import sys
+
+#Checks the stored processing order of the Indices tree of the file given as argument
+f = R.TFile.Open(sys.argv[1])
+
+indices = f.Get("Indices")
+ordered = f.Get("MetaData/OrderedIndices")
+reduced = f.Get("MetaData/ReducedHistories")
+
+if not ordered or not reduced:
+    print "ERROR: missing OrderedIndices or ReducedHistories"
+    sys.exit(1)
+
+reducedIndex = list()
+for i in xrange(0,reduced.GetEntries()):
+    reduced.GetEntry(i)
+    reducedIndex.append(reduced.Index)
+
+keys = list()
+for i in xrange(0,indices.GetEntries()):
+    indices.GetEntry(i)
+    keys.append((reducedIndex[indices.ProcessHistoryIndex],indices.Run,indices.Lumi))
+
+if ordered.GetEntries() != 0:
+    print "ERROR: OrderedIndices must be empty, the flag that the entries are grouped"
+    sys.exit(1)
+
+#each run and each lumi of a run is contiguous and the run entries are processed before
+# the lumis of the run
+order = list()
+runStart = 0
+for i in xrange(0,len(keys)+1):
+    if i == len(keys) or keys[i][0:2] != keys[runStart][0:2]:
+        order.extend([j for j in xrange(runStart,i) if keys[j][2] == 0])
+        order.extend([j for j in xrange(runStart,i) if keys[j][2] != 0])
+        runStart = i
+lumiKeys = [k for k in keys if k[2] != 0]
+for i in xrange(1,len(lumiKeys)):
+    if lumiKeys[i] != lumiKeys[i-1] and lumiKeys[i] in lumiKeys[0:i]:
+        print "ERROR: flagged as grouped but lumi",lumiKeys[i],"is not contiguous"
+        sys.exit(1)
+
+if sorted(order) != range(0,len(keys)):
+    print "ERROR: OrderedIndices is not a permutation of the Indices entries"
+    sys.exit(1)
+
+#each run/lumi must be contiguous and keep the file order
+seen = set()
+previous = None
+for position,index in enumerate(order):
+    key = keys[index]
+    if key != previous:
+        if key in seen:
+            print "ERROR: run/lumi",key,"is not contiguous at position",position
+            sys.exit(1)
+        seen.add(key)
+    elif order[position-1] > index:
+        print "ERROR: file order not kept for",key,"at position",position
+        sys.exit(1)
+    previous = key
+
+#runs in order of first appearance with the run entries first
+firstAppearance = list()
+for key in keys:
+    if key[0:2] not in firstAppearance:
+        firstAppearance.append(key[0:2])
+runOrder = list()
+for index in order:
+    run = keys[index][0:2]
+    if not runOrder or runOrder[-1] != run:
+        runOrder.append(run)
+if runOrder != firstAppearance:
+    print "ERROR: runs are not in order of first appearance",runOrder,firstAppearance
+    sys.exit(1)
+for position,index in enumerate(order):
+    if keys[index][2] == 0 and position > 0:
+        before = keys[order[position-1]]
+        if before[0:2] == keys[index][0:2] and before[2] != 0:
+            print "ERROR: run entry after a lumi of the same run at position",position
+            sys.exit(1)
+
+print "SUCCEEDED"
@@ -0,0 +1,83 @@
+import ROOT as R
+import sys
+
+#first argument is the file, second is 'changed' if the file was written with
+# writeOnlyChangedLumiElements or 'complete' if it was written from such a file
+f = R.TFile.Open(sys.argv[1])
+onlyChanged = sys.argv[2] == 'changed'
+
+th1fs = f.Get("TH1Fs")
+
+#files written with writeOnlyChangedLumiElements are at least file format version 3,
+# so the names are in the name table and the histograms are stored as columns
+names = None
+if th1fs.GetBranch("NameId"):
+    names = list()
+    nameTree = f.Get("MetaData/Names")
+    for i in xrange(0,nameTree.GetEntries()):
+        nameTree.GetEntry(i)
+        names.append(str(nameTree.FullName))
+
+indices = f.Get("Indices")
+
+kTH1FIndex = 3
+kFullSnapshot = 1001
+kCarryForwardSnapshot = 1002
+
+nLumis = 10
+nHists = 10
+
+#run, lumi, type, first index, last index
+expectedIndices = list()
+values = list()
+lastIndex = -1
+for l in xrange(0,nLumis):
+    if onlyChanged:
+        if l == 0:
+            expectedIndices.append( (1,l+1,kFullSnapshot,0,0) )
+        else:
+            #the content of the lumi elements never changes
+            expectedIndices.append( (1,l+1,kCarryForwardSnapshot,0,0) )
+            continue
+    startIndex = lastIndex+1
+    for j in xrange(0,nHists):
+        lastIndex +=1
+        values.append(("Foo"+str(j)+"_lumi", 0, 1.0))
+    expectedIndices.append( (1,l+1,kTH1FIndex,startIndex,lastIndex) )
+startIndex = lastIndex+1
+for j in xrange(0,nHists):
+    lastIndex +=1
+    values.append(("Foo"+str(j), 0, 1.0))
+expectedIndices.append( (1,0,kTH1FIndex,startIndex,lastIndex) )
+
+if len(values) != th1fs.GetEntries():
+    print "wrong number of entries in TH1Fs",th1fs.GetEntries()
+    sys.exit(1)
+
+if len(expectedIndices) != indices.GetEntries():
+    print "wrong number of entries in Indices", indices.GetEntries()
+    sys.exit(1)
+
+for indexTreeIndex in xrange(0,indices.GetEntries()):
+    indices.GetEntry(indexTreeIndex)
+    v = (indices.Run,indices.Lumi,indices.Type,indices.FirstIndex,indices.LastIndex)
+    if v != expectedIndices[indexTreeIndex]:
+        print 'ERROR: unexpected value for indices at entry :',indexTreeIndex
+        print ' expected:', expectedIndices[indexTreeIndex]
+        print ' found:',v
+        sys.exit(1)
+    if indices.Type != kTH1FIndex:
+        continue
+    for ihist in xrange(indices.FirstIndex,indices.LastIndex+1):
+        th1fs.GetEntry(ihist)
+        if names is None:
+            v = (th1fs.FullName,th1fs.Flags,th1fs.Value.GetEntries())
+        else:
+            v = (names[th1fs.NameId],th1fs.Flags,th1fs.Entries)
+        if v != values[ihist]:
+            print 'ERROR: unexpected value for index :',ihist
+            print ' expected:',values[ihist]
+            print ' found:',v
+            sys.exit(1)
+
+print "SUCCEEDED"
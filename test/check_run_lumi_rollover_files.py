@@ -0,0 +1,44 @@
+import ROOT as R
+import sys
+
+#files written by create_run_lumi_file_rollover_cfg.py, at most 4 lumis per file
+expectedLumis = [ [1,2,3,4], [5,6,7,8], [9,10] ]
+fileNames = ["dqm_run_lumi_rollover.root","dqm_run_lumi_rollover001.root","dqm_run_lumi_rollover002.root"]
+
+kTH1FIndex = 3
+nHists = 10
+
+for fileIndex in xrange(0,len(fileNames)):
+    f = R.TFile.Open(fileNames[fileIndex])
+    if not f or f.IsZombie():
+        print "ERROR: could not open",fileNames[fileIndex]
+        sys.exit(1)
+    if not f.Get("MetaData/ProcessHistories"):
+        print "ERROR: no meta data in",fileNames[fileIndex]
+        sys.exit(1)
+    indices = f.Get("Indices")
+    lumis = list()
+    hasRun = False
+    for i in xrange(0,indices.GetEntries()):
+        indices.GetEntry(i)
+        if indices.Run != 1:
+            print "ERROR: unexpected run",indices.Run,"in",fileNames[fileIndex]
+            sys.exit(1)
+        if indices.Lumi == 0:
+            hasRun = True
+            continue
+        if indices.Type != kTH1FIndex or indices.LastIndex-indices.FirstIndex+1 != nHists:
+            print "ERROR: unexpected content for lumi",indices.Lumi,"in",fileNames[fileIndex]
+            sys.exit(1)
+        lumis.append(indices.Lumi)
+    if lumis != expectedLumis[fileIndex]:
+        print "ERROR: found lumis",lumis,"in",fileNames[fileIndex],"expected",expectedLumis[fileIndex]
+        sys.exit(1)
+    #the run is only written when it ends
+    if hasRun != (fileIndex == len(fileNames)-1):
+        print "ERROR: unexpected run entry in",fileNames[fileIndex]
+        sys.exit(1)
+
+if R.TFile.Open("dqm_run_lumi_rollover003.root"):
+    print "ERROR: too many files were written"
+    sys.exit(1)
@@ -0,0 +1,43 @@
+import ROOT as R
+import sys
+
+f = R.TFile.Open(sys.argv[1])
+
+th1fs = f.Get("TH1Fs")
+summaries = f.Get("Summaries")
+
+nRuns = 10
+nHists = 10
+#same order as the TH1Fs entries, see check_run_lumi_file.py
+expected = list()
+for i in xrange(0,nRuns):
+    for j in xrange(0,nHists):
+        expected.append((i+1,1,"Foo"+str(j)+"_lumi",j))
+    for j in xrange(0,nHists):
+        expected.append((i+1,0,"Foo"+str(j),j))
+
+if len(expected) != summaries.GetEntries():
+    print "wrong number of entries in Summaries",summaries.GetEntries()
+    sys.exit(1)
+
+for index in xrange(0,summaries.GetEntries()):
+    summaries.GetEntry(index)
+    run,lumi,name,value = expected[index]
+    v = (summaries.Run,summaries.Lumi,summaries.FullName,summaries.Type,summaries.Entry)
+    if v != (run,lumi,name,3,index):
+        print 'ERROR: unexpected key for summary',index
+        print ' expected:',(run,lumi,name,3,index)
+        print ' found:',v
+        sys.exit(1)
+    th1fs.GetEntry(summaries.Entry)
+    hist = th1fs.Value
+    stats = (summaries.Entries,summaries.SumOfWeights,summaries.Mean[0],summaries.RMS[0],summaries.MinContent,summaries.MaxContent)
+    fromHist = (hist.GetEntries(),hist.GetSumOfWeights(),hist.GetMean(),hist.GetRMS(),hist.GetMinimum(),hist.GetMaximum())
+    if stats != (1.,1.,float(value),0.,0.,1.) or stats != fromHist:
+        print 'ERROR: unexpected statistics for summary',index
+        print ' expected:',(1.,1.,float(value),0.,0.,1.)
+        print ' from the histogram:',fromHist
+        print ' found:',stats
+        sys.exit(1)
+
+print "SUCCEEDED"
@@ -0,0 +1,15 @@
+import FWCore.ParameterSet.Config as cms
+
+process = cms.Process("READ")
+
+process.source = cms.Source("DQMRootSource",
+                            fileNames = cms.untracked.vstring("file:dqm_file_multi_types.root"),
+                            decodeThreads = cms.untracked.uint32(4))
+
+process.out = cms.OutputModule("DQMRootOutputModule",
+                               fileName = cms.untracked.string("dqm_copy_multi_types_decode_threads.root"))
+process.e = cms.EndPath(process.out)
+
+process.add_(cms.Service("DQMStore"))
+#process.add_(cms.Service("Tracer"))
+
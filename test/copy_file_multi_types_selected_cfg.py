@@ -0,0 +1,15 @@
+import FWCore.ParameterSet.Config as cms
+
+process = cms.Process("READ")
+
+process.source = cms.Source("DQMRootSource",
+                            fileNames = cms.untracked.vstring("file:dqm_file_multi_types.root"),
+                            includePatterns = cms.untracked.vstring("Foo[0-6].*"),
+                            excludePatterns = cms.untracked.vstring("Foo[5-9].*"),
+                            skipTypes = cms.untracked.vstring("TH2Fs"))
+
+process.out = cms.OutputModule("DQMRootOutputModule",
+                               fileName = cms.untracked.string("dqm_copy_multi_types_selected.root"))
+process.e = cms.EndPath(process.out)
+
+process.add_(cms.Service("DQMStore"))
@@ -0,0 +1,16 @@
+import FWCore.ParameterSet.Config as cms
+
+process = cms.Process("READ")
+
+process.source = cms.Source("DQMRootSource",
+                            fileNames = cms.untracked.vstring("file:dqm_file_multi_types.root"))
+
+#only one bin of each 2D histogram is filled per lumi so they are stored sparse
+process.out = cms.OutputModule("DQMRootOutputModule",
+                               fileName = cms.untracked.string("dqm_copy_multi_types_sparse.root"),
+                               fileFormatVersion = cms.untracked.uint32(4),
+                               sparseDensityThreshold = cms.untracked.double(0.25))
+process.e = cms.EndPath(process.out)
+
+process.add_(cms.Service("DQMStore"))
+#process.add_(cms.Service("Tracer"))
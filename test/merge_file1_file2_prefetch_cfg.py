@@ -0,0 +1,13 @@
+import FWCore.ParameterSet.Config as cms
+
+process = cms.Process("READ")
+
+process.source = cms.Source("DQMRootSource",
+                            fileNames = cms.untracked.vstring("file:dqm_file1.root","file:dqm_file2.root"),
+                            prefetchNextFile = cms.untracked.bool(True))
+
+process.out = cms.OutputModule("DQMRootOutputModule",
+                               fileName = cms.untracked.string("dqm_merged_file1_file2_prefetch.root"))
+process.e = cms.EndPath(process.out)
+
+process.add_(cms.Service("DQMStore"))
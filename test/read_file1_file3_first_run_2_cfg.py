@@ -0,0 +1,46 @@
+import FWCore.ParameterSet.Config as cms
+
+process = cms.Process("READ")
+
+#dqm_file1.root only holds run 1 so it is skipped
+process.source = cms.Source("DQMRootSource",
+                            fileNames = cms.untracked.vstring("file:dqm_file1.root","file:dqm_file3.root"),
+                            firstRun = cms.untracked.uint32(2))
+
+seq = cms.untracked.VEventID()
+for r in [2]:
+    #begin run
+    seq.append(cms.EventID(r,0,0))
+    for l in xrange(1,11):
+        #begin lumi
+        seq.append(cms.EventID(r,l,0))
+        #end lumi
+        seq.append(cms.EventID(r,l,0))
+    #end run
+    seq.append(cms.EventID(r,0,0))
+
+process.check = cms.EDAnalyzer("MulticoreRunLumiEventChecker",
+                               eventSequence = seq)
+
+readRunElements = list()
+for i in xrange(0,10):
+ readRunElements.append(cms.untracked.PSet(name=cms.untracked.string("Foo"+str(i)),
+                                           #file3 has means shifted by 1
+                                           means = cms.untracked.vdouble([i+1]),
+                                           entries=cms.untracked.vdouble([1])
+ ))
+
+readLumiElements=list()
+for i in xrange(0,10):
+ readLumiElements.append(cms.untracked.PSet(name=cms.untracked.string("Foo"+str(i)),
+                                           means = cms.untracked.vdouble([i+1 for x in xrange(0,10)]),
+                                           entries=cms.untracked.vdouble([1 for x in xrange(0,10)])
+ ))
+
+process.reader = cms.EDAnalyzer("DummyReadDQMStore",
+                                runElements = cms.untracked.VPSet(*readRunElements),
+                                lumiElements = cms.untracked.VPSet(*readLumiElements) )
+
+process.e = cms.EndPath(process.check+process.reader)
+
+process.add_(cms.Service("DQMStore"))
@@ -0,0 +1,10 @@
+import FWCore.ParameterSet.Config as cms
+
+process = cms.Process("READ")
+
+process.source = cms.Source("DQMRootSource",
+                            fileNames = cms.untracked.vstring("file:dqm_run_lumi_rollover.root",
+                                                              "file:dqm_run_lumi_rollover001.root",
+                                                              "file:dqm_run_lumi_rollover002.root"))
+
+process.add_(cms.Service("DQMStore"))
@@ -0,0 +1,14 @@
+import FWCore.ParameterSet.Config as cms
+
+process = cms.Process("READ")
+
+process.source = cms.Source("DQMRootSource",
+                            fileNames = cms.untracked.vstring("file:dqm_copy_multi_types_sparse.root"),
+                            decodeThreads = cms.untracked.uint32(2))
+
+process.out = cms.OutputModule("DQMRootOutputModule",
+                               fileName = cms.untracked.string("dqm_copy_multi_types_sparse_copy.root"))
+process.e = cms.EndPath(process.out)
+
+process.add_(cms.Service("DQMStore"))
+#process.add_(cms.Service("Tracer"))
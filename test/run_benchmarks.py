@@ -0,0 +1,148 @@
+#!/usr/bin/env python
+#Measures the throughput of DQMRootOutputModule and DQMRootSource on synthetic DQMStores
+# and writes the results as JSON so they can be compared between releases.
+#
+# The times are measured inside each cmsRun job by the BenchmarkTimer module, from beginJob
+# to endJob, so loading the libraries and reading the configuration are not included.
+# Each time is the best of --repeat jobs:
+#  write:      benchmark_write_cfg.py with the output module minus the same job without it
+#  open_index: benchmark_read_cfg.py skipping all types, which only opens the file and
+#              reads the index and the names
+#  read:       benchmark_read_cfg.py of one file minus the same job skipping all types
+#  merge:      the same with --copies copies of the file, so each element is merged
+#              copies-1 times into what the previous copies filled
+#
+# Every result keeps the raw times it was computed from. The noise of a result is the
+# largest spread between the repeated jobs of those times; a result which is not larger
+# than its noise is flagged with belowNoise and has no rates, since they would be
+# meaningless. Use more --repeat, --elements or --lumis to get above the noise.
+#
+# Usage: run_benchmarks.py [--elements 1000] [--types TH1Fs,TH2Fs] [--lumis 10] [-o results.json]
+
+import ROOT as R
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+
+#ordered like kTypeNames in plugins/format.h
+allTypes = ["Ints","Floats","Strings","TH1Fs","TH1Ss","TH1Ds","TH2Fs","TH2Ss","TH2Ds","TH3Fs","TProfiles","TProfile2Ds"]
+
+parser = argparse.ArgumentParser(description="Throughput benchmarks of DQMRootOutputModule and DQMRootSource")
+parser.add_argument("--elements", type=int, default=1000, help="number of MonitorElements")
+parser.add_argument("--types", default="Ints,Floats,TH1Fs,TH1Fs,TH1Fs,TH2Fs,TProfiles",
+                    help="comma separated type tree names, the elements are spread round robin over them")
+parser.add_argument("--binsX", type=int, default=100)
+parser.add_argument("--binsY", type=int, default=100)
+parser.add_argument("--binsZ", type=int, default=10)
+parser.add_argument("--lumis", type=int, default=10, help="number of lumis in the one run")
+parser.add_argument("--fillsPerLumi", type=int, default=100, help="fills of each histogram in each lumi")
+parser.add_argument("--lumiFraction", type=float, default=0.5, help="fraction of the elements which are lumi elements")
+parser.add_argument("--fileFormatVersion", type=int, default=1)
+parser.add_argument("--copies", type=int, default=4, help="number of copies of the file read for the merge measurement")
+parser.add_argument("--repeat", type=int, default=3, help="the best of this many jobs is used for each time")
+parser.add_argument("-o", "--output", default="dqm_benchmark_results.json", help="the JSON file to write")
+args = parser.parse_args()
+
+testDir = os.path.dirname(os.path.abspath(__file__))
+if os.environ.get("LOCAL_TEST_DIR"):
+    testDir = os.environ["LOCAL_TEST_DIR"]
+fileName = "dqm_benchmark.root"
+
+#returns the times printed by BenchmarkTimer of --repeat jobs
+def jobTimes(config, arguments):
+    times = list()
+    for i in xrange(0, args.repeat):
+        job = subprocess.Popen(["cmsRun", os.path.join(testDir, config)] + arguments, stdout=subprocess.PIPE)
+        output = job.communicate()[0]
+        sys.stdout.write(output)
+        if job.returncode != 0:
+            print "ERROR: cmsRun %s %s failed with status %d" % (config, " ".join(arguments), job.returncode)
+            sys.exit(job.returncode)
+        found = [l for l in output.splitlines() if l.startswith("BenchmarkTimer seconds ")]
+        if len(found) != 1:
+            print "ERROR: cmsRun %s %s did not print the BenchmarkTimer time" % (config, " ".join(arguments))
+            sys.exit(1)
+        times.append(float(found[0].split()[2]))
+    return times
+
+def storedEntries(name):
+    f = R.TFile.Open(name)
+    entries = 0
+    for t in allTypes:
+        tree = f.Get(t)
+        if tree:
+            entries += tree.GetEntries()
+    f.Close()
+    return entries
+
+#iTimes are the job times of the measurement and iBaseline those of the job it is compared to, if any
+def result(phase, iTimes, iBaseline, elements, bytes):
+    seconds = min(iTimes)
+    noise = max(iTimes) - min(iTimes)
+    raw = {"measured": iTimes}
+    if iBaseline is not None:
+        seconds -= min(iBaseline)
+        noise = max(noise, max(iBaseline) - min(iBaseline))
+        raw["baseline"] = iBaseline
+    megabytes = bytes / (1024. * 1024.)
+    belowNoise = seconds <= noise
+    return {"phase": phase,
+            "seconds": seconds,
+            "noiseSeconds": noise,
+            "belowNoise": belowNoise,
+            "rawSeconds": raw,
+            "elements": elements,
+            "elementsPerSecond": None if belowNoise else elements / seconds,
+            "megabytes": megabytes,
+            "megabytesPerSecond": None if belowNoise else megabytes / seconds}
+
+writeArguments = ["nElements=%d" % args.elements,
+                  "types=%s" % args.types,
+                  "nBinsX=%d" % args.binsX,
+                  "nBinsY=%d" % args.binsY,
+                  "nBinsZ=%d" % args.binsZ,
+                  "nLumis=%d" % args.lumis,
+                  "fillsPerLumi=%d" % args.fillsPerLumi,
+                  "lumiFraction=%g" % args.lumiFraction,
+                  "fileFormatVersion=%d" % args.fileFormatVersion]
+
+fillOnly = jobTimes("benchmark_write_cfg.py", writeArguments)
+if os.path.exists(fileName):
+    os.remove(fileName)
+fillAndWrite = jobTimes("benchmark_write_cfg.py", writeArguments + ["outputFile=" + fileName])
+
+entries = storedEntries(fileName)
+fileSize = os.path.getsize(fileName)
+
+copies = list()
+for i in xrange(0, args.copies):
+    copy = "dqm_benchmark_copy%d.root" % i
+    shutil.copyfile(fileName, copy)
+    copies.append("file:" + copy)
+
+skipOne = jobTimes("benchmark_read_cfg.py", ["inputFiles=file:" + fileName, "skipAllTypes=True"])
+readOne = jobTimes("benchmark_read_cfg.py", ["inputFiles=file:" + fileName])
+skipCopies = jobTimes("benchmark_read_cfg.py", ["inputFiles=" + ",".join(copies), "skipAllTypes=True"])
+readCopies = jobTimes("benchmark_read_cfg.py", ["inputFiles=" + ",".join(copies)])
+for copy in copies:
+    os.remove(copy[len("file:"):])
+
+results = {"cmsswVersion": os.environ.get("CMSSW_VERSION", ""),
+           "configuration": vars(args),
+           "storedEntries": entries,
+           "fileSizeBytes": fileSize,
+           "results": [result("write", fillAndWrite, fillOnly, entries, fileSize),
+                       result("open_index", skipOne, None, entries, fileSize),
+                       result("read", readOne, skipOne, entries, fileSize),
+                       result("merge", readCopies, skipCopies, entries * args.copies, fileSize * args.copies)]}
+for r in results["results"]:
+    if r["belowNoise"]:
+        print "WARNING: %s took %g s which is not above the noise of %g s" % (r["phase"], r["seconds"], r["noiseSeconds"])
+
+with open(args.output, "w") as out:
+    json.dump(results, out, indent=2, sort_keys=True)
+print json.dumps(results, indent=2, sort_keys=True)
+print "SUCCEEDED"
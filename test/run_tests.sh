@@ -44,6 +44,36 @@ pushd ${LOCAL_TMP_DIR}
   echo ${checkFile} ------------------------------------------------------------
   python ${LOCAL_TEST_DIR}/${checkFile} dqm_run_lumi.root || die "python ${checkFile}" $?
 
+  testConfig=create_run_lumi_file_async_cfg.py
+  rm -f dqm_run_lumi_async.root
+  echo ${testConfig} ------------------------------------------------------------
+  cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
+
+  checkFile=check_run_lumi_file.py
+  echo ${checkFile} ------------------------------------------------------------
+  python ${LOCAL_TEST_DIR}/${checkFile} dqm_run_lumi_async.root || die "python ${checkFile}" $?
+
+  testConfig=create_run_lumi_file_summaries_cfg.py
+  rm -f dqm_run_lumi_summaries.root
+  echo ${testConfig} ------------------------------------------------------------
+  cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
+
+  checkFile=check_run_lumi_summaries.py
+  echo ${checkFile} ------------------------------------------------------------
+  python ${LOCAL_TEST_DIR}/${checkFile} dqm_run_lumi_summaries.root || die "python ${checkFile}" $?
+
+  echo dqmSummary ------------------------------------------------------------
+  dqmSummary --name Foo3 dqm_run_lumi_summaries.root || die "dqmSummary" $?
+
+  testConfig=create_run_lumi_file_io_tuning_cfg.py
+  rm -f dqm_run_lumi_io_tuning.root
+  echo ${testConfig} ------------------------------------------------------------
+  cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
+
+  checkFile=check_run_lumi_file.py
+  echo ${checkFile} ------------------------------------------------------------
+  python ${LOCAL_TEST_DIR}/${checkFile} dqm_run_lumi_io_tuning.root || die "python ${checkFile}" $?
+
   #read write
   testConfig=read_write_run_lumi_file_cfg.py
   rm -f dqm_run_lumi_copy.root
@@ -54,6 +84,109 @@ pushd ${LOCAL_TMP_DIR}
   echo ${checkFile} ------------------------------------------------------------
   python ${LOCAL_TEST_DIR}/${checkFile} dqm_run_lumi_copy.root || die "python ${checkFile}" $?
 
+  #name table
+  testConfig=create_run_lumi_file_name_table_cfg.py
+  rm -f dqm_run_lumi_name_table.root
+  echo ${testConfig} ------------------------------------------------------------
+  cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
+
+  testConfig=read_write_run_lumi_name_table_file_cfg.py
+  rm -f dqm_run_lumi_name_table_copy.root
+  echo ${testConfig} ------------------------------------------------------------
+  cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
+
+  checkFile=check_run_lumi_file.py
+  echo ${checkFile} ------------------------------------------------------------
+  python ${LOCAL_TEST_DIR}/${checkFile} dqm_run_lumi_name_table_copy.root || die "python ${checkFile}" $?
+
+  #different name tables are merged by dqmFastCopy
+  testConfig=create_run_lumi_file_name_table_other_cfg.py
+  rm -f dqm_run_lumi_name_table_other.root
+  echo ${testConfig} ------------------------------------------------------------
+  cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
+
+  rm -f dqm_fast_copy_name_tables.root
+  echo dqmFastCopy ------------------------------------------------------------
+  dqmFastCopy -o dqm_fast_copy_name_tables.root dqm_run_lumi_name_table.root dqm_run_lumi_name_table_other.root || die "dqmFastCopy" $?
+
+  checkFile=check_fast_copy_name_tables.py
+  echo ${checkFile} ------------------------------------------------------------
+  python ${LOCAL_TEST_DIR}/${checkFile} dqm_fast_copy_name_tables.root || die "python ${checkFile}" $?
+
+  #histograms stored as columns
+  testConfig=create_run_lumi_file_columnar_cfg.py
+  rm -f dqm_run_lumi_columnar.root
+  echo ${testConfig} ------------------------------------------------------------
+  cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
+
+  testConfig=read_write_run_lumi_columnar_file_cfg.py
+  rm -f dqm_run_lumi_columnar_copy.root
+  echo ${testConfig} ------------------------------------------------------------
+  cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
+
+  checkFile=check_run_lumi_file.py
+  echo ${checkFile} ------------------------------------------------------------
+  python ${LOCAL_TEST_DIR}/${checkFile} dqm_run_lumi_columnar_copy.root || die "python ${checkFile}" $?
+
+  #payloads stored only once
+  testConfig=write_run_lumi_deduplicated_file_cfg.py
+  rm -f dqm_run_lumi_deduplicated.root
+  echo ${testConfig} ------------------------------------------------------------
+  cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
+
+  testConfig=read_write_run_lumi_deduplicated_file_cfg.py
+  rm -f dqm_run_lumi_deduplicated_copy.root
+  echo ${testConfig} ------------------------------------------------------------
+  cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
+
+  checkFile=check_run_lumi_file.py
+  echo ${checkFile} ------------------------------------------------------------
+  python ${LOCAL_TEST_DIR}/${checkFile} dqm_run_lumi_deduplicated_copy.root || die "python ${checkFile}" $?
+
+  testConfig=create_run_lumi_file_changed_only_cfg.py
+  rm -f dqm_run_lumi_changed_only.root
+  echo ${testConfig} ------------------------------------------------------------
+  cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
+
+  checkFile=check_run_lumi_changed_only_file.py
+  echo ${checkFile} ------------------------------------------------------------
+  python ${LOCAL_TEST_DIR}/${checkFile} dqm_run_lumi_changed_only.root changed || die "python ${checkFile}" $?
+
+  testConfig=read_write_run_lumi_changed_only_file_cfg.py
+  rm -f dqm_run_lumi_changed_only_copy.root
+  echo ${testConfig} ------------------------------------------------------------
+  cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
+
+  checkFile=check_run_lumi_changed_only_file.py
+  echo ${checkFile} ------------------------------------------------------------
+  python ${LOCAL_TEST_DIR}/${checkFile} dqm_run_lumi_changed_only_copy.root complete || die "python ${checkFile}" $?
+
+  testConfig=create_run_lumi_file_rollover_cfg.py
+  rm -f dqm_run_lumi_rollover*.root
+  echo ${testConfig} ------------------------------------------------------------
+  cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
+
+  checkFile=check_run_lumi_rollover_files.py
+  echo ${checkFile} ------------------------------------------------------------
+  python ${LOCAL_TEST_DIR}/${checkFile} || die "python ${checkFile}" $?
+
+  testConfig=read_run_lumi_rollover_files_cfg.py
+  echo ${testConfig} ------------------------------------------------------------
+  cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
+
+  testConfig=create_run_lumi_file_checkpoint_cfg.py
+  rm -f dqm_run_lumi_checkpoint.root
+  echo ${testConfig} ------------------------------------------------------------
+  cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
+
+  checkFile=check_run_lumi_changed_only_file.py
+  echo ${checkFile} ------------------------------------------------------------
+  python ${LOCAL_TEST_DIR}/${checkFile} dqm_run_lumi_checkpoint.root complete || die "python ${checkFile}" $?
+
+  checkFile=check_checkpoints.py
+  echo ${checkFile} ------------------------------------------------------------
+  python ${LOCAL_TEST_DIR}/${checkFile} dqm_run_lumi_checkpoint.root || die "python ${checkFile}" $?
+
   #more than one type
   testConfig=create_file_multi_types_cfg.py
   rm -f dqm_file_multi_types.root
@@ -75,6 +208,50 @@ pushd ${LOCAL_TMP_DIR}
   echo ${checkFile}  ${fileToCheck} ------------------------------------------------------------
   python ${LOCAL_TEST_DIR}/${checkFile} ${fileToCheck} || die "python ${checkFile} ${fileToCheck}" $?
 
+  testConfig=copy_file_multi_types_decode_threads_cfg.py
+  rm -f dqm_copy_multi_types_decode_threads.root
+  echo ${testConfig} ------------------------------------------------------------
+  cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
+
+  checkFile=check_multi_types.py
+  fileToCheck=dqm_copy_multi_types_decode_threads.root
+  echo ${checkFile}  ${fileToCheck} ------------------------------------------------------------
+  python ${LOCAL_TEST_DIR}/${checkFile} ${fileToCheck} || die "python ${checkFile} ${fileToCheck}" $?
+
+  testConfig=copy_file_multi_types_selected_cfg.py
+  rm -f dqm_copy_multi_types_selected.root
+  echo ${testConfig} ------------------------------------------------------------
+  cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
+
+  checkFile=check_multi_types_selected.py
+  fileToCheck=dqm_copy_multi_types_selected.root
+  echo ${checkFile}  ${fileToCheck} ------------------------------------------------------------
+  python ${LOCAL_TEST_DIR}/${checkFile} ${fileToCheck} || die "python ${checkFile} ${fileToCheck}" $?
+
+  testConfig=copy_file_multi_types_sparse_cfg.py
+  rm -f dqm_copy_multi_types_sparse.root
+  echo ${testConfig} ------------------------------------------------------------
+  cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
+
+  testConfig=read_write_multi_types_sparse_file_cfg.py
+  rm -f dqm_copy_multi_types_sparse_copy.root
+  echo ${testConfig} ------------------------------------------------------------
+  cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
+
+  checkFile=check_multi_types.py
+  fileToCheck=dqm_copy_multi_types_sparse_copy.root
+  echo ${checkFile}  ${fileToCheck} ------------------------------------------------------------
+  python ${LOCAL_TEST_DIR}/${checkFile} ${fileToCheck} || die "python ${checkFile} ${fileToCheck}" $?
+
+  rm -f dqm_fast_copy_multi_types.root
+  echo dqmFastCopy ------------------------------------------------------------
+  dqmFastCopy -o dqm_fast_copy_multi_types.root dqm_file_multi_types.root || die "dqmFastCopy" $?
+
+  checkFile=check_multi_types.py
+  fileToCheck=dqm_fast_copy_multi_types.root
+  echo ${checkFile}  ${fileToCheck} ------------------------------------------------------------
+  python ${LOCAL_TEST_DIR}/${checkFile} ${fileToCheck} || die "python ${checkFile} ${fileToCheck}" $?
+
   #merging
   testConfig=create_file1_cfg.py
   rm -f dqm_file1.root
@@ -99,6 +276,10 @@ pushd ${LOCAL_TMP_DIR}
   echo ${testConfig} ------------------------------------------------------------
   cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
 
+  testConfig=read_file1_file3_first_run_2_cfg.py
+  echo ${testConfig} ------------------------------------------------------------
+  cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
+
   testConfig=merge_file1_file2_cfg.py
   rm -f dqm_merged_file1_file2.root
   echo ${testConfig} ------------------------------------------------------------
@@ -108,10 +289,28 @@ pushd ${LOCAL_TMP_DIR}
   echo ${checkFile} ------------------------------------------------------------
   python ${LOCAL_TEST_DIR}/${checkFile} || die "python ${checkFile}" $?
 
+  testConfig=merge_file1_file2_prefetch_cfg.py
+  rm -f dqm_merged_file1_file2_prefetch.root
+  echo ${testConfig} ------------------------------------------------------------
+  cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
+
+  checkFile=check_merged_file1_file2.py
+  echo ${checkFile} ------------------------------------------------------------
+  python ${LOCAL_TEST_DIR}/${checkFile} dqm_merged_file1_file2_prefetch.root || die "python ${checkFile}" $?
+
   testConfig=read_merged_file1_file2_cfg.py
   echo ${testConfig} ------------------------------------------------------------
   cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
 
+  testConfig=merge_file1_file2_columnar_cfg.py
+  rm -f dqm_merged_file1_file2_columnar.root
+  echo ${testConfig} ------------------------------------------------------------
+  cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
+
+  testConfig=read_merged_file1_file2_columnar_cfg.py
+  echo ${testConfig} ------------------------------------------------------------
+  cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
+
   testConfig=merge_file1_file3_file2_cfg.py
   rm -f dqm_merged_file1_file3_file2.root
   echo ${testConfig} ------------------------------------------------------------
@@ -121,6 +320,53 @@ pushd ${LOCAL_TMP_DIR}
   echo ${testConfig} ------------------------------------------------------------
   cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
 
+  testConfig=read_merged_file1_file3_file2_prefetch_cfg.py
+  echo ${testConfig} ------------------------------------------------------------
+  cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
+
+  testConfig=read_merged_file1_file3_file2_decode_threads_cfg.py
+  echo ${testConfig} ------------------------------------------------------------
+  cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
+
+  testConfig=read_merged_file1_file3_file2_lumis_to_process_cfg.py
+  echo ${testConfig} ------------------------------------------------------------
+  cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
+
+  checkFile=check_ordered_indices.py
+  echo ${checkFile} ------------------------------------------------------------
+  python ${LOCAL_TEST_DIR}/${checkFile} dqm_merged_file1_file3_file2.root || die "python ${checkFile}" $?
+
+  #concatenate without merging
+  rm -f dqm_fast_copy_file1_file2.root
+  echo dqmFastCopy ------------------------------------------------------------
+  dqmFastCopy -o dqm_fast_copy_file1_file2.root dqm_file1.root dqm_file2.root || die "dqmFastCopy" $?
+
+  testConfig=read_fast_copy_file1_file2_cfg.py
+  echo ${testConfig} ------------------------------------------------------------
+  cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
+
+  #merge without a DQMStore
+  rm -f dqm_parallel_merged_file1_file2.root
+  echo dqmMerge ------------------------------------------------------------
+  dqmMerge -j 2 -o dqm_parallel_merged_file1_file2.root dqm_file1.root dqm_file2.root || die "dqmMerge" $?
+
+  testConfig=read_parallel_merged_file1_file2_cfg.py
+  echo ${testConfig} ------------------------------------------------------------
+  cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
+
+  checkFile=check_ordered_indices.py
+  echo ${checkFile} ------------------------------------------------------------
+  python ${LOCAL_TEST_DIR}/${checkFile} dqm_parallel_merged_file1_file2.root || die "python ${checkFile}" $?
+
+  #only part of the file is kept
+  rm -f dqm_fast_copy_merged_file1_file3_file2_run1.root
+  echo dqmFastCopy ------------------------------------------------------------
+  dqmFastCopy --run 1 -o dqm_fast_copy_merged_file1_file3_file2_run1.root dqm_merged_file1_file3_file2.root || die "dqmFastCopy" $?
+
+  testConfig=read_fast_copy_merged_run1_cfg.py
+  echo ${testConfig} ------------------------------------------------------------
+  cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
+
   testConfig=create_one_run_one_lumi_run_only_file_cfg.py
   rm -f dqm_one_run_one_lumi_run_only.root
   echo ${testConfig} ------------------------------------------------------------
@@ -165,6 +411,11 @@ pushd ${LOCAL_TMP_DIR}
   echo ${testConfig} ------------------------------------------------------------
   cmsRun -p ${LOCAL_TEST_DIR}/${testConfig} || die "cmsRun ${testConfig}" $?
 
+#benchmarks, only small enough to check they still run
+  rm -f dqm_benchmark_results.json
+  echo run_benchmarks.py ------------------------------------------------------------
+  python ${LOCAL_TEST_DIR}/run_benchmarks.py --elements 20 --lumis 2 --copies 2 --repeat 1 -o dqm_benchmark_results.json || die "python run_benchmarks.py" $?
+
 # empty
   testConfig=create_empty_file_cfg.py
   rm -f dqm_empty.root